@@ -1,82 +1,25 @@
 #include <stdio.h>
-#include <windows.h>
-#include <bcrypt.h>
 #include "amdilc_internal.h"
 
-#define SHA1_SIZE   (20)
 #define NAME_LEN    (64)
 
-static HCRYPTPROV mCryptProvider = 0;
-
-static void freeSource(
-    Source* src);
-
-static void calcSha1(
-    uint8_t* digest,
-    const uint8_t* data,
-    unsigned size)
+static bool isShaderDumpEnabled()
 {
-    HCRYPTHASH hash;
-    DWORD digestSize = 0;
-    DWORD dwordSize = sizeof(DWORD);
-
-    if (mCryptProvider == 0) {
-        // This function is very slow (~250ms), acquire once
-        CryptAcquireContext(&mCryptProvider, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT);
-    }
-
-    CryptCreateHash(mCryptProvider, CALG_SHA1, 0, 0, &hash);
-    CryptHashData(hash, data, size, 0);
-    CryptGetHashParam(hash, HP_HASHSIZE, (BYTE*)&digestSize, &dwordSize, 0);
-    assert(digestSize == SHA1_SIZE);
-    CryptGetHashParam(hash, HP_HASHVAL, digest, &digestSize, 0);
-    CryptDestroyHash(hash);
-}
+    const char* envValue = getenv("GRVK_DUMP_SHADERS");
 
-static void freeDestination(
-    Destination* dst)
-{
-    if (dst->absoluteSrc != NULL) {
-        freeSource(dst->absoluteSrc);
-    }
-    free(dst->absoluteSrc);
+    return envValue != NULL && strcmp(envValue, "1") == 0;
 }
 
-static void freeSource(
-    Source* src)
+bool ilcIsOptimizationEnabled()
 {
-    for (unsigned i = 0; i < src->srcCount; i++) {
-        freeSource(&src->srcs[i]);
-    }
-    free(src->srcs);
-}
+    const char* envValue = getenv("GRVK_DISABLE_SHADER_OPT");
 
-static void freeInstruction(
-    Instruction* instr)
-{
-    for (unsigned i = 0; i < instr->dstCount; i++) {
-        freeDestination(&instr->dsts[i]);
-    }
-    for (unsigned i = 0; i < instr->srcCount; i++) {
-        freeSource(&instr->srcs[i]);
-    }
-    free(instr->dsts);
-    free(instr->srcs);
-    free(instr->extras);
+    return envValue == NULL || strcmp(envValue, "1") != 0;
 }
 
-static void freeKernel(
-    Kernel* kernel)
+bool ilcIsRelaxedPrecisionEnabled()
 {
-    for (unsigned i = 0; i < kernel->instrCount; i++) {
-        freeInstruction(&kernel->instrs[i]);
-    }
-    free(kernel->instrs);
-}
-
-static bool isShaderDumpEnabled()
-{
-    const char* envValue = getenv("GRVK_DUMP_SHADERS");
+    const char* envValue = getenv("GRVK_SHADER_RELAXED_PRECISION");
 
     return envValue != NULL && strcmp(envValue, "1") == 0;
 }
@@ -85,13 +28,12 @@ static void getShaderName(
     char* name,
     unsigned nameLen,
     const uint8_t* code,
-    unsigned size)
+    unsigned size,
+    const uint8_t* hash)
 {
     assert(size >= 2 * sizeof(Token));
     uint8_t shaderType = GET_BITS(((Token*)code)[1], 16, 23);
-    uint8_t hash[SHA1_SIZE];
 
-    calcSha1(hash, code, size);
     snprintf(name, nameLen,
              "%s_%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
              mIlShaderTypeNames[shaderType],
@@ -101,59 +43,193 @@ static void getShaderName(
              hash[15], hash[16], hash[17], hash[18], hash[19]);
 }
 
-static void dumpBuffer(
-    const uint8_t* code,
-    unsigned size,
-    const char* name,
-    const char* format)
+static IlcShader getEmptyShader()
 {
-    char fileName[NAME_LEN];
-    snprintf(fileName, NAME_LEN, "%s_%s.bin", name, format);
-
-    FILE* file = fopen(fileName, "wb");
-    fwrite(code, 1, size, file);
-    fclose(file);
+    return (IlcShader) {
+        .codeSize = 0,
+        .code = NULL,
+        .bindingCount = 0,
+        .bindings = NULL,
+        .inputCount = 0,
+        .inputs = NULL,
+        .outputMask = 0,
+        .isOverridden = false,
+        .name = NULL,
+    };
 }
 
-static void dumpKernel(
-    const Kernel* kernel,
-    const char* name)
+static bool hasMemoryWrites(
+    const Kernel* kernel)
 {
-    char fileName[NAME_LEN];
-    snprintf(fileName, NAME_LEN, "%s_il.txt", name);
+    for (unsigned i = 0; i < kernel->instrCount; i++) {
+        switch (kernel->instrs[i].opcode) {
+        case IL_OP_UAV_STORE:
+        case IL_OP_UAV_RAW_STORE:
+        case IL_OP_UAV_STRUCT_STORE:
+        case IL_OP_UAV_ADD:
+        case IL_OP_UAV_READ_ADD:
+        case IL_OP_APPEND_BUF_ALLOC:
+        case IL_OP_APPEND_BUF_CONSUME:
+            return true;
+        default:
+            break;
+        }
+    }
 
-    FILE* file = fopen(fileName, "w");
-    ilcDumpKernel(file, kernel);
-    fclose(file);
+    return false;
 }
 
-IlcShader ilcCompileShader(
+static IlcShader compileShader(
     const void* code,
-    unsigned size)
+    unsigned size,
+    const uint8_t* baseHash,
+    const uint8_t* hash,
+    uint32_t linkedOutputMask,
+    bool expandRectangles,
+    uint32_t flatOutputMask,
+    IlcControlFlowHints controlFlowHints)
 {
+    char baseName[NAME_LEN];
     char name[NAME_LEN];
-    getShaderName(name, NAME_LEN, code, size);
+    bool dump = isShaderDumpEnabled();
+    IlcShader shader;
+    uint8_t cacheKey[SHA1_SIZE + sizeof(uint32_t)];
+    uint8_t cacheHash[SHA1_SIZE];
+
+    getShaderName(baseName, NAME_LEN, code, size, baseHash);
+    getShaderName(name, NAME_LEN, code, size, hash);
+
+    // Hand-tuned replacements take precedence over everything else, including the variants of
+    // the overridden shader
+    if (ilcOverrideLoad(&shader, baseName)) {
+        if (expandRectangles) {
+            LOGW("%s is overridden, can't expand rectangles\n", baseName);
+            free(shader.code);
+            free(shader.bindings);
+            free(shader.inputs);
+            return getEmptyShader();
+        } else if (linkedOutputMask == ~0u) {
+            LOGI("loaded %s from the override directory\n", baseName);
+        }
+
+        shader.name = strdup(baseName);
+        return shader;
+    }
+
+    // Variants compiled with other control flow hints are cached separately
+    memcpy(cacheKey, hash, SHA1_SIZE);
+    memcpy(&cacheKey[SHA1_SIZE], &controlFlowHints, sizeof(uint32_t));
+    ilcSha1(cacheHash, cacheKey, sizeof(cacheKey));
+
+    // Dumps include debug names, always compile in that case
+    if (!dump && ilcCacheLoad(&shader, cacheHash)) {
+        LOGV("loaded %s from cache\n", name);
+        shader.name = strdup(name);
+        return shader;
+    }
+
     LOGV("compiling %s...\n", name);
 
     Kernel* kernel = ilcDecodeStream((Token*)code, size / sizeof(Token));
-    bool dump = isShaderDumpEnabled();
 
-    if (dump) {
-        dumpBuffer(code, size, name, "il");
-        dumpKernel(kernel, name);
+    // Expanded rectangles call the shader up to 4 times per vertex, which would repeat its
+    // memory writes
+    if (expandRectangles && hasMemoryWrites(kernel)) {
+        LOGW("%s writes to memory, can't expand rectangles\n", name);
+        free(kernel);
+        return getEmptyShader();
     }
 
-    IlcShader shader = ilcCompileKernel(kernel, name);
+    // Debug names are only useful when inspecting dumps
+    shader = ilcCompileKernel(kernel, name, ilcIsOptimizationEnabled(),
+                              ilcIsRelaxedPrecisionEnabled(), controlFlowHints, dump,
+                              linkedOutputMask, expandRectangles, flatOutputMask);
 
+    // Disassembled and written in the background
     if (dump) {
-        dumpBuffer((uint8_t*)shader.code, shader.codeSize, name, "spv");
+        ilcQueueShaderDump(name, code, size, &shader);
+    }
+
+    // Keep the cache free of debug info
+    if (!dump) {
+        ilcCacheStore(&shader, cacheHash);
     }
 
-    freeKernel(kernel);
     free(kernel);
     return shader;
 }
 
+IlcShader ilcCompileShader(
+    const void* code,
+    unsigned size,
+    IlcControlFlowHints controlFlowHints)
+{
+    uint8_t hash[SHA1_SIZE];
+
+    ilcSha1(hash, code, size);
+
+    return compileShader(code, size, hash, hash, ~0u, false, 0, controlFlowHints);
+}
+
+IlcShader ilcCompileLinkedShader(
+    const void* code,
+    unsigned size,
+    uint32_t outputMask,
+    IlcControlFlowHints controlFlowHints)
+{
+    uint8_t key[SHA1_SIZE + sizeof(uint32_t)];
+    uint8_t hash[SHA1_SIZE];
+
+    // Linked variants are identified by the IL code hash and the output mask
+    ilcSha1(key, code, size);
+    memcpy(&key[SHA1_SIZE], &outputMask, sizeof(uint32_t));
+    ilcSha1(hash, key, sizeof(key));
+
+    return compileShader(code, size, key, hash, outputMask, false, 0, controlFlowHints);
+}
+
+IlcShader ilcCompileRectangleVertexShader(
+    const void* code,
+    unsigned size,
+    unsigned psInputCount,
+    const IlcInput* psInputs,
+    IlcControlFlowHints controlFlowHints)
+{
+    uint32_t outputMask = 0;
+    uint32_t flatOutputMask = 0;
+    uint8_t key[SHA1_SIZE + 2 * sizeof(uint32_t)];
+    uint8_t hash[SHA1_SIZE];
+
+    // Only the outputs the pixel shader reads are expanded
+    for (unsigned i = 0; i < psInputCount; i++) {
+        if (psInputs[i].locationIndex < 32) {
+            outputMask |= 1u << psInputs[i].locationIndex;
+
+            if (psInputs[i].interpMode == IL_INTERPMODE_CONSTANT) {
+                flatOutputMask |= 1u << psInputs[i].locationIndex;
+            }
+        }
+    }
+
+    // Rectangle variants are identified by the IL code hash and both masks
+    ilcSha1(key, code, size);
+    memcpy(&key[SHA1_SIZE], &outputMask, sizeof(uint32_t));
+    memcpy(&key[SHA1_SIZE + sizeof(uint32_t)], &flatOutputMask, sizeof(uint32_t));
+    ilcSha1(hash, key, sizeof(key));
+
+    return compileShader(code, size, key, hash, outputMask, true, flatOutputMask,
+                         controlFlowHints);
+}
+
+bool ilcIsVertexShader(
+    const void* code,
+    unsigned size)
+{
+    assert(size >= 2 * sizeof(Token));
+
+    return GET_BITS(((Token*)code)[1], 16, 23) == IL_SHADER_VERTEX;
+}
+
 void ilcDisassembleShader(
     FILE* file,
     const void* code,
@@ -162,6 +238,5 @@ void ilcDisassembleShader(
     Kernel* kernel = ilcDecodeStream((Token*)code, size / sizeof(Token));
 
     ilcDumpKernel(file, kernel);
-    freeKernel(kernel);
     free(kernel);
 }
@@ -1,6 +1,7 @@
 #ifndef AMDILC_H_
 #define AMDILC_H_
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #define VK_NO_PROTOTYPES
@@ -16,6 +17,14 @@ typedef enum _IlcBindingType {
     ILC_BINDING_RESOURCE,
 } IlcBindingType;
 
+typedef enum _IlcControlFlowHints {
+    ILC_HINT_UNROLL = 1 << 0, // Unroll loops with a small constant trip count
+    ILC_HINT_DONT_UNROLL = 1 << 1, // Keep the other loops rolled
+    ILC_HINT_FLATTEN = 1 << 2, // Flatten short branch-free if blocks
+    ILC_HINT_DONT_FLATTEN = 1 << 3, // Keep the other if blocks and switches as branches
+    ILC_HINT_DEFAULT = ILC_HINT_UNROLL | ILC_HINT_FLATTEN,
+} IlcControlFlowHints;
+
 typedef struct _IlcBinding {
     IlcBindingType type;
     uint32_t ilIndex;
@@ -36,17 +45,52 @@ typedef struct _IlcShader {
     IlcBinding* bindings;
     unsigned inputCount;
     IlcInput* inputs;
+    uint32_t outputMask; // Generic outputs of vertex, domain and geometry shaders, by location
+    bool isOverridden; // Loaded from GRVK_SHADER_OVERRIDE_PATH, no variants can be compiled
     char* name;
 } IlcShader;
 
 IlcShader ilcCompileShader(
     const void* code,
-    unsigned size);
+    unsigned size,
+    IlcControlFlowHints controlFlowHints);
+
+// Compiles out the generic outputs that aren't in outputMask, as they aren't read by the next stage
+IlcShader ilcCompileLinkedShader(
+    const void* code,
+    unsigned size,
+    uint32_t outputMask,
+    IlcControlFlowHints controlFlowHints);
+
+// Compiles a vertex shader that draws RECT_LIST rectangles as pairs of triangles, without a
+// geometry shader. Each rectangle takes 6 vertices, counting from the first vertex of the draw.
+// Returns a shader without code if the vertex shader is overridden or writes to memory
+IlcShader ilcCompileRectangleVertexShader(
+    const void* code,
+    unsigned size,
+    unsigned psInputCount,
+    const IlcInput* psInputs,
+    IlcControlFlowHints controlFlowHints);
 
 IlcShader ilcCompileRectangleGeometryShader(
     unsigned psInputCount,
     const IlcInput* psInputs);
 
+// Overrides GRVK_SHADER_CACHE_PATH, call before compiling any shader
+void ilcSetShaderCachePath(
+    const char* path);
+
+// Waits for the queued GRVK_DUMP_SHADERS files to be written
+void ilcFlushShaderDumps();
+
+// Unpacks a GRVK_SHADER_DUMP_ARCHIVE file into the working directory
+bool ilcExtractShaderDumps(
+    const char* path);
+
+bool ilcIsVertexShader(
+    const void* code,
+    unsigned size);
+
 void ilcDisassembleShader(
     FILE* file,
     const void* code,
@@ -0,0 +1,417 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "amdilc_internal.h"
+#include "version.h"
+
+#define CACHE_MAGIC             (0x4B565247) // "GRVK"
+#define CACHE_FORMAT_VERSION    (6)
+#define CACHE_FILE_NAME         "grvk_shader_cache.bin"
+#define VERSION_LEN             (64)
+#define INDEX_INITIAL_SIZE      (256)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t formatVersion;
+    char compilerVersion[VERSION_LEN];
+    uint32_t optimized;
+    uint32_t relaxedPrecision;
+} CacheHeader;
+
+// Followed by the SPIR-V code, the bindings and the inputs
+typedef struct {
+    uint32_t size; // Entry size in bytes, including this header
+    uint8_t hash[SHA1_SIZE];
+    uint32_t codeSize;
+    uint32_t bindingCount;
+    uint32_t inputCount;
+    uint32_t outputMask;
+} CacheEntryHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t ilIndex;
+    uint32_t vkIndex;
+    uint32_t descriptorType;
+    int32_t strideIndex;
+} CacheBinding;
+
+typedef struct {
+    uint32_t locationIndex;
+    uint32_t interpMode;
+} CacheInput;
+
+typedef struct {
+    const uint8_t* hash; // NULL if empty
+    uint64_t offset;
+} CacheIndexEntry;
+
+#ifdef _WIN32
+
+static SRWLOCK mCacheLock = SRWLOCK_INIT;
+static bool mCacheInitialized = false;
+static char* mCachePath = NULL; // Overrides GRVK_SHADER_CACHE_PATH
+static HANDLE mCacheFile = INVALID_HANDLE_VALUE;
+static const uint8_t* mCacheData = NULL; // Mapped view of the entries present at load time
+static uint64_t mCacheDataSize = 0;
+static uint64_t mCacheFileSize = 0;
+static unsigned mIndexEntryCount = 0;
+static unsigned mIndexEntrySize = 0;
+static CacheIndexEntry* mIndexEntries = NULL;
+
+// 64-bit so that counts read from a corrupt cache can't wrap around to a valid size
+static uint64_t getEntrySize(
+    uint32_t codeSize,
+    uint32_t bindingCount,
+    uint32_t inputCount)
+{
+    return sizeof(CacheEntryHeader) + (uint64_t)codeSize +
+           (uint64_t)bindingCount * sizeof(CacheBinding) +
+           (uint64_t)inputCount * sizeof(CacheInput);
+}
+
+static uint32_t getHashKey(
+    const uint8_t* hash)
+{
+    // SHA-1 is uniformly distributed already
+    uint32_t key;
+    memcpy(&key, hash, sizeof(key));
+    return key;
+}
+
+static CacheIndexEntry* findIndexEntry(
+    const uint8_t* hash)
+{
+    if (mIndexEntrySize == 0) {
+        return NULL;
+    }
+
+    unsigned mask = mIndexEntrySize - 1;
+    for (unsigned i = getHashKey(hash) & mask;; i = (i + 1) & mask) {
+        CacheIndexEntry* entry = &mIndexEntries[i];
+
+        if (entry->hash == NULL || memcmp(entry->hash, hash, SHA1_SIZE) == 0) {
+            return entry;
+        }
+    }
+}
+
+static void addIndexEntry(
+    const uint8_t* hash,
+    uint64_t offset)
+{
+    // Keep the load factor under 1/2
+    if (2 * (mIndexEntryCount + 1) > mIndexEntrySize) {
+        unsigned oldEntrySize = mIndexEntrySize;
+        CacheIndexEntry* oldEntries = mIndexEntries;
+
+        mIndexEntrySize = oldEntrySize == 0 ? INDEX_INITIAL_SIZE : 2 * oldEntrySize;
+        mIndexEntries = calloc(mIndexEntrySize, sizeof(CacheIndexEntry));
+        mIndexEntryCount = 0;
+
+        for (unsigned i = 0; i < oldEntrySize; i++) {
+            if (oldEntries[i].hash != NULL) {
+                addIndexEntry(oldEntries[i].hash, oldEntries[i].offset);
+            }
+        }
+
+        free(oldEntries);
+    }
+
+    CacheIndexEntry* entry = findIndexEntry(hash);
+    if (entry->hash == NULL) {
+        *entry = (CacheIndexEntry) { hash, offset };
+        mIndexEntryCount++;
+    }
+}
+
+static bool writeFile(
+    const void* data,
+    unsigned size)
+{
+    DWORD writtenSize = 0;
+
+    return WriteFile(mCacheFile, data, size, &writtenSize, NULL) && writtenSize == size;
+}
+
+static bool resetCacheFile()
+{
+    const CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .formatVersion = CACHE_FORMAT_VERSION,
+        .compilerVersion = GRVK_VERSION,
+        .optimized = ilcIsOptimizationEnabled(),
+        .relaxedPrecision = ilcIsRelaxedPrecisionEnabled(),
+    };
+    LARGE_INTEGER zero = { .QuadPart = 0 };
+
+    if (!SetFilePointerEx(mCacheFile, zero, NULL, FILE_BEGIN) ||
+        !SetEndOfFile(mCacheFile) ||
+        !writeFile(&header, sizeof(header))) {
+        return false;
+    }
+
+    mCacheFileSize = sizeof(header);
+    return true;
+}
+
+static void loadCacheEntries()
+{
+    HANDLE mapping = CreateFileMappingA(mCacheFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        LOGW("failed to map shader cache (%lu)\n", GetLastError());
+        return;
+    }
+
+    // The view stays valid after the mapping handle is closed
+    mCacheData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (mCacheData == NULL) {
+        LOGW("failed to map shader cache view (%lu)\n", GetLastError());
+        return;
+    }
+
+    mCacheDataSize = mCacheFileSize;
+
+    // Index entries, stopping at the first truncated one (e.g. crash while appending)
+    uint64_t offset = sizeof(CacheHeader);
+    unsigned entryCount = 0;
+    while (offset + sizeof(CacheEntryHeader) <= mCacheDataSize) {
+        const CacheEntryHeader* entryHeader = (const CacheEntryHeader*)&mCacheData[offset];
+
+        if (entryHeader->size < sizeof(CacheEntryHeader) ||
+            entryHeader->size != getEntrySize(entryHeader->codeSize, entryHeader->bindingCount,
+                                              entryHeader->inputCount) ||
+            offset + entryHeader->size > mCacheDataSize) {
+            break;
+        }
+
+        addIndexEntry(entryHeader->hash, offset);
+        offset += entryHeader->size;
+        entryCount++;
+    }
+
+    if (offset != mCacheDataSize) {
+        LOGW("discarding %u bytes of invalid shader cache data\n",
+             (unsigned)(mCacheDataSize - offset));
+        mCacheDataSize = offset;
+    }
+
+    mCacheFileSize = offset;
+    LOGI("loaded %u shaders from cache\n", entryCount);
+}
+
+static void initCache()
+{
+    const char* cachePath = mCachePath != NULL ? mCachePath : getenv("GRVK_SHADER_CACHE_PATH");
+    char fileName[MAX_PATH];
+    CacheHeader header;
+    DWORD readSize = 0;
+    LARGE_INTEGER fileSize;
+
+    if (cachePath == NULL || strlen(cachePath) == 0) {
+        return;
+    }
+
+    snprintf(fileName, sizeof(fileName), "%s\\%s", cachePath, CACHE_FILE_NAME);
+    mCacheFile = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mCacheFile == INVALID_HANDLE_VALUE) {
+        LOGW("failed to open shader cache %s (%lu)\n", fileName, GetLastError());
+        return;
+    }
+
+    if (!GetFileSizeEx(mCacheFile, &fileSize)) {
+        fileSize.QuadPart = 0;
+    }
+    mCacheFileSize = fileSize.QuadPart;
+
+    // Start over if the cache was written by another compiler version or configuration
+    if (mCacheFileSize < sizeof(header) ||
+        !ReadFile(mCacheFile, &header, sizeof(header), &readSize, NULL) ||
+        readSize != sizeof(header) ||
+        header.magic != CACHE_MAGIC ||
+        header.formatVersion != CACHE_FORMAT_VERSION ||
+        strncmp(header.compilerVersion, GRVK_VERSION, VERSION_LEN) != 0 ||
+        header.optimized != ilcIsOptimizationEnabled() ||
+        header.relaxedPrecision != ilcIsRelaxedPrecisionEnabled()) {
+        LOGI("creating shader cache %s\n", fileName);
+
+        if (!resetCacheFile()) {
+            LOGW("failed to reset shader cache (%lu)\n", GetLastError());
+            CloseHandle(mCacheFile);
+            mCacheFile = INVALID_HANDLE_VALUE;
+        }
+        return;
+    }
+
+    LOGI("using shader cache %s\n", fileName);
+    loadCacheEntries();
+}
+
+static void lockCache()
+{
+    AcquireSRWLockExclusive(&mCacheLock);
+
+    if (!mCacheInitialized) {
+        initCache();
+        mCacheInitialized = true;
+    }
+}
+
+bool ilcCacheLoad(
+    IlcShader* shader,
+    const uint8_t* hash)
+{
+    bool found = false;
+
+    lockCache();
+
+    const CacheIndexEntry* entry = findIndexEntry(hash);
+
+    // Entries appended during this session aren't mapped
+    if (entry != NULL && entry->hash != NULL && entry->offset < mCacheDataSize) {
+        const uint8_t* data = &mCacheData[entry->offset];
+        const CacheEntryHeader* entryHeader = (const CacheEntryHeader*)data;
+        const uint8_t* codeData = data + sizeof(CacheEntryHeader);
+        const CacheBinding* cacheBindings =
+            (const CacheBinding*)(codeData + entryHeader->codeSize);
+        const CacheInput* cacheInputs =
+            (const CacheInput*)&cacheBindings[entryHeader->bindingCount];
+
+        *shader = (IlcShader) {
+            .codeSize = entryHeader->codeSize,
+            .code = malloc(entryHeader->codeSize),
+            .bindingCount = entryHeader->bindingCount,
+            .bindings = malloc(entryHeader->bindingCount * sizeof(IlcBinding)),
+            .inputCount = entryHeader->inputCount,
+            .inputs = malloc(entryHeader->inputCount * sizeof(IlcInput)),
+            .outputMask = entryHeader->outputMask,
+            .isOverridden = false,
+            .name = NULL,
+        };
+
+        memcpy(shader->code, codeData, entryHeader->codeSize);
+        for (unsigned i = 0; i < shader->bindingCount; i++) {
+            shader->bindings[i] = (IlcBinding) {
+                .type = cacheBindings[i].type,
+                .ilIndex = cacheBindings[i].ilIndex,
+                .vkIndex = cacheBindings[i].vkIndex,
+                .descriptorType = cacheBindings[i].descriptorType,
+                .strideIndex = cacheBindings[i].strideIndex,
+            };
+        }
+        for (unsigned i = 0; i < shader->inputCount; i++) {
+            shader->inputs[i] = (IlcInput) {
+                .locationIndex = cacheInputs[i].locationIndex,
+                .interpMode = cacheInputs[i].interpMode,
+            };
+        }
+
+        found = true;
+    }
+
+    ReleaseSRWLockExclusive(&mCacheLock);
+    return found;
+}
+
+void ilcCacheStore(
+    const IlcShader* shader,
+    const uint8_t* hash)
+{
+    lockCache();
+
+    const CacheIndexEntry* entry = findIndexEntry(hash);
+
+    if (mCacheFile == INVALID_HANDLE_VALUE || (entry != NULL && entry->hash != NULL)) {
+        ReleaseSRWLockExclusive(&mCacheLock);
+        return;
+    }
+
+    // Serialize the entry so that it's appended with a single write
+    uint64_t entrySize = getEntrySize(shader->codeSize, shader->bindingCount, shader->inputCount);
+    uint8_t* data = malloc(entrySize);
+    CacheEntryHeader* entryHeader = (CacheEntryHeader*)data;
+    uint8_t* codeData = data + sizeof(CacheEntryHeader);
+    CacheBinding* cacheBindings = (CacheBinding*)(codeData + shader->codeSize);
+    CacheInput* cacheInputs = (CacheInput*)&cacheBindings[shader->bindingCount];
+
+    *entryHeader = (CacheEntryHeader) {
+        .size = entrySize,
+        .codeSize = shader->codeSize,
+        .bindingCount = shader->bindingCount,
+        .inputCount = shader->inputCount,
+        .outputMask = shader->outputMask,
+    };
+    memcpy(entryHeader->hash, hash, SHA1_SIZE);
+    memcpy(codeData, shader->code, shader->codeSize);
+    for (unsigned i = 0; i < shader->bindingCount; i++) {
+        cacheBindings[i] = (CacheBinding) {
+            .type = shader->bindings[i].type,
+            .ilIndex = shader->bindings[i].ilIndex,
+            .vkIndex = shader->bindings[i].vkIndex,
+            .descriptorType = shader->bindings[i].descriptorType,
+            .strideIndex = shader->bindings[i].strideIndex,
+        };
+    }
+    for (unsigned i = 0; i < shader->inputCount; i++) {
+        cacheInputs[i] = (CacheInput) {
+            .locationIndex = shader->inputs[i].locationIndex,
+            .interpMode = shader->inputs[i].interpMode,
+        };
+    }
+
+    LARGE_INTEGER offset = { .QuadPart = mCacheFileSize };
+    if (SetFilePointerEx(mCacheFile, offset, NULL, FILE_BEGIN) && writeFile(data, entrySize)) {
+        // Index the in-memory hash copy so that the entry isn't appended twice
+        uint8_t* hashCopy = malloc(SHA1_SIZE);
+        memcpy(hashCopy, hash, SHA1_SIZE);
+        addIndexEntry(hashCopy, mCacheFileSize);
+        mCacheFileSize += entrySize;
+    } else {
+        LOGW("failed to write to shader cache (%lu)\n", GetLastError());
+    }
+
+    free(data);
+    ReleaseSRWLockExclusive(&mCacheLock);
+}
+
+void ilcSetShaderCachePath(
+    const char* path)
+{
+    AcquireSRWLockExclusive(&mCacheLock);
+
+    if (mCacheInitialized) {
+        LOGW("shader cache is already initialized, ignoring %s\n", path);
+    } else {
+        free(mCachePath);
+        mCachePath = strdup(path);
+    }
+
+    ReleaseSRWLockExclusive(&mCacheLock);
+}
+
+#else
+
+// The cache relies on Win32 file mapping, native builds (benchmarks) run without it
+
+bool ilcCacheLoad(
+    IlcShader* shader,
+    const uint8_t* hash)
+{
+    return false;
+}
+
+void ilcCacheStore(
+    const IlcShader* shader,
+    const uint8_t* hash)
+{
+}
+
+void ilcSetShaderCachePath(
+    const char* path)
+{
+    LOGW("shader cache isn't supported on this platform, ignoring %s\n", path);
+}
+
+#endif
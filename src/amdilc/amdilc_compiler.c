@@ -19,14 +19,40 @@
 #define COMP_MASK_XYZ       (COMP_MASK_XY | COMP_MASK_Z)
 #define COMP_MASK_XYZW      (COMP_MASK_XYZ | COMP_MASK_W)
 #define NO_STRIDE_INDEX     (-1)
+#define MAX_TEMP_INDEX_SIZE (1 << 16)
+#define ARRAY_INITIAL_SIZE  (16)
+#define INDEX_INITIAL_SIZE  (64)
+
+#define MAX_UNROLL_TRIP_COUNT   (16)
+#define MAX_UNROLL_INSTR_COUNT  (512) // Loop body size times trip count
+#define MAX_FLATTEN_INSTR_COUNT (8)
 
 typedef enum {
     RES_TYPE_GENERIC,
     RES_TYPE_LDS,
     RES_TYPE_ATOMIC_COUNTER,
     RES_TYPE_PUSH_CONSTANTS,
+    RES_TYPE_GENERIC_VEC4, // float4 alias of a generic buffer, for aligned accesses
 } IlcResourceType;
 
+typedef enum {
+    VALUE_TYPE_NONE, // Typeless
+    VALUE_TYPE_FLOAT,
+    VALUE_TYPE_INT,
+    VALUE_TYPE_UINT,
+    VALUE_TYPE_COUNT,
+} IlcValueType;
+
+typedef struct {
+    IlcValueType type;
+    uint8_t componentMask; // Live components
+} IlcTempInfo;
+
+typedef struct {
+    unsigned typeCounts[VALUE_TYPE_COUNT];
+    uint8_t componentMask;
+} IlcTempUsage;
+
 typedef enum {
     BLOCK_IF_ELSE = 1,
     BLOCK_LOOP = 2,
@@ -60,6 +86,18 @@ typedef struct {
     uint32_t ilId;
 } IlcSampler;
 
+typedef struct {
+    uint64_t key;
+    unsigned index; // Array index + 1, 0 if empty
+} IlcIndexEntry;
+
+// Open addressing hash table from a lookup key to an array index
+typedef struct {
+    unsigned entryCount;
+    unsigned entrySize;
+    IlcIndexEntry* entries;
+} IlcIndex;
+
 typedef struct {
     IlcSpvId labelElseId;
     IlcSpvId labelEndId;
@@ -115,11 +153,21 @@ typedef struct {
     IlcSpvId bool4Id;
     unsigned currentStrideIndex;
     unsigned regCount;
+    unsigned regSize;
     IlcRegister* regs;
+    unsigned tempIndexSize;
+    unsigned* tempIndices; // Direct-mapped r# register indices + 1
+    IlcIndex regIndex; // Other registers, by type and number
+    unsigned tempInfoCount;
+    IlcTempInfo* tempInfos; // Dominant type and used width of r# registers
     unsigned resourceCount;
+    unsigned resourceSize;
     IlcResource* resources;
+    IlcIndex resourceIndex;
     unsigned samplerCount;
+    unsigned samplerSize;
     IlcSampler* samplers;
+    IlcIndex samplerIndex;
     unsigned controlFlowBlockCount;
     IlcControlFlowBlock* controlFlowBlocks;
     unsigned hsForkPhaseIdCount;
@@ -127,6 +175,15 @@ typedef struct {
     IlcSpvId hsJoinPhaseId;
     bool isInFunction;
     bool isAfterReturn;
+    bool optimize;
+    bool relaxedPrecision;
+    IlcControlFlowHints controlFlowHints;
+    uint32_t outputMask; // Declared generic outputs, by location
+    uint32_t linkedOutputMask; // Generic outputs read by the next stage
+    bool expandRectangles;
+    uint32_t flatOutputMask; // Generic outputs taken from the first vertex of a rectangle
+    unsigned rectangleInterfaceCount;
+    IlcSpvId* rectangleInterfaceIds;
 } IlcCompiler;
 
 static unsigned getResourceDimensionCount(
@@ -207,6 +264,10 @@ static void emitName(
     const char* prefix,
     unsigned number)
 {
+    if (!compiler->module->hasDebugInfo) {
+        return;
+    }
+
     char name[64];
     snprintf(name, sizeof(name), "%s%u", prefix, number);
     ilcSpvPutName(compiler->module, id, name);
@@ -222,6 +283,17 @@ static IlcSpvId emitVariable(
     return ilcSpvPutVariable(compiler->module, pointerId, storageClass);
 }
 
+static unsigned getComponentMaskCount(
+    uint8_t componentMask)
+{
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < 4; i++) {
+        count += (componentMask >> i) & 1;
+    }
+    return count;
+}
+
 static IlcSpvId emitZeroOneVector(
     IlcCompiler* compiler,
     IlcSpvId componentTypeId)
@@ -235,17 +307,20 @@ static IlcSpvId emitZeroOneVector(
     return ilcSpvPutConstantComposite(compiler->module, vec2Id, 2, consistuentIds);
 }
 
-static IlcSpvId emitShiftMask(
+static IlcSpvId emitByteAddress(
     IlcCompiler* compiler,
-    IlcSpvId srcId)
+    IlcSpvId indexId,
+    IlcSpvId strideId,
+    IlcSpvId offsetId)
 {
-    // Only keep the lower 5 bits of the shift value
-    IlcSpvId maskId = ilcSpvPutConstant(compiler->module, compiler->intId, SHIFT_MASK_LITERAL);
-    const IlcSpvId maskConsistuentIds[] = { maskId, maskId, maskId, maskId };
-    IlcSpvId maskCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->int4Id,
-                                                          4, maskConsistuentIds);
-    return ilcSpvPutOp2(compiler->module, SpvOpBitwiseAnd, compiler->int4Id,
-                        srcId, maskCompositeId);
+    if (strideId == 0) {
+        // Raw
+        return indexId;
+    }
+
+    // Structured
+    IlcSpvId addrId = ilcSpvPutOp2(compiler->module, SpvOpIMul, compiler->intId, indexId, strideId);
+    return ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->intId, addrId, offsetId);
 }
 
 static IlcSpvId emitWordAddress(
@@ -254,19 +329,45 @@ static IlcSpvId emitWordAddress(
     IlcSpvId strideId,
     IlcSpvId offsetId)
 {
-    IlcSpvId addrId;
+    IlcSpvId addrId = emitByteAddress(compiler, indexId, strideId, offsetId);
+    IlcSpvId fourId = ilcSpvPutConstant(compiler->module, compiler->intId, 4);
+    return ilcSpvPutOp2(compiler->module, SpvOpSDiv, compiler->intId, addrId, fourId);
+}
+
+static bool isWholeVectorAccess(
+    const Destination* dst)
+{
+    for (unsigned i = 0; i < 4; i++) {
+        if (dst->component[i] == IL_MODCOMP_NOWRITE) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (strideId == 0) {
-        // Raw
-        addrId = indexId;
-    } else {
-        // Structured
-        addrId = ilcSpvPutOp2(compiler->module, SpvOpIMul, compiler->intId, indexId, strideId);
-        addrId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->intId, addrId, offsetId);
+static IlcSpvId emitVectorAddress(
+    IlcCompiler* compiler,
+    IlcSpvId indexId,
+    IlcSpvId strideId,
+    IlcSpvId offsetId,
+    bool isWholeVector)
+{
+    unsigned vectorSize = 4 * sizeof(float);
+
+    // Partial accesses may only be widened when the whole vector lies within the structure
+    if (!isWholeVector && ilcSpvGetAlignment(compiler->module, strideId) < vectorSize) {
+        return 0;
     }
 
-    IlcSpvId fourId = ilcSpvPutConstant(compiler->module, compiler->intId, 4);
-    return ilcSpvPutOp2(compiler->module, SpvOpSDiv, compiler->intId, addrId, fourId);
+    // Index into the float4 view, or 0 if the address isn't known to be 16-byte aligned.
+    // The address computation is shared with the word address fallback.
+    IlcSpvId addrId = emitByteAddress(compiler, indexId, strideId, offsetId);
+    if (ilcSpvGetAlignment(compiler->module, addrId) < vectorSize) {
+        return 0;
+    }
+
+    IlcSpvId vectorSizeId = ilcSpvPutConstant(compiler->module, compiler->intId, vectorSize);
+    return ilcSpvPutOp2(compiler->module, SpvOpSDiv, compiler->intId, addrId, vectorSizeId);
 }
 
 static IlcSpvId emitVectorTrim(
@@ -329,6 +430,126 @@ static IlcSpvId emitVectorGrow(
     }
 }
 
+static IlcSpvId emitVectorExpand(
+    IlcCompiler* compiler,
+    IlcSpvId vecId,
+    IlcSpvId componentTypeId,
+    uint8_t componentMask)
+{
+    unsigned componentCount = getComponentMaskCount(componentMask);
+
+    if (componentCount == 1) {
+        return emitVectorGrow(compiler, vecId, componentTypeId, 1);
+    }
+
+    // Move packed components back in place, missing ones are left undefined
+    IlcSpvId vec4TypeId = ilcSpvPutVectorType(compiler->module, componentTypeId, 4);
+    IlcSpvWord components[4];
+    unsigned index = 0;
+
+    for (unsigned i = 0; i < 4; i++) {
+        components[i] = componentMask & (1 << i) ? index++ : 0;
+    }
+    return ilcSpvPutVectorShuffle(compiler->module, vec4TypeId, vecId, vecId, 4, components);
+}
+
+static IlcSpvId emitVectorPack(
+    IlcCompiler* compiler,
+    IlcSpvId vecId,
+    IlcSpvId componentTypeId,
+    uint8_t componentMask)
+{
+    unsigned componentCount = getComponentMaskCount(componentMask);
+    IlcSpvWord components[4];
+    unsigned index = 0;
+
+    for (unsigned i = 0; i < 4; i++) {
+        if (componentMask & (1 << i)) {
+            components[index++] = i;
+        }
+    }
+
+    if (componentCount == 1) {
+        return ilcSpvPutCompositeExtract(compiler->module, componentTypeId, vecId, 1, components);
+    }
+
+    IlcSpvId vecTypeId = ilcSpvPutVectorType(compiler->module, componentTypeId, componentCount);
+    return ilcSpvPutVectorShuffle(compiler->module, vecTypeId, vecId, vecId,
+                                  componentCount, components);
+}
+
+static IlcSpvId emitPackedExtract(
+    IlcCompiler* compiler,
+    IlcSpvId vecId,
+    IlcSpvId componentTypeId,
+    unsigned componentCount,
+    unsigned index)
+{
+    if (componentCount == 1) {
+        // Already a scalar
+        return vecId;
+    }
+
+    const IlcSpvWord indexes[] = { index };
+    return ilcSpvPutCompositeExtract(compiler->module, componentTypeId, vecId, 1, indexes);
+}
+
+static IlcSpvId getPackedTypeId(
+    IlcCompiler* compiler,
+    IlcSpvId componentTypeId,
+    uint8_t componentMask)
+{
+    unsigned componentCount = getComponentMaskCount(componentMask);
+
+    if (componentCount == 1) {
+        return componentTypeId;
+    } else if (componentCount == 4) {
+        // Skip the type lookup for common types
+        if (componentTypeId == compiler->floatId) {
+            return compiler->float4Id;
+        } else if (componentTypeId == compiler->intId) {
+            return compiler->int4Id;
+        } else if (componentTypeId == compiler->uintId) {
+            return compiler->uint4Id;
+        } else if (componentTypeId == compiler->boolId) {
+            return compiler->bool4Id;
+        }
+    }
+    return ilcSpvPutVectorType(compiler->module, componentTypeId, componentCount);
+}
+
+static IlcSpvId emitPackedConstant(
+    IlcCompiler* compiler,
+    IlcSpvId componentTypeId,
+    uint8_t componentMask,
+    IlcSpvWord literal)
+{
+    unsigned componentCount = getComponentMaskCount(componentMask);
+    IlcSpvId constantId = ilcSpvPutConstant(compiler->module, componentTypeId, literal);
+
+    if (componentCount == 1) {
+        return constantId;
+    }
+
+    IlcSpvId vecTypeId = ilcSpvPutVectorType(compiler->module, componentTypeId, componentCount);
+    const IlcSpvId constituentIds[] = { constantId, constantId, constantId, constantId };
+    return ilcSpvPutConstantComposite(compiler->module, vecTypeId, componentCount,
+                                      constituentIds);
+}
+
+static IlcSpvId emitShiftMask(
+    IlcCompiler* compiler,
+    IlcSpvId srcId,
+    uint8_t componentMask)
+{
+    // Only keep the lower 5 bits of the shift value
+    IlcSpvId maskId = emitPackedConstant(compiler, compiler->intId, componentMask,
+                                         SHIFT_MASK_LITERAL);
+    return ilcSpvPutOp2(compiler->module, SpvOpBitwiseAnd,
+                        getPackedTypeId(compiler, compiler->intId, componentMask),
+                        srcId, maskId);
+}
+
 static void emitBinding(
     IlcCompiler* compiler,
     IlcBindingType bindingType,
@@ -380,6 +601,135 @@ static void emitBinding(
     };
 }
 
+static uint64_t getIndexKey(
+    uint32_t type,
+    uint32_t num)
+{
+    return ((uint64_t)type << 32) | num;
+}
+
+static IlcIndexEntry* findIndexEntry(
+    const IlcIndex* index,
+    uint64_t key)
+{
+    if (index->entrySize == 0) {
+        return NULL;
+    }
+
+    // Fibonacci hashing spreads the small sequential keys, then linear probing
+    unsigned mask = index->entrySize - 1;
+    for (unsigned i = ((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;; i = (i + 1) & mask) {
+        IlcIndexEntry* entry = &index->entries[i];
+
+        if (entry->index == 0 || entry->key == key) {
+            return entry;
+        }
+    }
+}
+
+static unsigned lookUpIndex(
+    const IlcIndex* index,
+    uint64_t key)
+{
+    const IlcIndexEntry* entry = findIndexEntry(index, key);
+
+    return entry != NULL ? entry->index : 0;
+}
+
+static void addIndexEntry(
+    IlcIndex* index,
+    uint64_t key,
+    unsigned arrayIndex)
+{
+    // Keep the load factor under 1/2
+    if (2 * (index->entryCount + 1) > index->entrySize) {
+        unsigned oldEntrySize = index->entrySize;
+        IlcIndexEntry* oldEntries = index->entries;
+
+        index->entrySize = oldEntrySize == 0 ? INDEX_INITIAL_SIZE : 2 * oldEntrySize;
+        index->entries = calloc(index->entrySize, sizeof(IlcIndexEntry));
+        index->entryCount = 0;
+
+        for (unsigned i = 0; i < oldEntrySize; i++) {
+            if (oldEntries[i].index != 0) {
+                addIndexEntry(index, oldEntries[i].key, oldEntries[i].index - 1);
+            }
+        }
+
+        free(oldEntries);
+    }
+
+    // Keep the first entry on duplicates, like a linear search would
+    IlcIndexEntry* entry = findIndexEntry(index, key);
+    if (entry->index == 0) {
+        *entry = (IlcIndexEntry) { key, arrayIndex + 1 };
+        index->entryCount++;
+    }
+}
+
+static void clearIndex(
+    IlcIndex* index)
+{
+    if (index->entrySize > 0) {
+        memset(index->entries, 0, sizeof(IlcIndexEntry) * index->entrySize);
+    }
+    index->entryCount = 0;
+}
+
+static void indexRegister(
+    IlcCompiler* compiler,
+    unsigned regIndex)
+{
+    const IlcRegister* reg = &compiler->regs[regIndex];
+
+    if (reg->ilType != IL_REGTYPE_TEMP || reg->ilNum >= MAX_TEMP_INDEX_SIZE) {
+        addIndexEntry(&compiler->regIndex, getIndexKey(reg->ilType, reg->ilNum), regIndex);
+        return;
+    }
+
+    // r# numbers are dense, index them directly
+    if (reg->ilNum >= compiler->tempIndexSize) {
+        unsigned oldSize = compiler->tempIndexSize;
+        unsigned size = oldSize == 0 ? INDEX_INITIAL_SIZE : oldSize;
+
+        while (size <= reg->ilNum) {
+            size *= 2;
+        }
+
+        compiler->tempIndexSize = size;
+        compiler->tempIndices = realloc(compiler->tempIndices, sizeof(unsigned) * size);
+        memset(&compiler->tempIndices[oldSize], 0, sizeof(unsigned) * (size - oldSize));
+    }
+
+    if (compiler->tempIndices[reg->ilNum] == 0) {
+        compiler->tempIndices[reg->ilNum] = regIndex + 1;
+    }
+}
+
+static void rebuildIndices(
+    IlcCompiler* compiler)
+{
+    // Array indices shift when registers, resources or samplers get removed
+    if (compiler->tempIndexSize > 0) {
+        memset(compiler->tempIndices, 0, sizeof(unsigned) * compiler->tempIndexSize);
+    }
+    clearIndex(&compiler->regIndex);
+    clearIndex(&compiler->resourceIndex);
+    clearIndex(&compiler->samplerIndex);
+
+    for (unsigned i = 0; i < compiler->regCount; i++) {
+        indexRegister(compiler, i);
+    }
+    for (unsigned i = 0; i < compiler->resourceCount; i++) {
+        const IlcResource* resource = &compiler->resources[i];
+
+        addIndexEntry(&compiler->resourceIndex, getIndexKey(resource->resType, resource->ilId), i);
+    }
+    for (unsigned i = 0; i < compiler->samplerCount; i++) {
+        addIndexEntry(&compiler->samplerIndex, compiler->samplers[i].ilId, i);
+    }
+}
+
 static const IlcRegister* addRegister(
     IlcCompiler* compiler,
     const IlcRegister* reg,
@@ -387,9 +737,14 @@ static const IlcRegister* addRegister(
 {
     emitName(compiler, reg->id, identifier, reg->ilNum);
 
+    if (compiler->regCount == compiler->regSize) {
+        compiler->regSize = MAX(2 * compiler->regSize, ARRAY_INITIAL_SIZE);
+        compiler->regs = realloc(compiler->regs, sizeof(IlcRegister) * compiler->regSize);
+    }
+
+    compiler->regs[compiler->regCount] = *reg;
+    indexRegister(compiler, compiler->regCount);
     compiler->regCount++;
-    compiler->regs = realloc(compiler->regs, sizeof(IlcRegister) * compiler->regCount);
-    compiler->regs[compiler->regCount - 1] = *reg;
 
     return &compiler->regs[compiler->regCount - 1];
 }
@@ -399,15 +754,77 @@ static const IlcRegister* findRegister(
     uint32_t type,
     uint32_t num)
 {
-    for (int i = 0; i < compiler->regCount; i++) {
-        const IlcRegister* reg = &compiler->regs[i];
+    unsigned regIndex;
 
-        if (reg->ilType == type && reg->ilNum == num) {
-            return reg;
-        }
+    if (type == IL_REGTYPE_TEMP && num < MAX_TEMP_INDEX_SIZE) {
+        regIndex = num < compiler->tempIndexSize ? compiler->tempIndices[num] : 0;
+    } else {
+        regIndex = lookUpIndex(&compiler->regIndex, getIndexKey(type, num));
     }
 
-    return NULL;
+    return regIndex != 0 ? &compiler->regs[regIndex - 1] : NULL;
+}
+
+static IlcTempInfo getTempInfo(
+    const IlcCompiler* compiler,
+    uint32_t num)
+{
+    if (num >= compiler->tempInfoCount) {
+        return (IlcTempInfo) { VALUE_TYPE_FLOAT, COMP_MASK_XYZW };
+    }
+    return compiler->tempInfos[num];
+}
+
+static uint8_t getRegisterComponentMask(
+    const IlcCompiler* compiler,
+    const IlcRegister* reg)
+{
+    if (reg->ilType == IL_REGTYPE_TEMP) {
+        return getTempInfo(compiler, reg->ilNum).componentMask;
+    }
+
+    // Leading components
+    return (1 << reg->componentCount) - 1;
+}
+
+static IlcSpvId getValueComponentTypeId(
+    const IlcCompiler* compiler,
+    IlcValueType type)
+{
+    switch (type) {
+    case VALUE_TYPE_INT:
+        return compiler->intId;
+    case VALUE_TYPE_UINT:
+        return compiler->uintId;
+    default:
+        return compiler->floatId;
+    }
+}
+
+static IlcSpvId getValueTypeId(
+    const IlcCompiler* compiler,
+    IlcValueType type)
+{
+    switch (type) {
+    case VALUE_TYPE_INT:
+        return compiler->int4Id;
+    case VALUE_TYPE_UINT:
+        return compiler->uint4Id;
+    default:
+        return compiler->float4Id;
+    }
+}
+
+static IlcSpvId getVectorComponentTypeId(
+    const IlcCompiler* compiler,
+    IlcSpvId typeId)
+{
+    if (typeId == compiler->int4Id) {
+        return compiler->intId;
+    } else if (typeId == compiler->uint4Id) {
+        return compiler->uintId;
+    }
+    return compiler->floatId;
 }
 
 static const IlcRegister* findOrCreateRegister(
@@ -418,16 +835,22 @@ static const IlcRegister* findOrCreateRegister(
     const IlcRegister* reg = findRegister(compiler, type, num);
 
     if (reg == NULL && type == IL_REGTYPE_TEMP) {
-        // Create temporary register
-        IlcSpvId tempTypeId = compiler->float4Id;
+        // Create temporary register, typed after its dominant usage and holding live components
+        IlcTempInfo tempInfo = getTempInfo(compiler, num);
+        unsigned tempComponentCount = getComponentMaskCount(tempInfo.componentMask);
+        IlcSpvId tempComponentTypeId = getValueComponentTypeId(compiler, tempInfo.type);
+        IlcSpvId tempTypeId = tempComponentCount == 1
+                            ? tempComponentTypeId
+                            : ilcSpvPutVectorType(compiler->module, tempComponentTypeId,
+                                                  tempComponentCount);
         IlcSpvId tempId = emitVariable(compiler, tempTypeId, SpvStorageClassPrivate);
 
         const IlcRegister tempReg = {
             .id = tempId,
             .interfaceId = tempId,
             .typeId = tempTypeId,
-            .componentTypeId = compiler->floatId,
-            .componentCount = 4,
+            .componentTypeId = tempComponentTypeId,
+            .componentCount = tempComponentCount,
             .ilType = type,
             .ilNum = num,
             .ilImportUsage = 0,
@@ -445,15 +868,9 @@ static const IlcResource* findResource(
     IlcResourceType resType,
     uint32_t ilId)
 {
-    for (int i = 0; i < compiler->resourceCount; i++) {
-        const IlcResource* resource = &compiler->resources[i];
-
-        if (resource->resType == resType && resource->ilId == ilId) {
-            return resource;
-        }
-    }
+    unsigned resourceIndex = lookUpIndex(&compiler->resourceIndex, getIndexKey(resType, ilId));
 
-    return NULL;
+    return resourceIndex != 0 ? &compiler->resources[resourceIndex - 1] : NULL;
 }
 
 static const IlcResource* addResource(
@@ -466,14 +883,22 @@ static const IlcResource* addResource(
     }
 
     // TODO use emitName
-    char name[32];
-    snprintf(name, sizeof(name), "resource%u.%u", resource->resType, resource->ilId);
-    ilcSpvPutName(compiler->module, resource->id, name);
+    if (compiler->module->hasDebugInfo) {
+        char name[32];
+        snprintf(name, sizeof(name), "resource%u.%u", resource->resType, resource->ilId);
+        ilcSpvPutName(compiler->module, resource->id, name);
+    }
 
+    if (compiler->resourceCount == compiler->resourceSize) {
+        compiler->resourceSize = MAX(2 * compiler->resourceSize, ARRAY_INITIAL_SIZE);
+        compiler->resources = realloc(compiler->resources,
+                                      sizeof(IlcResource) * compiler->resourceSize);
+    }
+
+    compiler->resources[compiler->resourceCount] = *resource;
+    addIndexEntry(&compiler->resourceIndex, getIndexKey(resource->resType, resource->ilId),
+                  compiler->resourceCount);
     compiler->resourceCount++;
-    compiler->resources = realloc(compiler->resources,
-                                  sizeof(IlcResource) * compiler->resourceCount);
-    compiler->resources[compiler->resourceCount - 1] = *resource;
 
     return &compiler->resources[compiler->resourceCount - 1];
 }
@@ -482,15 +907,9 @@ static const IlcSampler* findSampler(
     IlcCompiler* compiler,
     uint32_t ilId)
 {
-    for (int i = 0; i < compiler->samplerCount; i++) {
-        const IlcSampler* sampler = &compiler->samplers[i];
+    unsigned samplerIndex = lookUpIndex(&compiler->samplerIndex, ilId);
 
-        if (sampler->ilId == ilId) {
-            return sampler;
-        }
-    }
-
-    return NULL;
+    return samplerIndex != 0 ? &compiler->samplers[samplerIndex - 1] : NULL;
 }
 
 static const IlcSampler* addSampler(
@@ -504,9 +923,15 @@ static const IlcSampler* addSampler(
 
     emitName(compiler, sampler->id, "sampler", sampler->ilId);
 
+    if (compiler->samplerCount == compiler->samplerSize) {
+        compiler->samplerSize = MAX(2 * compiler->samplerSize, ARRAY_INITIAL_SIZE);
+        compiler->samplers = realloc(compiler->samplers,
+                                     sizeof(IlcSampler) * compiler->samplerSize);
+    }
+
+    compiler->samplers[compiler->samplerCount] = *sampler;
+    addIndexEntry(&compiler->samplerIndex, sampler->ilId, compiler->samplerCount);
     compiler->samplerCount++;
-    compiler->samplers = realloc(compiler->samplers, sizeof(IlcSampler) * compiler->samplerCount);
-    compiler->samplers[compiler->samplerCount - 1] = *sampler;
 
     return &compiler->samplers[compiler->samplerCount - 1];
 }
@@ -577,10 +1002,11 @@ static IlcControlFlowBlock* findControlFlowBlock(
     return NULL;
 }
 
-static IlcSpvId loadSource(
+static IlcSpvId loadSourceComponents(
     IlcCompiler* compiler,
     const Source* src,
     uint8_t componentMask,
+    bool isPacked,
     IlcSpvId typeId)
 {
     const IlcRegister* reg;
@@ -611,9 +1037,8 @@ static IlcSpvId loadSource(
                                              src->hasImmediate ? src->immediate : 0);
         if (src->srcCount > 0) {
             assert(src->srcCount == 1);
-            IlcSpvId rel4Id = loadSource(compiler, &src->srcs[0], COMP_MASK_XYZW,
-                                         compiler->int4Id);
-            IlcSpvId relId = emitVectorTrim(compiler, rel4Id, compiler->int4Id, 0, 1);
+            IlcSpvId relId = loadSourceComponents(compiler, &src->srcs[0], COMP_MASK_X, true,
+                                                  compiler->int4Id);
             indexId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->intId, indexId, relId);
         }
         ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, reg->id, 1, &indexId);
@@ -627,9 +1052,15 @@ static IlcSpvId loadSource(
         ptrId = reg->id;
     }
 
-    IlcSpvId varId = ilcSpvPutLoad(compiler->module, reg->typeId, ptrId);
+    IlcSpvId varId = 0;
     IlcSpvId componentTypeId = 0;
 
+    if (reg->ilType == IL_REGTYPE_LITERAL) {
+        varId = reg->id;
+    } else {
+        varId = ilcSpvPutLoad(compiler->module, reg->typeId, ptrId);
+    }
+
     if (reg->componentTypeId == compiler->boolId) {
         // Promote to float scalar
         componentTypeId = compiler->floatId;
@@ -640,31 +1071,55 @@ static IlcSpvId loadSource(
         componentTypeId = reg->componentTypeId;
     }
 
-    IlcSpvId vec4TypeId = ilcSpvPutVectorType(compiler->module, componentTypeId, 4);
+    IlcSpvId vec4TypeId = getPackedTypeId(compiler, componentTypeId, COMP_MASK_XYZW);
     if (reg->componentCount < 4) {
-        varId = emitVectorGrow(compiler, varId, componentTypeId, reg->componentCount);
+        varId = emitVectorExpand(compiler, varId, componentTypeId,
+                                 getRegisterComponentMask(compiler, reg));
+    }
+
+    IlcSpvId loadTypeId = vec4TypeId;
+    IlcSpvId valueTypeId = typeId;
+    unsigned componentCount = 4;
+    IlcSpvWord components[4];
+    bool isIdentity = true;
+
+    if (isPacked && componentMask != COMP_MASK_XYZW) {
+        // Requested components are moved next to each other, the rest is dropped
+        loadTypeId = getPackedTypeId(compiler, componentTypeId, componentMask);
+        valueTypeId = getPackedTypeId(compiler, getVectorComponentTypeId(compiler, typeId),
+                                      componentMask);
+        componentCount = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            if (componentMask & (1 << i)) {
+                components[componentCount++] = src->swizzle[i];
+            }
+        }
+        isIdentity = false;
+    } else {
+        for (unsigned i = 0; i < 4; i++) {
+            components[i] = componentMask & (1 << i) ? src->swizzle[i] : IL_COMPSEL_0;
+            isIdentity = isIdentity && components[i] == i;
+        }
     }
 
-    const uint8_t swizzle[] = {
-        componentMask & COMP_MASK_X ? src->swizzle[0] : IL_COMPSEL_0,
-        componentMask & COMP_MASK_Y ? src->swizzle[1] : IL_COMPSEL_0,
-        componentMask & COMP_MASK_Z ? src->swizzle[2] : IL_COMPSEL_0,
-        componentMask & COMP_MASK_W ? src->swizzle[3] : IL_COMPSEL_0,
-    };
-
-    if (swizzle[0] != IL_COMPSEL_X_R || swizzle[1] != IL_COMPSEL_Y_G ||
-        swizzle[2] != IL_COMPSEL_Z_B || swizzle[3] != IL_COMPSEL_W_A) {
+    if (isIdentity) {
+        // Nothing to select
+    } else if (componentCount == 1 && components[0] <= IL_COMPSEL_W_A) {
+        varId = ilcSpvPutCompositeExtract(compiler->module, componentTypeId, varId, 1, components);
+    } else if (componentCount == 1) {
+        varId = ilcSpvPutConstant(compiler->module, componentTypeId,
+                                  components[0] == IL_COMPSEL_0 ? ZERO_LITERAL : ONE_LITERAL);
+    } else {
         // Select components from {x, y, z, w, 0.f, 1.f}
         IlcSpvId zeroOneId = emitZeroOneVector(compiler, componentTypeId);
 
-        const IlcSpvWord components[] = { swizzle[0], swizzle[1], swizzle[2], swizzle[3] };
-        varId = ilcSpvPutVectorShuffle(compiler->module, vec4TypeId, varId, zeroOneId,
-                                       4, components);
+        varId = ilcSpvPutVectorShuffle(compiler->module, loadTypeId, varId, zeroOneId,
+                                       componentCount, components);
     }
 
-    if (typeId != vec4TypeId) {
+    if (valueTypeId != loadTypeId) {
         // Need to cast to the expected type
-        varId = ilcSpvPutBitcast(compiler->module, typeId, varId);
+        varId = ilcSpvPutBitcast(compiler->module, valueTypeId, varId);
     }
 
     // All following operations but `neg` are float only (AMDIL spec, table 2.10)
@@ -690,32 +1145,41 @@ static IlcSpvId loadSource(
     }
 
     if (src->abs) {
-        varId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FAbs, compiler->float4Id, 1, &varId);
+        IlcSpvId absTypeId = isPacked ? getPackedTypeId(compiler, compiler->floatId, componentMask)
+                                      : compiler->float4Id;
+        varId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FAbs, absTypeId, 1, &varId);
     }
 
     if (src->negate[0] || src->negate[1] || src->negate[2] || src->negate[3]) {
         IlcSpvId negId = 0;
 
         if (typeId == compiler->float4Id) {
-            negId = ilcSpvPutOp1(compiler->module, SpvOpFNegate, compiler->float4Id, varId);
-        } else if (typeId == compiler->int4Id) {
-            negId = ilcSpvPutOp1(compiler->module, SpvOpSNegate, compiler->int4Id, varId);
+            negId = ilcSpvPutOp1(compiler->module, SpvOpFNegate, valueTypeId, varId);
+        } else if (typeId == compiler->int4Id || typeId == compiler->uint4Id) {
+            // SNegate accepts unsigned operands, the two's complement result is the same
+            negId = ilcSpvPutOp1(compiler->module, SpvOpSNegate, valueTypeId, varId);
         } else {
             assert(false);
         }
 
-        if (src->negate[0] && src->negate[1] && src->negate[2] && src->negate[3]) {
-            varId = negId;
-        } else {
-            // Select components from {-x, -y, -z, -w, x, y, z, w}
-            const IlcSpvWord components[] = {
-                src->negate[0] ? 0 : 4,
-                src->negate[1] ? 1 : 5,
-                src->negate[2] ? 2 : 6,
-                src->negate[3] ? 3 : 7,
-            };
+        // Select components from {-x, -y, -z, -w, x, y, z, w}
+        IlcSpvWord negComponents[4];
+        bool isNegated = true;
+        unsigned index = 0;
+
+        for (unsigned i = 0; i < 4; i++) {
+            if (!isPacked || (componentMask & (1 << i))) {
+                negComponents[index] = src->negate[i] ? index : componentCount + index;
+                isNegated = isNegated && src->negate[i];
+                index++;
+            }
+        }
 
-            varId = ilcSpvPutVectorShuffle(compiler->module, typeId, negId, varId, 4, components);
+        if (isNegated) {
+            varId = negId;
+        } else if (componentCount > 1) {
+            varId = ilcSpvPutVectorShuffle(compiler->module, valueTypeId, negId, varId,
+                                           componentCount, negComponents);
         }
     }
 
@@ -726,22 +1190,63 @@ static IlcSpvId loadSource(
     return varId;
 }
 
-static void storeDestination(
+static IlcSpvId loadSource(
     IlcCompiler* compiler,
-    const Destination* dst,
-    IlcSpvId varId,
+    const Source* src,
+    uint8_t componentMask,
     IlcSpvId typeId)
 {
-    const IlcRegister* reg = findOrCreateRegister(compiler, dst->registerType, dst->registerNum);
+    return loadSourceComponents(compiler, src, componentMask, false, typeId);
+}
+
+static IlcSpvId loadPackedSource(
+    IlcCompiler* compiler,
+    const Source* src,
+    uint8_t componentMask,
+    IlcSpvId typeId)
+{
+    // Components outside of the mask are dropped instead of being zeroed
+    return loadSourceComponents(compiler, src, componentMask, true, typeId);
+}
+
+static void storeDestination(
+    IlcCompiler* compiler,
+    const Destination* dst,
+    IlcSpvId varId,
+    IlcSpvId typeId)
+{
+    const IlcRegister* reg = findOrCreateRegister(compiler, dst->registerType, dst->registerNum);
 
     if (reg == NULL) {
         LOGE("destination register %d %d not found\n", dst->registerType, dst->registerNum);
         return;
     }
 
-    if (typeId != reg->typeId && reg->componentCount == 4) {
+    if (dst->clamp) {
+        // Clamp to [0.f, 1.f]
+        if (typeId != compiler->float4Id) {
+            varId = ilcSpvPutBitcast(compiler->module, compiler->float4Id, varId);
+            typeId = compiler->float4Id;
+        }
+
+        IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->floatId, ZERO_LITERAL);
+        IlcSpvId oneId = ilcSpvPutConstant(compiler->module, compiler->floatId, ONE_LITERAL);
+        const IlcSpvId zeroConsistuentIds[] = { zeroId, zeroId, zeroId, zeroId };
+        const IlcSpvId oneConsistuentIds[] = { oneId, oneId, oneId, oneId };
+        IlcSpvId zeroCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
+                                                              4, zeroConsistuentIds);
+        IlcSpvId oneCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
+                                                             4, oneConsistuentIds);
+
+        const IlcSpvId paramIds[] = { varId, zeroCompositeId, oneCompositeId };
+        varId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FClamp, compiler->float4Id,
+                                3, paramIds);
+    }
+
+    IlcSpvId vec4TypeId = getPackedTypeId(compiler, reg->componentTypeId, COMP_MASK_XYZW);
+    if (typeId != vec4TypeId) {
         // Need to cast to the expected type
-        varId = ilcSpvPutBitcast(compiler->module, reg->typeId, varId);
+        varId = ilcSpvPutBitcast(compiler->module, vec4TypeId, varId);
     }
 
     IlcSpvId ptrId = 0;
@@ -780,49 +1285,12 @@ static void storeDestination(
         LOGW("unhandled shift scale %d\n", dst->shiftScale);
     }
 
-    if (dst->clamp) {
-        // Clamp to [0.f, 1.f]
-        IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->floatId, ZERO_LITERAL);
-        IlcSpvId oneId = ilcSpvPutConstant(compiler->module, compiler->floatId, ONE_LITERAL);
-        const IlcSpvId zeroConsistuentIds[] = { zeroId, zeroId, zeroId, zeroId };
-        const IlcSpvId oneConsistuentIds[] = { oneId, oneId, oneId, oneId };
-        IlcSpvId zeroCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
-                                                              4, zeroConsistuentIds);
-        IlcSpvId oneCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
-                                                             4, oneConsistuentIds);
-
-        const IlcSpvId paramIds[] = { varId, zeroCompositeId, oneCompositeId };
-        varId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FClamp, compiler->float4Id,
-                                3, paramIds);
-    }
-
-    if (dst->component[0] == IL_MODCOMP_NOWRITE || dst->component[1] == IL_MODCOMP_NOWRITE ||
-        dst->component[2] == IL_MODCOMP_NOWRITE || dst->component[3] == IL_MODCOMP_NOWRITE) {
-        if (reg->componentCount == 1) {
-            // Nothing to do
-        } else if (reg->componentCount == 4) {
-            // Select components from {dst.x, dst.y, dst.z, dst.w, x, y, z, w}
-            IlcSpvId origId = ilcSpvPutLoad(compiler->module, reg->typeId, ptrId);
-
-            const IlcSpvWord components[] = {
-                dst->component[0] == IL_MODCOMP_NOWRITE ? 0 : 4,
-                dst->component[1] == IL_MODCOMP_NOWRITE ? 1 : 5,
-                dst->component[2] == IL_MODCOMP_NOWRITE ? 2 : 6,
-                dst->component[3] == IL_MODCOMP_NOWRITE ? 3 : 7,
-            };
-            varId = ilcSpvPutVectorShuffle(compiler->module, reg->typeId, origId, varId,
-                                           4, components);
-        } else {
-            LOGW("unhandled write mask for component count %u\n", reg->componentCount);
-        }
-    }
-
     if ((dst->component[0] == IL_MODCOMP_0 || dst->component[0] == IL_MODCOMP_1) ||
         (dst->component[1] == IL_MODCOMP_0 || dst->component[1] == IL_MODCOMP_1) ||
         (dst->component[2] == IL_MODCOMP_0 || dst->component[2] == IL_MODCOMP_1) ||
         (dst->component[3] == IL_MODCOMP_0 || dst->component[3] == IL_MODCOMP_1)) {
-        // Select components from {x, y, z, w, 0.f, 1.f}
-        IlcSpvId zeroOneId = emitZeroOneVector(compiler, compiler->floatId);
+        // Select components from {x, y, z, w, 0, 1}
+        IlcSpvId zeroOneId = emitZeroOneVector(compiler, reg->componentTypeId);
 
         const IlcSpvWord components[] = {
             dst->component[0] == IL_MODCOMP_0 ? 4 : (dst->component[0] == IL_MODCOMP_1 ? 5 : 0),
@@ -830,12 +1298,36 @@ static void storeDestination(
             dst->component[2] == IL_MODCOMP_0 ? 4 : (dst->component[2] == IL_MODCOMP_1 ? 5 : 2),
             dst->component[3] == IL_MODCOMP_0 ? 4 : (dst->component[3] == IL_MODCOMP_1 ? 5 : 3),
         };
-        varId = ilcSpvPutVectorShuffle(compiler->module, reg->typeId, varId, zeroOneId,
+        varId = ilcSpvPutVectorShuffle(compiler->module, vec4TypeId, varId, zeroOneId,
                                        4, components);
     }
 
-    if (reg->componentCount < 4) {
-        varId = emitVectorTrim(compiler, varId, typeId, 0, reg->componentCount);
+    // Only components held by the register are stored
+    uint8_t componentMask = getRegisterComponentMask(compiler, reg);
+    IlcSpvWord components[4];
+    unsigned writeCount = 0;
+    unsigned index = 0;
+
+    for (unsigned i = 0; i < 4; i++) {
+        if (componentMask & (1 << i)) {
+            bool isWritten = dst->component[i] != IL_MODCOMP_NOWRITE;
+
+            components[index] = isWritten ? reg->componentCount + i : index;
+            writeCount += isWritten;
+            index++;
+        }
+    }
+
+    if (writeCount == 0) {
+        // Dead components only
+        return;
+    } else if (writeCount < reg->componentCount) {
+        // Select components from {dst.x, dst.y, dst.z, dst.w, x, y, z, w}
+        IlcSpvId origId = ilcSpvPutLoad(compiler->module, reg->typeId, ptrId);
+        varId = ilcSpvPutVectorShuffle(compiler->module, reg->typeId, origId, varId,
+                                       reg->componentCount, components);
+    } else if (reg->componentCount < 4) {
+        varId = emitVectorPack(compiler, varId, reg->componentTypeId, componentMask);
     }
 
     ilcSpvPutStore(compiler->module, ptrId, varId);
@@ -894,15 +1386,13 @@ static void emitConstBuffer(
 {
     assert(instr->extraCount % 4 == 0);
 
-    // Create immediate constant buffer
+    // Create immediate constant buffer, initialized once from a constant array
     unsigned arraySize = instr->extraCount / 4;
     IlcSpvId lengthId = ilcSpvPutConstant(compiler->module, compiler->uintId, arraySize);
     IlcSpvId typeId = compiler->float4Id;
     IlcSpvId arrayTypeId = ilcSpvPutArrayType(compiler->module, typeId, lengthId);
-    IlcSpvId arrayId = emitVariable(compiler, arrayTypeId, SpvStorageClassPrivate);
+    IlcSpvId* elementIds = malloc(sizeof(IlcSpvId) * arraySize);
 
-    // Populate array
-    IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassPrivate, typeId);
     for (unsigned i = 0; i < arraySize; i++) {
         IlcSpvId consistuentIds[] = {
             ilcSpvPutConstant(compiler->module, compiler->floatId, instr->extras[4 * i + 0]),
@@ -910,14 +1400,17 @@ static void emitConstBuffer(
             ilcSpvPutConstant(compiler->module, compiler->floatId, instr->extras[4 * i + 2]),
             ilcSpvPutConstant(compiler->module, compiler->floatId, instr->extras[4 * i + 3]),
         };
-        IlcSpvId compositeId = ilcSpvPutConstantComposite(compiler->module, typeId,
-                                                          4, consistuentIds);
-
-        IlcSpvId addrId = ilcSpvPutConstant(compiler->module, compiler->uintId, i);
-        IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, arrayId, 1, &addrId);
-        ilcSpvPutStore(compiler->module, ptrId, compositeId);
+        elementIds[i] = ilcSpvPutConstantComposite(compiler->module, typeId, 4, consistuentIds);
     }
 
+    IlcSpvId initializerId = ilcSpvPutConstantComposite(compiler->module, arrayTypeId,
+                                                        arraySize, elementIds);
+    IlcSpvId pointerId = ilcSpvPutPointerType(compiler->module, SpvStorageClassPrivate,
+                                              arrayTypeId);
+    IlcSpvId arrayId = ilcSpvPutInitializedVariable(compiler->module, pointerId,
+                                                    SpvStorageClassPrivate, initializerId);
+    free(elementIds);
+
     const IlcRegister constBufferReg = {
         .id = arrayId,
         .interfaceId = arrayId,
@@ -970,9 +1463,8 @@ static void emitLiteral(
 
     assert(src->registerType == IL_REGTYPE_LITERAL);
 
+    // Literals are read-only, use the constant directly instead of a variable
     IlcSpvId literalTypeId = compiler->float4Id;
-    IlcSpvId literalId = emitVariable(compiler, literalTypeId, SpvStorageClassPrivate);
-
     IlcSpvId consistuentIds[] = {
         ilcSpvPutConstant(compiler->module, compiler->floatId, instr->extras[0]),
         ilcSpvPutConstant(compiler->module, compiler->floatId, instr->extras[1]),
@@ -982,11 +1474,9 @@ static void emitLiteral(
     IlcSpvId compositeId = ilcSpvPutConstantComposite(compiler->module, literalTypeId,
                                                       4, consistuentIds);
 
-    ilcSpvPutStore(compiler->module, literalId, compositeId);
-
     const IlcRegister reg = {
-        .id = literalId,
-        .interfaceId = literalId,
+        .id = compositeId,
+        .interfaceId = 0,
         .typeId = literalTypeId,
         .componentTypeId = compiler->floatId,
         .componentCount = 4,
@@ -999,6 +1489,24 @@ static void emitLiteral(
     addRegister(compiler, &reg, "l");
 }
 
+static bool isLinkableStage(
+    const IlcCompiler* compiler)
+{
+    // Stages whose generic outputs feed the rasterizer or a geometry shader
+    return compiler->kernel->shaderType == IL_SHADER_VERTEX ||
+           compiler->kernel->shaderType == IL_SHADER_DOMAIN ||
+           compiler->kernel->shaderType == IL_SHADER_GEOMETRY;
+}
+
+static bool isUnlinkedOutput(
+    const IlcCompiler* compiler,
+    const IlcRegister* reg)
+{
+    return reg->ilType == IL_REGTYPE_OUTPUT && reg->ilImportUsage == IL_IMPORTUSAGE_GENERIC &&
+           isLinkableStage(compiler) && reg->ilNum < 32 &&
+           (compiler->linkedOutputMask & (1u << reg->ilNum)) == 0;
+}
+
 static void emitOutput(
     IlcCompiler* compiler,
     const Instruction* instr)
@@ -1046,19 +1554,39 @@ static void emitOutput(
         outputComponentCount = 1;
         outputPrefix = "o";
     } else if (dst->registerType == IL_REGTYPE_OUTPUT) {
+        bool isLinked = true;
+
+        if (importUsage == IL_IMPORTUSAGE_GENERIC && isLinkableStage(compiler) &&
+            dst->registerNum < 32) {
+            compiler->outputMask |= 1u << dst->registerNum;
+            isLinked = (compiler->linkedOutputMask & (1u << dst->registerNum)) != 0;
+        }
+
+        // Rectangle expansion copies the position and linked generic outputs to the real ones
+        bool isExpanded = compiler->expandRectangles && isLinked &&
+                          (importUsage == IL_IMPORTUSAGE_POS ||
+                           importUsage == IL_IMPORTUSAGE_GENERIC);
+
+        // Outputs the next stage doesn't read become private so that their computations go away
         outputTypeId = compiler->float4Id;
-        outputId = emitVariable(compiler, outputTypeId, SpvStorageClassOutput);
+        outputId = emitVariable(compiler, outputTypeId, isLinked && !isExpanded ?
+                                SpvStorageClassOutput : SpvStorageClassPrivate);
         outputInterfaceId = outputId;
         outputComponentTypeId = compiler->floatId;
         outputComponentCount = 4;
         outputPrefix = "o";
 
-        if (importUsage == IL_IMPORTUSAGE_POS) {
+        if (isExpanded) {
+            // Decorated in emitRectangleMainFunction
+        } else if (importUsage == IL_IMPORTUSAGE_POS) {
             IlcSpvWord builtInType = SpvBuiltInPosition;
             ilcSpvPutDecoration(compiler->module, outputId, SpvDecorationBuiltIn, 1, &builtInType);
         } else if (importUsage == IL_IMPORTUSAGE_GENERIC) {
-            IlcSpvWord locationIdx = dst->registerNum;
-            ilcSpvPutDecoration(compiler->module, outputId, SpvDecorationLocation, 1, &locationIdx);
+            if (isLinked) {
+                IlcSpvWord locationIdx = dst->registerNum;
+                ilcSpvPutDecoration(compiler->module, outputId, SpvDecorationLocation, 1,
+                                    &locationIdx);
+            }
         } else {
             LOGW("unhandled import usage %d\n", importUsage);
         }
@@ -1187,7 +1715,6 @@ static void emitInput(
             inputComponentTypeId = compiler->intId;
             inputComponentCount = 1;
             inputTypeId = compiler->intId;
-            inputId = emitVariable(compiler, inputTypeId, SpvStorageClassInput);
 
             IlcSpvWord builtInType = 0;
             if (importUsage == IL_IMPORTUSAGE_PRIMITIVEID) {
@@ -1203,7 +1730,15 @@ static void emitInput(
             } else {
                 assert(false);
             }
-            ilcSpvPutDecoration(compiler->module, inputId, SpvDecorationBuiltIn, 1, &builtInType);
+
+            if (compiler->expandRectangles && importUsage == IL_IMPORTUSAGE_VERTEXID) {
+                // Set before each call of the shader, see emitRectangleMainFunction
+                inputId = emitVariable(compiler, inputTypeId, SpvStorageClassPrivate);
+            } else {
+                inputId = emitVariable(compiler, inputTypeId, SpvStorageClassInput);
+                ilcSpvPutDecoration(compiler->module, inputId, SpvDecorationBuiltIn, 1,
+                                    &builtInType);
+            }
         } else if (importUsage == IL_IMPORTUSAGE_ISFRONTFACE) {
             inputComponentTypeId = compiler->boolId;
             inputComponentCount = 1;
@@ -1606,6 +2141,131 @@ static void emitHsPhase(
     }
 }
 
+static IlcSpvId getCopyTypeId(
+    const IlcCompiler* compiler,
+    const Instruction* instr,
+    unsigned firstSrcIndex)
+{
+    const Destination* dst = &instr->dsts[0];
+
+    // Modifiers are float only
+    if (dst->registerType != IL_REGTYPE_TEMP || dst->clamp) {
+        return compiler->float4Id;
+    }
+    for (unsigned i = firstSrcIndex; i < instr->srcCount; i++) {
+        const Source* src = &instr->srcs[i];
+
+        if (src->abs || src->negate[0] || src->negate[1] || src->negate[2] || src->negate[3]) {
+            return compiler->float4Id;
+        }
+    }
+
+    // Copy bits as-is in the destination type
+    return getValueTypeId(compiler, getTempInfo(compiler, dst->registerNum).type);
+}
+
+static bool isComponentWise(
+    const Instruction* instr)
+{
+    // Result components only depend on the same source components
+    switch (instr->opcode) {
+    case IL_OP_ABS:
+    case IL_OP_ADD:
+    case IL_OP_DIV:
+    case IL_OP_DSX:
+    case IL_OP_DSY:
+    case IL_OP_FRC:
+    case IL_OP_MAD:
+    case IL_OP_MAX:
+    case IL_OP_MIN:
+    case IL_OP_MOV:
+    case IL_OP_MUL:
+    case IL_OP_FTOI:
+    case IL_OP_FTOU:
+    case IL_OP_ITOF:
+    case IL_OP_UTOF:
+    case IL_OP_ROUND_NEAR:
+    case IL_OP_ROUND_NEG_INF:
+    case IL_OP_ROUND_PLUS_INF:
+    case IL_OP_ROUND_ZERO:
+    case IL_OP_EXP_VEC:
+    case IL_OP_LOG_VEC:
+    case IL_OP_RSQ_VEC:
+    case IL_OP_SIN_VEC:
+    case IL_OP_COS_VEC:
+    case IL_OP_SQRT_VEC:
+    case IL_OP_RCP_VEC:
+    case IL_OP_EQ:
+    case IL_OP_GE:
+    case IL_OP_LT:
+    case IL_OP_NE:
+    case IL_OP_I_NOT:
+    case IL_OP_I_OR:
+    case IL_OP_I_XOR:
+    case IL_OP_I_ADD:
+    case IL_OP_I_MAD:
+    case IL_OP_I_MAX:
+    case IL_OP_I_MIN:
+    case IL_OP_I_MUL:
+    case IL_OP_I_NEGATE:
+    case IL_OP_I_SHL:
+    case IL_OP_I_SHR:
+    case IL_OP_U_SHR:
+    case IL_OP_U_DIV:
+    case IL_OP_U_MOD:
+    case IL_OP_U_MAX:
+    case IL_OP_U_MIN:
+    case IL_OP_AND:
+    case IL_OP_I_FIRSTBIT:
+    case IL_OP_I_BIT_EXTRACT:
+    case IL_OP_U_BIT_EXTRACT:
+    case IL_OP_U_BIT_INSERT:
+    case IL_OP_I_EQ:
+    case IL_OP_I_GE:
+    case IL_OP_I_LT:
+    case IL_OP_I_NE:
+    case IL_OP_U_LT:
+    case IL_OP_U_GE:
+    case IL_OP_CMOV_LOGICAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint8_t getOperationMask(
+    const IlcCompiler* compiler,
+    const Instruction* instr)
+{
+    // Component-wise ops only compute the written components. Packing and expanding vectors only
+    // folds away once registers are promoted, so keep full vectors otherwise.
+    if (!compiler->optimize || !isComponentWise(instr)) {
+        return COMP_MASK_XYZW;
+    }
+
+    uint8_t componentMask = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        if (instr->dsts[0].component[i] == IL_MODCOMP_WRITE) {
+            componentMask |= 1 << i;
+        }
+    }
+    return componentMask != 0 ? componentMask : COMP_MASK_X;
+}
+
+static void storePackedDestination(
+    IlcCompiler* compiler,
+    const Destination* dst,
+    IlcSpvId varId,
+    uint8_t componentMask,
+    IlcSpvId typeId)
+{
+    if (componentMask != COMP_MASK_XYZW) {
+        varId = emitVectorExpand(compiler, varId, getVectorComponentTypeId(compiler, typeId),
+                                 componentMask);
+    }
+    storeDestination(compiler, dst, varId, typeId);
+}
+
 static void emitFloatOp(
     IlcCompiler* compiler,
     const Instruction* instr)
@@ -1626,13 +2286,24 @@ static void emitFloatOp(
         break;
     }
 
+    IlcSpvId typeId = instr->opcode == IL_OP_MOV ? getCopyTypeId(compiler, instr, 0)
+                                                 : compiler->float4Id;
+    // Component-wise ops are computed on the written components only
+    uint8_t opMask = getOperationMask(compiler, instr);
+    IlcSpvId floatTypeId = getPackedTypeId(compiler, compiler->floatId, opMask);
+
     for (int i = 0; i < instr->srcCount; i++) {
-        srcIds[i] = loadSource(compiler, &instr->srcs[i], componentMask, compiler->float4Id);
+        if (compiler->optimize) {
+            // Dot products also take packed sources
+            srcIds[i] = loadPackedSource(compiler, &instr->srcs[i], componentMask & opMask, typeId);
+        } else {
+            srcIds[i] = loadSource(compiler, &instr->srcs[i], componentMask, typeId);
+        }
     }
 
     switch (instr->opcode) {
     case IL_OP_ABS:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FAbs, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450FAbs, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_ACOS: {
@@ -1644,7 +2315,7 @@ static void emitFloatOp(
                                        4, components);
     }   break;
     case IL_OP_ADD:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpFAdd, compiler->float4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpFAdd, floatTypeId, srcIds[0], srcIds[1]);
         break;
     case IL_OP_ASIN: {
         IlcSpvId asinId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Asin, compiler->float4Id,
@@ -1664,7 +2335,7 @@ static void emitFloatOp(
     }   break;
     case IL_OP_DIV:
         // FIXME SPIR-V has undefined division by zero
-        resId = ilcSpvPutOp2(compiler->module, SpvOpFDiv, compiler->float4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpFDiv, floatTypeId, srcIds[0], srcIds[1]);
         break;
     case IL_OP_DP2:
     case IL_OP_DP3:
@@ -1675,6 +2346,9 @@ static void emitFloatOp(
         }
         IlcSpvId dotId = ilcSpvPutOp2(compiler->module, SpvOpDot, compiler->floatId,
                                       srcIds[0], srcIds[1]);
+        if (instr->preciseMask != 0) {
+            ilcSpvPutNoContraction(compiler->module, dotId);
+        }
         // Replicate dot product on all components
         resId = emitVectorGrow(compiler, dotId, compiler->floatId, 1);
     }   break;
@@ -1684,10 +2358,10 @@ static void emitFloatOp(
         IlcSpvWord op = instr->opcode == IL_OP_DSX ? (fine ? SpvOpDPdxFine : SpvOpDPdxCoarse)
                                                    : (fine ? SpvOpDPdyFine : SpvOpDPdyCoarse);
         ilcSpvPutCapability(compiler->module, SpvCapabilityDerivativeControl);
-        resId = ilcSpvPutOp1(compiler->module, op, compiler->float4Id, srcIds[0]);
+        resId = ilcSpvPutOp1(compiler->module, op, floatTypeId, srcIds[0]);
     }   break;
     case IL_OP_FRC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Fract, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Fract, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_MAD: {
@@ -1695,7 +2369,7 @@ static void emitFloatOp(
         if (!ieee) {
             LOGW("unhandled non-IEEE mad\n");
         }
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Fma, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Fma, floatTypeId,
                                 instr->srcCount, srcIds);
     }   break;
     case IL_OP_MAX: {
@@ -1703,7 +2377,7 @@ static void emitFloatOp(
         if (!ieee) {
             LOGW("unhandled non-IEEE max\n");
         }
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450NMax, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450NMax, floatTypeId,
                                 instr->srcCount, srcIds);
     }   break;
     case IL_OP_MIN: {
@@ -1711,7 +2385,7 @@ static void emitFloatOp(
         if (!ieee) {
             LOGW("unhandled non-IEEE min\n");
         }
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450NMin, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450NMin, floatTypeId,
                                 instr->srcCount, srcIds);
     }   break;
     case IL_OP_MOV:
@@ -1722,63 +2396,67 @@ static void emitFloatOp(
         if (!ieee) {
             LOGW("unhandled non-IEEE mul\n");
         }
-        resId = ilcSpvPutOp2(compiler->module, SpvOpFMul, compiler->float4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpFMul, floatTypeId, srcIds[0], srcIds[1]);
     }   break;
     case IL_OP_FTOI:
-        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertFToS, compiler->int4Id, srcIds[0]);
-        resId = ilcSpvPutBitcast(compiler->module, compiler->float4Id, resId);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertFToS,
+                             getPackedTypeId(compiler, compiler->intId, opMask), srcIds[0]);
+        resId = ilcSpvPutBitcast(compiler->module, floatTypeId, resId);
         break;
     case IL_OP_FTOU:
-        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertFToU, compiler->uint4Id, srcIds[0]);
-        resId = ilcSpvPutBitcast(compiler->module, compiler->float4Id, resId);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertFToU,
+                             getPackedTypeId(compiler, compiler->uintId, opMask), srcIds[0]);
+        resId = ilcSpvPutBitcast(compiler->module, floatTypeId, resId);
         break;
     case IL_OP_ITOF:
-        resId = ilcSpvPutBitcast(compiler->module, compiler->int4Id, srcIds[0]);
-        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertSToF, compiler->float4Id, resId);
+        resId = ilcSpvPutBitcast(compiler->module,
+                                 getPackedTypeId(compiler, compiler->intId, opMask), srcIds[0]);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertSToF, floatTypeId, resId);
         break;
     case IL_OP_UTOF:
-        resId = ilcSpvPutBitcast(compiler->module, compiler->uint4Id, srcIds[0]);
-        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertUToF, compiler->float4Id, resId);
+        resId = ilcSpvPutBitcast(compiler->module,
+                                 getPackedTypeId(compiler, compiler->uintId, opMask), srcIds[0]);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpConvertUToF, floatTypeId, resId);
         break;
     case IL_OP_ROUND_NEAR:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Round, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Round, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_ROUND_NEG_INF:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Floor, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Floor, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_ROUND_PLUS_INF:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Ceil, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Ceil, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_ROUND_ZERO:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Trunc, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Trunc, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_EXP_VEC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Exp2, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Exp2, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_LOG_VEC:
         // FIXME handle log(0)
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Log2, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Log2, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_RSQ_VEC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450InverseSqrt, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450InverseSqrt, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_SIN_VEC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Sin, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Sin, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_COS_VEC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Cos, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Cos, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_SQRT_VEC:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Sqrt, compiler->float4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450Sqrt, floatTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_F_2_F16: {
@@ -1826,19 +2504,21 @@ static void emitFloatOp(
                                        firstHalfId, secondHalfId, 4, components);
     }   break;
     case IL_OP_RCP_VEC: {
-        IlcSpvId oneId = ilcSpvPutConstant(compiler->module, compiler->floatId, ONE_LITERAL);
-        const IlcSpvId constituentIds[] = { oneId, oneId, oneId, oneId };
-        IlcSpvId one4Id = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
-                                                     4, constituentIds);
+        IlcSpvId oneId = emitPackedConstant(compiler, compiler->floatId, opMask, ONE_LITERAL);
         // FIXME SPIR-V has undefined division by zero
-        resId = ilcSpvPutOp2(compiler->module, SpvOpFDiv, compiler->float4Id, one4Id, srcIds[0]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpFDiv, floatTypeId, oneId, srcIds[0]);
     }   break;
     default:
         assert(false);
         break;
     }
 
-    storeDestination(compiler, &instr->dsts[0], resId, compiler->float4Id);
+    // Only precise operations are kept from being fused with others, like a mul into an add
+    if ((instr->preciseMask & opMask) != 0 && instr->opcode != IL_OP_MOV) {
+        ilcSpvPutNoContraction(compiler->module, resId);
+    }
+
+    storePackedDestination(compiler, &instr->dsts[0], resId, opMask, typeId);
 }
 
 static void emitFloatComparisonOp(
@@ -1847,9 +2527,10 @@ static void emitFloatComparisonOp(
 {
     IlcSpvId srcIds[MAX_SRC_COUNT] = { 0 };
     SpvOp compOp = 0;
+    uint8_t opMask = getOperationMask(compiler, instr);
 
     for (int i = 0; i < instr->srcCount; i++) {
-        srcIds[i] = loadSource(compiler, &instr->srcs[i], COMP_MASK_XYZW, compiler->float4Id);
+        srcIds[i] = loadPackedSource(compiler, &instr->srcs[i], opMask, compiler->float4Id);
     }
 
     switch (instr->opcode) {
@@ -1870,16 +2551,19 @@ static void emitFloatComparisonOp(
         break;
     }
 
-    IlcSpvId condId = ilcSpvPutOp2(compiler->module, compOp, compiler->bool4Id,
+    IlcSpvId condId = ilcSpvPutOp2(compiler->module, compOp,
+                                   getPackedTypeId(compiler, compiler->boolId, opMask),
                                    srcIds[0], srcIds[1]);
-    IlcSpvId trueId = ilcSpvPutConstant(compiler->module, compiler->floatId, TRUE_LITERAL);
-    IlcSpvId falseId = ilcSpvPutConstant(compiler->module, compiler->floatId, FALSE_LITERAL);
-    IlcSpvId true4Id = emitVectorGrow(compiler, trueId, compiler->floatId, 1);
-    IlcSpvId false4Id = emitVectorGrow(compiler, falseId, compiler->floatId, 1);
-    IlcSpvId resId = ilcSpvPutSelect(compiler->module, compiler->float4Id,
-                                     condId, true4Id, false4Id);
-
-    storeDestination(compiler, &instr->dsts[0], resId, compiler->float4Id);
+    // Masks have the same bits in any type, pick the destination one
+    IlcSpvId typeId = getCopyTypeId(compiler, instr, instr->srcCount);
+    IlcSpvId componentTypeId = getVectorComponentTypeId(compiler, typeId);
+    IlcSpvId trueId = emitPackedConstant(compiler, componentTypeId, opMask, TRUE_LITERAL);
+    IlcSpvId falseId = emitPackedConstant(compiler, componentTypeId, opMask, FALSE_LITERAL);
+    IlcSpvId resId = ilcSpvPutSelect(compiler->module,
+                                     getPackedTypeId(compiler, componentTypeId, opMask),
+                                     condId, trueId, falseId);
+
+    storePackedDestination(compiler, &instr->dsts[0], resId, opMask, typeId);
 }
 
 static void emitIntegerOp(
@@ -1891,65 +2575,73 @@ static void emitIntegerOp(
     IlcSpvId resId = 0;
 
     if (instr->opcode == IL_OP_U_DIV ||
-        instr->opcode == IL_OP_U_MOD) {
+        instr->opcode == IL_OP_U_MOD ||
+        instr->opcode == IL_OP_U_MAX ||
+        instr->opcode == IL_OP_U_MIN) {
         typeId = compiler->uint4Id;
     } else {
         typeId = compiler->int4Id;
     }
 
+    // Component-wise ops are computed on the written components only
+    uint8_t opMask = getOperationMask(compiler, instr);
+    unsigned opCount = getComponentMaskCount(opMask);
+    IlcSpvId intTypeId = getPackedTypeId(compiler, compiler->intId, opMask);
+    IlcSpvId uintTypeId = getPackedTypeId(compiler, compiler->uintId, opMask);
+
     for (int i = 0; i < instr->srcCount; i++) {
-        srcIds[i] = loadSource(compiler, &instr->srcs[i], COMP_MASK_XYZW, typeId);
+        srcIds[i] = loadPackedSource(compiler, &instr->srcs[i], opMask, typeId);
     }
 
     switch (instr->opcode) {
     case IL_OP_I_NOT:
-        resId = ilcSpvPutOp1(compiler->module, SpvOpNot, compiler->int4Id, srcIds[0]);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpNot, intTypeId, srcIds[0]);
         break;
     case IL_OP_I_OR:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseOr, compiler->int4Id,
+        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseOr, intTypeId,
                              srcIds[0], srcIds[1]);
         break;
     case IL_OP_I_XOR:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseXor, compiler->int4Id,
+        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseXor, intTypeId,
                              srcIds[0], srcIds[1]);
         break;
     case IL_OP_I_ADD:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->int4Id,
+        resId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, intTypeId,
                              srcIds[0], srcIds[1]);
         break;
     case IL_OP_I_MAD: {
-        IlcSpvId mulId = ilcSpvPutOp2(compiler->module, SpvOpIMul, compiler->int4Id,
+        IlcSpvId mulId = ilcSpvPutOp2(compiler->module, SpvOpIMul, intTypeId,
                                       srcIds[0], srcIds[1]);
-        resId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->int4Id, mulId, srcIds[2]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, intTypeId, mulId, srcIds[2]);
     } break;
     case IL_OP_I_MAX:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450SMax, compiler->int4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450SMax, intTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_I_MIN:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450SMin, compiler->int4Id,
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450SMin, intTypeId,
                                 instr->srcCount, srcIds);
         break;
     case IL_OP_I_MUL:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpIMul, compiler->int4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpIMul, intTypeId, srcIds[0], srcIds[1]);
         break;
     case IL_OP_I_NEGATE:
-        resId = ilcSpvPutOp1(compiler->module, SpvOpSNegate, compiler->int4Id, srcIds[0]);
+        resId = ilcSpvPutOp1(compiler->module, SpvOpSNegate, intTypeId, srcIds[0]);
         break;
     case IL_OP_U_DIV:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpUDiv, compiler->uint4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpUDiv, uintTypeId, srcIds[0], srcIds[1]);
         break;
     case IL_OP_U_MOD:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpUMod, compiler->uint4Id, srcIds[0], srcIds[1]);
+        resId = ilcSpvPutOp2(compiler->module, SpvOpUMod, uintTypeId, srcIds[0], srcIds[1]);
         break;
     case IL_OP_U_MAX:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450UMax, compiler->uint4Id, 2, srcIds);
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450UMax, uintTypeId, 2, srcIds);
         break;
     case IL_OP_U_MIN:
-        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450UMin, compiler->uint4Id, 2, srcIds);
+        resId = ilcSpvPutGLSLOp(compiler->module, GLSLstd450UMin, uintTypeId, 2, srcIds);
         break;
     case IL_OP_AND:
-        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseAnd, compiler->int4Id,
+        resId = ilcSpvPutOp2(compiler->module, SpvOpBitwiseAnd, intTypeId,
                              srcIds[0], srcIds[1]);
         break;
     case IL_OP_I_SHL:
@@ -1963,8 +2655,8 @@ static void emitIntegerOp(
         } else {
             op = SpvOpShiftRightLogical;
         }
-        resId = ilcSpvPutOp2(compiler->module, op, compiler->int4Id,
-                             srcIds[0], emitShiftMask(compiler, srcIds[1]));
+        resId = ilcSpvPutOp2(compiler->module, op, intTypeId,
+                             srcIds[0], emitShiftMask(compiler, srcIds[1], opMask));
     }   break;
     case IL_OP_I_FIRSTBIT: {
         IlcSpvWord op;
@@ -1975,45 +2667,55 @@ static void emitIntegerOp(
         } else {
             op = GLSLstd450FindSMsb; // shi
         }
-        resId = ilcSpvPutGLSLOp(compiler->module, op, compiler->int4Id, 1, srcIds);
+        resId = ilcSpvPutGLSLOp(compiler->module, op, intTypeId, 1, srcIds);
     }   break;
     case IL_OP_I_BIT_EXTRACT:
     case IL_OP_U_BIT_EXTRACT: {
         bool isSigned = instr->opcode == IL_OP_I_BIT_EXTRACT;
-        IlcSpvId widthsId = emitShiftMask(compiler, srcIds[0]);
-        IlcSpvId offsetsId = emitShiftMask(compiler, srcIds[1]);
+        IlcSpvId widthsId = emitShiftMask(compiler, srcIds[0], opMask);
+        IlcSpvId offsetsId = emitShiftMask(compiler, srcIds[1], opMask);
         IlcSpvId bfId[4];
-        for (unsigned i = 0; i < 4; i++) {
+        for (unsigned i = 0; i < opCount; i++) {
             // FIXME handle width + offset >= 32
-            IlcSpvId widthId = emitVectorTrim(compiler, widthsId, compiler->int4Id, i, 1);
-            IlcSpvId offsetId = emitVectorTrim(compiler, offsetsId, compiler->int4Id, i, 1);
-            IlcSpvId baseId = emitVectorTrim(compiler, srcIds[2], compiler->int4Id, i, 1);
+            IlcSpvId widthId = emitPackedExtract(compiler, widthsId, compiler->intId, opCount, i);
+            IlcSpvId offsetId = emitPackedExtract(compiler, offsetsId, compiler->intId,
+                                                  opCount, i);
+            IlcSpvId baseId = emitPackedExtract(compiler, srcIds[2], compiler->intId, opCount, i);
             bfId[i] = ilcSpvPutOp3(compiler->module,
                                    isSigned ? SpvOpBitFieldSExtract : SpvOpBitFieldUExtract,
                                    compiler->intId, baseId, offsetId, widthId);
         }
-        resId = ilcSpvPutCompositeConstruct(compiler->module, compiler->int4Id, 4, bfId);
+        if (opCount == 1) {
+            resId = bfId[0];
+        } else {
+            resId = ilcSpvPutCompositeConstruct(compiler->module, intTypeId, opCount, bfId);
+        }
     }   break;
     case IL_OP_U_BIT_INSERT: {
-        IlcSpvId widthsId = emitShiftMask(compiler, srcIds[0]);
-        IlcSpvId offsetsId = emitShiftMask(compiler, srcIds[1]);
+        IlcSpvId widthsId = emitShiftMask(compiler, srcIds[0], opMask);
+        IlcSpvId offsetsId = emitShiftMask(compiler, srcIds[1], opMask);
         IlcSpvId bfId[4];
-        for (unsigned i = 0; i < 4; i++) {
-            IlcSpvId widthId = emitVectorTrim(compiler, widthsId, compiler->int4Id, i, 1);
-            IlcSpvId offsetId = emitVectorTrim(compiler, offsetsId, compiler->int4Id, i, 1);
-            IlcSpvId insertId = emitVectorTrim(compiler, srcIds[2], compiler->int4Id, i, 1);
-            IlcSpvId baseId = emitVectorTrim(compiler, srcIds[3], compiler->int4Id, i, 1);
+        for (unsigned i = 0; i < opCount; i++) {
+            IlcSpvId widthId = emitPackedExtract(compiler, widthsId, compiler->intId, opCount, i);
+            IlcSpvId offsetId = emitPackedExtract(compiler, offsetsId, compiler->intId,
+                                                  opCount, i);
+            IlcSpvId insertId = emitPackedExtract(compiler, srcIds[2], compiler->intId, opCount, i);
+            IlcSpvId baseId = emitPackedExtract(compiler, srcIds[3], compiler->intId, opCount, i);
             bfId[i] = ilcSpvPutOp4(compiler->module, SpvOpBitFieldInsert, compiler->intId,
                                    baseId, insertId, offsetId, widthId);
         }
-        resId = ilcSpvPutCompositeConstruct(compiler->module, compiler->int4Id, 4, bfId);
+        if (opCount == 1) {
+            resId = bfId[0];
+        } else {
+            resId = ilcSpvPutCompositeConstruct(compiler->module, intTypeId, opCount, bfId);
+        }
     }   break;
     default:
         assert(false);
         break;
     }
 
-    storeDestination(compiler, &instr->dsts[0], resId, typeId);
+    storePackedDestination(compiler, &instr->dsts[0], resId, opMask, typeId);
 }
 
 static void emitIntegerComparisonOp(
@@ -2022,9 +2724,10 @@ static void emitIntegerComparisonOp(
 {
     IlcSpvId srcIds[MAX_SRC_COUNT] = { 0 };
     SpvOp compOp = 0;
+    uint8_t opMask = getOperationMask(compiler, instr);
 
     for (int i = 0; i < instr->srcCount; i++) {
-        srcIds[i] = loadSource(compiler, &instr->srcs[i], COMP_MASK_XYZW, compiler->int4Id);
+        srcIds[i] = loadPackedSource(compiler, &instr->srcs[i], opMask, compiler->int4Id);
     }
 
     switch (instr->opcode) {
@@ -2051,20 +2754,19 @@ static void emitIntegerComparisonOp(
         break;
     }
 
-    IlcSpvId condId = ilcSpvPutOp2(compiler->module, compOp, compiler->bool4Id,
+    IlcSpvId condId = ilcSpvPutOp2(compiler->module, compOp,
+                                   getPackedTypeId(compiler, compiler->boolId, opMask),
                                    srcIds[0], srcIds[1]);
-    IlcSpvId trueId = ilcSpvPutConstant(compiler->module, compiler->floatId, TRUE_LITERAL);
-    IlcSpvId falseId = ilcSpvPutConstant(compiler->module, compiler->floatId, FALSE_LITERAL);
-    const IlcSpvId trueConsistuentIds[] = { trueId, trueId, trueId, trueId };
-    const IlcSpvId falseConsistuentIds[] = { falseId, falseId, falseId, falseId };
-    IlcSpvId trueCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
-                                                          4, trueConsistuentIds);
-    IlcSpvId falseCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->float4Id,
-                                                           4, falseConsistuentIds);
-    IlcSpvId resId = ilcSpvPutSelect(compiler->module, compiler->float4Id, condId,
-                                     trueCompositeId, falseCompositeId);
-
-    storeDestination(compiler, &instr->dsts[0], resId, compiler->float4Id);
+    // Masks have the same bits in any type, pick the destination one
+    IlcSpvId typeId = getCopyTypeId(compiler, instr, instr->srcCount);
+    IlcSpvId componentTypeId = getVectorComponentTypeId(compiler, typeId);
+    IlcSpvId trueId = emitPackedConstant(compiler, componentTypeId, opMask, TRUE_LITERAL);
+    IlcSpvId falseId = emitPackedConstant(compiler, componentTypeId, opMask, FALSE_LITERAL);
+    IlcSpvId resId = ilcSpvPutSelect(compiler->module,
+                                     getPackedTypeId(compiler, componentTypeId, opMask),
+                                     condId, trueId, falseId);
+
+    storePackedDestination(compiler, &instr->dsts[0], resId, opMask, typeId);
 }
 
 static void emitCmovLogical(
@@ -2072,23 +2774,34 @@ static void emitCmovLogical(
     const Instruction* instr)
 {
     IlcSpvId srcIds[MAX_SRC_COUNT] = { 0 };
-
-    for (int i = 0; i < instr->srcCount; i++) {
-        srcIds[i] = loadSource(compiler, &instr->srcs[i], COMP_MASK_XYZW, compiler->float4Id);
+    IlcSpvId typeId = getCopyTypeId(compiler, instr, 1);
+    uint8_t opMask = getOperationMask(compiler, instr);
+
+    const Source* condSrc = &instr->srcs[0];
+    if (condSrc->abs || condSrc->negate[0] || condSrc->negate[1] || condSrc->negate[2] ||
+        condSrc->negate[3]) {
+        // Apply float modifiers first
+        srcIds[0] = loadPackedSource(compiler, condSrc, opMask, compiler->float4Id);
+        srcIds[0] = ilcSpvPutBitcast(compiler->module,
+                                     getPackedTypeId(compiler, compiler->intId, opMask), srcIds[0]);
+    } else {
+        srcIds[0] = loadPackedSource(compiler, condSrc, opMask, compiler->int4Id);
+    }
+    for (int i = 1; i < instr->srcCount; i++) {
+        srcIds[i] = loadPackedSource(compiler, &instr->srcs[i], opMask, typeId);
     }
 
     // For each component, select src1 if src0 has any bit set, otherwise select src2
-    IlcSpvId falseId = ilcSpvPutConstant(compiler->module, compiler->intId, FALSE_LITERAL);
-    const IlcSpvId falseConsistuentIds[] = { falseId, falseId, falseId, falseId };
-    IlcSpvId falseCompositeId = ilcSpvPutConstantComposite(compiler->module, compiler->int4Id,
-                                                           4, falseConsistuentIds);
-    IlcSpvId castId = ilcSpvPutBitcast(compiler->module, compiler->int4Id, srcIds[0]);
-    IlcSpvId condId = ilcSpvPutOp2(compiler->module, SpvOpINotEqual, compiler->bool4Id,
-                                   castId, falseCompositeId);
-    IlcSpvId resId = ilcSpvPutSelect(compiler->module, compiler->float4Id, condId,
-                                     srcIds[1], srcIds[2]);
-
-    storeDestination(compiler, &instr->dsts[0], resId, compiler->float4Id);
+    IlcSpvId falseId = emitPackedConstant(compiler, compiler->intId, opMask, FALSE_LITERAL);
+    IlcSpvId condId = ilcSpvPutOp2(compiler->module, SpvOpINotEqual,
+                                   getPackedTypeId(compiler, compiler->boolId, opMask),
+                                   srcIds[0], falseId);
+    IlcSpvId componentTypeId = getVectorComponentTypeId(compiler, typeId);
+    IlcSpvId resId = ilcSpvPutSelect(compiler->module,
+                                     getPackedTypeId(compiler, componentTypeId, opMask),
+                                     condId, srcIds[1], srcIds[2]);
+
+    storePackedDestination(compiler, &instr->dsts[0], resId, opMask, typeId);
 }
 
 static void emitNumThreadPerGroup(
@@ -2115,28 +2828,357 @@ static IlcSpvId emitConditionCheck(
     return ilcSpvPutOp2(compiler->module, comparisonOp, compiler->boolId, xId, falseId);
 }
 
-static void emitIf(
-    IlcCompiler* compiler,
+static bool isControlFlowInstruction(
     const Instruction* instr)
 {
-    const IlcIfElseBlock ifElseBlock = {
-        .labelElseId = ilcSpvAllocId(compiler->module),
-        .labelEndId = ilcSpvAllocId(compiler->module),
-        .hasElseBlock = false,
-    };
-
-    IlcSpvId srcId = loadSource(compiler, &instr->srcs[0], COMP_MASK_XYZW, compiler->int4Id);
-    IlcSpvId labelBeginId = ilcSpvAllocId(compiler->module);
-    IlcSpvId condId = emitConditionCheck(compiler, srcId, instr->opcode == IL_OP_IF_LOGICALNZ);
-    ilcSpvPutSelectionMerge(compiler->module, ifElseBlock.labelEndId);
-    ilcSpvPutBranchConditional(compiler->module, condId, labelBeginId, ifElseBlock.labelElseId);
-    ilcSpvPutLabel(compiler->module, labelBeginId);
-
-    const IlcControlFlowBlock block = {
-        .type = BLOCK_IF_ELSE,
-        .ifElse = ifElseBlock,
-    };
-    pushControlFlowBlock(compiler, &block);
+    switch (instr->opcode) {
+    case IL_OP_BREAK:
+    case IL_OP_BREAKC:
+    case IL_OP_BREAK_LOGICALZ:
+    case IL_OP_BREAK_LOGICALNZ:
+    case IL_OP_CONTINUE:
+    case IL_OP_CONTINUE_LOGICALZ:
+    case IL_OP_CONTINUE_LOGICALNZ:
+    case IL_OP_IF_LOGICALZ:
+    case IL_OP_IF_LOGICALNZ:
+    case IL_OP_ELSE:
+    case IL_OP_ENDIF:
+    case IL_OP_WHILE:
+    case IL_OP_ENDLOOP:
+    case IL_OP_SWITCH:
+    case IL_OP_CASE:
+    case IL_OP_DEFAULT:
+    case IL_OP_ENDSWITCH:
+    case IL_OP_RET_DYN:
+    case IL_OP_DISCARD_LOGICALZ:
+    case IL_OP_DISCARD_LOGICALNZ:
+    case IL_OP_END:
+    case IL_OP_ENDMAIN:
+    case IL_OP_ENDPHASE:
+    case IL_OP_HS_FORK_PHASE:
+    case IL_OP_HS_JOIN_PHASE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isPlainSource(
+    const Source* src,
+    uint8_t component)
+{
+    return src->swizzle[component] <= IL_COMPSEL_W_A && !src->negate[component] &&
+           !src->invert && !src->bias && !src->x2 && !src->sign && !src->abs &&
+           src->divComp == IL_DIVCOMP_NONE && !src->clamp && src->srcCount == 0;
+}
+
+static int getSingleWrittenComponent(
+    const Destination* dst)
+{
+    int component = -1;
+
+    for (unsigned i = 0; i < 4; i++) {
+        if (dst->component[i] == IL_MODCOMP_NOWRITE) {
+            continue;
+        } else if (dst->component[i] != IL_MODCOMP_WRITE || component >= 0) {
+            return -1;
+        }
+        component = i;
+    }
+
+    return component;
+}
+
+static bool writesTempComponent(
+    const Instruction* instr,
+    uint32_t registerNum,
+    uint8_t component)
+{
+    for (unsigned i = 0; i < instr->dstCount; i++) {
+        const Destination* dst = &instr->dsts[i];
+
+        if (dst->registerType == IL_REGTYPE_TEMP && dst->registerNum == registerNum &&
+            dst->component[component] != IL_MODCOMP_NOWRITE) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool readsTempComponent(
+    const Source* src,
+    uint8_t srcComponent,
+    uint32_t registerNum,
+    uint8_t component)
+{
+    return src->registerType == IL_REGTYPE_TEMP && src->registerNum == registerNum &&
+           isPlainSource(src, srcComponent) && src->swizzle[srcComponent] == component;
+}
+
+static bool getLiteralValue(
+    const Kernel* kernel,
+    const Source* src,
+    uint8_t srcComponent,
+    uint32_t* value)
+{
+    if (src->registerType != IL_REGTYPE_LITERAL || !isPlainSource(src, srcComponent)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < kernel->instrCount; i++) {
+        const Instruction* instr = &kernel->instrs[i];
+
+        if (instr->opcode == IL_DCL_LITERAL &&
+            instr->srcs[0].registerNum == src->registerNum) {
+            *value = instr->extras[src->swizzle[srcComponent]];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool evalIntComparison(
+    uint16_t opcode,
+    uint32_t a,
+    uint32_t b)
+{
+    switch (opcode) {
+    case IL_OP_I_EQ:
+        return a == b;
+    case IL_OP_I_NE:
+        return a != b;
+    case IL_OP_I_GE:
+        return (int32_t)a >= (int32_t)b;
+    case IL_OP_I_LT:
+        return (int32_t)a < (int32_t)b;
+    case IL_OP_U_GE:
+        return a >= b;
+    case IL_OP_U_LT:
+        return a < b;
+    default:
+        assert(false);
+        return false;
+    }
+}
+
+static const Instruction* getNextInstruction(
+    const Kernel* kernel,
+    unsigned* index)
+{
+    // Literals are declared right before their first use
+    while (*index < kernel->instrCount && kernel->instrs[*index].opcode == IL_DCL_LITERAL) {
+        (*index)++;
+    }
+
+    return *index < kernel->instrCount ? &kernel->instrs[(*index)++] : NULL;
+}
+
+static bool getLoopTripCount(
+    const Kernel* kernel,
+    unsigned whileIndex,
+    unsigned* tripCount,
+    unsigned* bodyInstrCount)
+{
+    // Match the counter loops emitted for "for (i = a; i < b; i += c)":
+    //   mov rI.i, lA / whileloop / ige rC.c, rI.i, lB / break_logicalnz rC.c / ...
+    //   iadd rI.i, rI.i, lC / endloop
+    unsigned index = whileIndex + 1;
+    const Instruction* cmpInstr = getNextInstruction(kernel, &index);
+    const Instruction* breakInstr = getNextInstruction(kernel, &index);
+
+    if (cmpInstr == NULL || breakInstr == NULL ||
+        (cmpInstr->opcode != IL_OP_I_EQ && cmpInstr->opcode != IL_OP_I_NE &&
+         cmpInstr->opcode != IL_OP_I_GE && cmpInstr->opcode != IL_OP_I_LT &&
+         cmpInstr->opcode != IL_OP_U_GE && cmpInstr->opcode != IL_OP_U_LT) ||
+        (breakInstr->opcode != IL_OP_BREAK_LOGICALZ &&
+         breakInstr->opcode != IL_OP_BREAK_LOGICALNZ)) {
+        return false;
+    }
+
+    const Destination* cmpDst = &cmpInstr->dsts[0];
+    int cmpComp = getSingleWrittenComponent(cmpDst);
+    if (cmpDst->registerType != IL_REGTYPE_TEMP || cmpComp < 0 ||
+        !readsTempComponent(&breakInstr->srcs[0], COMP_INDEX_X, cmpDst->registerNum, cmpComp)) {
+        return false;
+    }
+
+    // The counter is compared against a literal bound, on either side
+    bool isCounterFirst = cmpInstr->srcs[0].registerType == IL_REGTYPE_TEMP;
+    const Source* counterSrc = &cmpInstr->srcs[isCounterFirst ? 0 : 1];
+    const Source* boundSrc = &cmpInstr->srcs[isCounterFirst ? 1 : 0];
+    uint32_t bound;
+    if (counterSrc->registerType != IL_REGTYPE_TEMP || !isPlainSource(counterSrc, cmpComp) ||
+        !getLiteralValue(kernel, boundSrc, cmpComp, &bound)) {
+        return false;
+    }
+
+    uint32_t counterNum = counterSrc->registerNum;
+    uint8_t counterComp = counterSrc->swizzle[cmpComp];
+
+    // Find the single increment, which must run on every iteration
+    bool hasStep = false;
+    uint32_t step = 0;
+    unsigned depth = 0;
+    *bodyInstrCount = 0;
+    for (index = whileIndex + 1; index < kernel->instrCount; index++) {
+        const Instruction* instr = &kernel->instrs[index];
+
+        if (instr->opcode == IL_OP_WHILE ||
+            instr->opcode == IL_OP_CONTINUE ||
+            instr->opcode == IL_OP_CONTINUE_LOGICALZ ||
+            instr->opcode == IL_OP_CONTINUE_LOGICALNZ) {
+            // Nested loops are left for the driver to decide, continues skip the increment
+            return false;
+        } else if (instr->opcode == IL_OP_IF_LOGICALZ || instr->opcode == IL_OP_IF_LOGICALNZ ||
+                   instr->opcode == IL_OP_SWITCH) {
+            depth++;
+        } else if (instr->opcode == IL_OP_ENDIF || instr->opcode == IL_OP_ENDSWITCH) {
+            depth--;
+        } else if (instr->opcode == IL_OP_ENDLOOP) {
+            break;
+        } else if (instr->opcode != IL_DCL_LITERAL) {
+            (*bodyInstrCount)++;
+        }
+
+        if (writesTempComponent(instr, counterNum, counterComp)) {
+            if (hasStep || depth > 0 || instr->opcode != IL_OP_I_ADD ||
+                getSingleWrittenComponent(&instr->dsts[0]) != counterComp ||
+                !readsTempComponent(&instr->srcs[0], counterComp, counterNum, counterComp) ||
+                !getLiteralValue(kernel, &instr->srcs[1], counterComp, &step)) {
+                return false;
+            }
+            hasStep = true;
+        }
+    }
+
+    if (!hasStep) {
+        return false;
+    }
+
+    // Find the initial value, set in the same block before entering the loop
+    bool hasInit = false;
+    uint32_t value = 0;
+    for (int i = whileIndex - 1; i >= 0; i--) {
+        const Instruction* instr = &kernel->instrs[i];
+
+        if (isControlFlowInstruction(instr)) {
+            return false;
+        } else if (writesTempComponent(instr, counterNum, counterComp)) {
+            hasInit = instr->opcode == IL_OP_MOV &&
+                      getLiteralValue(kernel, &instr->srcs[0], counterComp, &value);
+            break;
+        }
+    }
+
+    if (!hasInit) {
+        return false;
+    }
+
+    for (unsigned i = 0; i <= MAX_UNROLL_TRIP_COUNT; i++) {
+        bool cmpResult = isCounterFirst ? evalIntComparison(cmpInstr->opcode, value, bound)
+                                        : evalIntComparison(cmpInstr->opcode, bound, value);
+
+        if (cmpResult == (breakInstr->opcode == IL_OP_BREAK_LOGICALNZ)) {
+            *tripCount = i;
+            return true;
+        }
+        value += step;
+    }
+
+    return false;
+}
+
+static bool isShortBranchFreeIf(
+    const Kernel* kernel,
+    unsigned ifIndex)
+{
+    unsigned instrCount = 0;
+
+    for (unsigned i = ifIndex + 1; i < kernel->instrCount; i++) {
+        const Instruction* instr = &kernel->instrs[i];
+
+        if (instr->opcode == IL_OP_ENDIF) {
+            return true;
+        } else if (instr->opcode == IL_OP_ELSE || instr->opcode == IL_DCL_LITERAL) {
+            continue;
+        } else if (isControlFlowInstruction(instr) ||
+                   instr->opcode == IL_OP_UAV_READ_ADD ||
+                   instr->opcode == IL_OP_LDS_READ_ADD ||
+                   instr->opcode == IL_OP_APPEND_BUF_ALLOC ||
+                   instr->opcode == IL_OP_APPEND_BUF_CONSUME ||
+                   instr->dstCount == 0 ||
+                   ++instrCount > MAX_FLATTEN_INSTR_COUNT) {
+            return false;
+        }
+
+        // Both sides get executed once flattened, only allow writes to registers
+        for (unsigned j = 0; j < instr->dstCount; j++) {
+            if (instr->dsts[j].registerType != IL_REGTYPE_TEMP) {
+                return false;
+            }
+        }
+    }
+
+    return false;
+}
+
+static SpvLoopControlMask getLoopControl(
+    const IlcCompiler* compiler,
+    const Instruction* instr)
+{
+    unsigned tripCount;
+    unsigned bodyInstrCount;
+
+    if ((compiler->controlFlowHints & ILC_HINT_UNROLL) &&
+        getLoopTripCount(compiler->kernel, instr - compiler->kernel->instrs,
+                         &tripCount, &bodyInstrCount) &&
+        tripCount * bodyInstrCount <= MAX_UNROLL_INSTR_COUNT) {
+        return SpvLoopControlUnrollMask;
+    }
+
+    return compiler->controlFlowHints & ILC_HINT_DONT_UNROLL ? SpvLoopControlDontUnrollMask
+                                                             : SpvLoopControlMaskNone;
+}
+
+static SpvSelectionControlMask getSelectionControl(
+    const IlcCompiler* compiler,
+    const Instruction* instr)
+{
+    if ((compiler->controlFlowHints & ILC_HINT_FLATTEN) &&
+        (instr->opcode == IL_OP_IF_LOGICALZ || instr->opcode == IL_OP_IF_LOGICALNZ) &&
+        isShortBranchFreeIf(compiler->kernel, instr - compiler->kernel->instrs)) {
+        return SpvSelectionControlFlattenMask;
+    }
+
+    return compiler->controlFlowHints & ILC_HINT_DONT_FLATTEN ? SpvSelectionControlDontFlattenMask
+                                                              : SpvSelectionControlMaskNone;
+}
+
+static void emitIf(
+    IlcCompiler* compiler,
+    const Instruction* instr)
+{
+    const IlcIfElseBlock ifElseBlock = {
+        .labelElseId = ilcSpvAllocId(compiler->module),
+        .labelEndId = ilcSpvAllocId(compiler->module),
+        .hasElseBlock = false,
+    };
+
+    IlcSpvId srcId = loadSource(compiler, &instr->srcs[0], COMP_MASK_XYZW, compiler->int4Id);
+    IlcSpvId labelBeginId = ilcSpvAllocId(compiler->module);
+    IlcSpvId condId = emitConditionCheck(compiler, srcId, instr->opcode == IL_OP_IF_LOGICALNZ);
+    ilcSpvPutSelectionMerge(compiler->module, ifElseBlock.labelEndId,
+                            getSelectionControl(compiler, instr));
+    ilcSpvPutBranchConditional(compiler->module, condId, labelBeginId, ifElseBlock.labelElseId);
+    ilcSpvPutLabel(compiler->module, labelBeginId);
+
+    const IlcControlFlowBlock block = {
+        .type = BLOCK_IF_ELSE,
+        .ifElse = ifElseBlock,
+    };
+    pushControlFlowBlock(compiler, &block);
 }
 
 static void emitElse(
@@ -2201,7 +3243,8 @@ static void emitWhile(
     ilcSpvPutBranch(compiler->module, loopBlock.labelHeaderId);
     ilcSpvPutLabel(compiler->module, loopBlock.labelHeaderId);
 
-    ilcSpvPutLoopMerge(compiler->module, loopBlock.labelBreakId, loopBlock.labelContinueId);
+    ilcSpvPutLoopMerge(compiler->module, loopBlock.labelBreakId, loopBlock.labelContinueId,
+                       getLoopControl(compiler, instr));
 
     IlcSpvId labelBeginId = ilcSpvAllocId(compiler->module);
     ilcSpvPutBranch(compiler->module, labelBeginId);
@@ -2309,7 +3352,8 @@ static void emitEndSwitch(
 
     // Retroactively insert OpSwitch
     unsigned wordIndex = ilcSpvGetWordIndex(compiler->module, ID_CODE);
-    ilcSpvPutSelectionMerge(compiler->module, block.switchCase.labelBreakId);
+    ilcSpvPutSelectionMerge(compiler->module, block.switchCase.labelBreakId,
+                            getSelectionControl(compiler, instr));
     ilcSpvPutSwitch(compiler->module, block.switchCase.selectorId, block.switchCase.labelDefaultId,
                     block.switchCase.caseCount * sizeof(IlcCase) / sizeof(IlcSpvWord),
                     (IlcSpvWord*)block.switchCase.cases);
@@ -2428,7 +3472,7 @@ static void emitDiscard(
 
     IlcSpvId srcId = loadSource(compiler, &instr->srcs[0], COMP_MASK_XYZW, compiler->int4Id);
     IlcSpvId condId = emitConditionCheck(compiler, srcId, instr->opcode == IL_OP_DISCARD_LOGICALNZ);
-    ilcSpvPutSelectionMerge(compiler->module, labelEndId);
+    ilcSpvPutSelectionMerge(compiler->module, labelEndId, SpvSelectionControlMaskNone);
     ilcSpvPutBranchConditional(compiler->module, condId, labelBeginId, labelEndId);
     ilcSpvPutLabel(compiler->module, labelBeginId);
 
@@ -2834,6 +3878,73 @@ static void emitLdsStoreVec(
     }
 }
 
+// Returns 0 if the resource isn't bound
+static IlcSpvId getVectorView(
+    IlcCompiler* compiler,
+    const IlcResource* resource,
+    bool isReadOnly)
+{
+    uint32_t ilId = resource->ilId;
+    IlcSpvId bufferId = resource->id;
+
+    const IlcResource* viewResource = findResource(compiler, RES_TYPE_GENERIC_VEC4, ilId);
+    if (viewResource != NULL) {
+        return viewResource->id;
+    }
+
+    // Lazily declare a float4 view bound to the same descriptor
+    const IlcBinding* binding = NULL;
+    for (unsigned i = 0; i < compiler->bindingCount; i++) {
+        if (compiler->bindings[i].type == ILC_BINDING_RESOURCE &&
+            compiler->bindings[i].ilIndex == ilId) {
+            binding = &compiler->bindings[i];
+            break;
+        }
+    }
+
+    if (binding == NULL) {
+        LOGW("no binding for resource %u, accessing words one by one\n", ilId);
+        return 0;
+    }
+
+    IlcSpvWord vkIndex = binding->vkIndex;
+
+    IlcSpvId arrayId = ilcSpvPutRuntimeArrayType(compiler->module, compiler->float4Id, true);
+    IlcSpvId structId = ilcSpvPutStructType(compiler->module, 1, &arrayId);
+    IlcSpvId pointerId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
+                                              structId);
+    IlcSpvId viewId = ilcSpvPutVariable(compiler->module, pointerId, SpvStorageClassStorageBuffer);
+
+    IlcSpvWord arrayStride = 4 * sizeof(float);
+    IlcSpvWord memberOffset = 0;
+    IlcSpvWord set = DESCRIPTOR_SET_ID;
+    ilcSpvPutDecoration(compiler->module, arrayId, SpvDecorationArrayStride, 1, &arrayStride);
+    ilcSpvPutDecoration(compiler->module, structId, SpvDecorationBlock, 0, NULL);
+    ilcSpvPutMemberDecoration(compiler->module, structId, 0, SpvDecorationOffset, 1, &memberOffset);
+    ilcSpvPutDecoration(compiler->module, viewId, SpvDecorationDescriptorSet, 1, &set);
+    ilcSpvPutDecoration(compiler->module, viewId, SpvDecorationBinding, 1, &vkIndex);
+
+    if (isReadOnly) {
+        ilcSpvPutDecoration(compiler->module, viewId, SpvDecorationNonWritable, 0, NULL);
+    } else {
+        // Writes through one view must be visible through the other
+        ilcSpvPutDecoration(compiler->module, bufferId, SpvDecorationAliased, 0, NULL);
+        ilcSpvPutDecoration(compiler->module, viewId, SpvDecorationAliased, 0, NULL);
+    }
+
+    const IlcResource vectorResource = {
+        .resType = RES_TYPE_GENERIC_VEC4,
+        .id = viewId,
+        .typeId = arrayId,
+        .texelTypeId = compiler->float4Id,
+        .ilId = ilId,
+        .ilType = IL_USAGE_PIXTEX_UNKNOWN,
+        .strideId = 0,
+    };
+
+    return addResource(compiler, &vectorResource)->id;
+}
+
 static void emitUavLoad(
     IlcCompiler* compiler,
     const Instruction* instr)
@@ -2873,10 +3984,29 @@ static void emitUavStructLoad(
     IlcSpvId srcId = loadSource(compiler, &instr->srcs[0], COMP_MASK_XYZW, compiler->int4Id);
     IlcSpvId indexId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_X, 1);
     IlcSpvId offsetId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_Y, 1);
+    IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->intId, ZERO_LITERAL);
+    IlcSpvId vecAddrId = emitVectorAddress(compiler, indexId, resource->strideId, offsetId,
+                                           isWholeVectorAccess(dst));
+
+    IlcSpvId viewId = 0;
+    if (vecAddrId != 0) {
+        viewId = getVectorView(compiler, resource, false);
+    }
+
+    if (viewId != 0) {
+        // Aligned, read the whole vector at once
+        IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
+                                                  compiler->float4Id);
+        const IlcSpvId indexIds[] = { zeroId, vecAddrId };
+        IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, viewId, 2, indexIds);
+        IlcSpvId loadId = ilcSpvPutLoad(compiler->module, compiler->float4Id, ptrId);
+        storeDestination(compiler, dst, loadId, compiler->float4Id);
+        return;
+    }
+
     IlcSpvId wordAddrId = emitWordAddress(compiler, indexId, resource->strideId, offsetId);
 
     // Read up to four components based on the destination mask
-    IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->intId, ZERO_LITERAL);
     IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
                                               resource->texelTypeId);
     IlcSpvId fZeroId = ilcSpvPutConstant(compiler->module, compiler->floatId, ZERO_LITERAL);
@@ -2946,16 +4076,37 @@ static void emitUavRawStructStore(
 
     IlcSpvId srcId = loadSource(compiler, &instr->srcs[0], COMP_MASK_XYZW, compiler->int4Id);
     IlcSpvId dataId = loadSource(compiler, &instr->srcs[1], COMP_MASK_XYZW, compiler->float4Id);
-    IlcSpvId wordAddrId = 0;
-    if (isRaw) {
-        IlcSpvId addrId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_X, 1);
-        wordAddrId = emitWordAddress(compiler, addrId, 0, 0);
-    } else {
-        IlcSpvId indexId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_X, 1);
-        IlcSpvId offsetId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_Y, 1);
-        wordAddrId = emitWordAddress(compiler, indexId, resource->strideId, offsetId);
+    IlcSpvId indexId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_X, 1);
+    IlcSpvId offsetId = 0;
+    IlcSpvId strideId = 0;
+    if (!isRaw) {
+        offsetId = emitVectorTrim(compiler, srcId, compiler->int4Id, COMP_INDEX_Y, 1);
+        strideId = resource->strideId;
     }
     IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->intId, 0);
+
+    // Partial stores stay per-component so that the other words are left untouched
+    IlcSpvId vecAddrId = 0;
+    if (isWholeVectorAccess(dst)) {
+        vecAddrId = emitVectorAddress(compiler, indexId, strideId, offsetId, true);
+    }
+
+    IlcSpvId viewId = 0;
+    if (vecAddrId != 0) {
+        viewId = getVectorView(compiler, resource, false);
+    }
+
+    if (viewId != 0) {
+        // Aligned, write the whole vector at once
+        IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
+                                                  compiler->float4Id);
+        IlcSpvId indexIds[] = { zeroId, vecAddrId };
+        IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, viewId, 2, indexIds);
+        ilcSpvPutStore(compiler->module, ptrId, dataId);
+        return;
+    }
+
+    IlcSpvId wordAddrId = emitWordAddress(compiler, indexId, strideId, offsetId);
     IlcSpvId oneId = ilcSpvPutConstant(compiler->module, compiler->intId, 1);
     IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
                                               resource->texelTypeId);
@@ -3181,33 +4332,52 @@ static void emitStructuredSrvLoad(
 
     // Read data words as 32-bit floats
     // TODO redeclare resources based on type to avoid type conversions
-    IlcSpvId wordAddrId = emitWordAddress(compiler, indexId, resource->strideId, offsetId);
     IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->intId, ZERO_LITERAL);
-    IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
-                                              resource->texelTypeId);
     IlcSpvId fZeroId = ilcSpvPutConstant(compiler->module, compiler->floatId, ZERO_LITERAL);
     IlcSpvId fWordIds[] = { fZeroId, fZeroId, fZeroId, fZeroId };
+    bool isWholeVector = wordCount == 4 && (elemCount > 1 || isWholeVectorAccess(dst));
+    IlcSpvId vecAddrId = emitVectorAddress(compiler, indexId, resource->strideId, offsetId,
+                                           isWholeVector);
+
+    if (vecAddrId != 0) {
+        // Aligned, read the whole vector at once and split it into words
+        IlcSpvId viewId = getVectorView(compiler, resource, true);
+        IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
+                                                  compiler->float4Id);
+        const IlcSpvId indexIds[] = { zeroId, vecAddrId };
+        IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, viewId, 2, indexIds);
+        IlcSpvId loadId = ilcSpvPutLoad(compiler->module, compiler->float4Id, ptrId);
 
-    for (unsigned i = 0; i < wordCount; i++) {
-        IlcSpvId addrId;
-
-        if (elemCount == 1 && dst->component[i] == IL_MODCOMP_NOWRITE) {
-            // Skip read if each element is a whole word and this component is not written to dst
-            continue;
+        for (unsigned i = 0; i < wordCount; i++) {
+            fWordIds[i] = ilcSpvPutCompositeExtract(compiler->module, compiler->floatId, loadId,
+                                                    1, &i);
         }
+    } else {
+        IlcSpvId wordAddrId = emitWordAddress(compiler, indexId, resource->strideId, offsetId);
+        IlcSpvId ptrTypeId = ilcSpvPutPointerType(compiler->module, SpvStorageClassStorageBuffer,
+                                                  resource->texelTypeId);
 
-        if (i == 0) {
-            addrId = wordAddrId;
-        } else {
-            IlcSpvId offsetId = ilcSpvPutConstant(compiler->module, compiler->intId, i);
-            addrId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->intId,
-                                  wordAddrId, offsetId);
-        }
+        for (unsigned i = 0; i < wordCount; i++) {
+            IlcSpvId addrId;
 
-        const IlcSpvId indexIds[] = { zeroId, addrId };
-        IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, resource->id,
-                                              2, indexIds);
-        fWordIds[i] = ilcSpvPutLoad(compiler->module, resource->texelTypeId, ptrId);
+            if (elemCount == 1 && dst->component[i] == IL_MODCOMP_NOWRITE) {
+                // Skip read if each element is a whole word and this component is not written
+                continue;
+            }
+
+            if (i == 0) {
+                addrId = wordAddrId;
+            } else {
+                IlcSpvId offsetId = ilcSpvPutConstant(compiler->module, compiler->intId, i);
+                addrId = ilcSpvPutOp2(compiler->module, SpvOpIAdd, compiler->intId,
+                                      wordAddrId, offsetId);
+            }
+
+            const IlcSpvId indexIds[] = { zeroId, addrId };
+            IlcSpvId ptrId = ilcSpvPutAccessChain(compiler->module, ptrTypeId, resource->id,
+                                                  2, indexIds);
+            fWordIds[i] = ilcSpvPutLoad(compiler->module, resource->texelTypeId, ptrId);
+        }
     }
 
     IlcSpvId resId = 0;
@@ -3609,7 +4779,7 @@ static void emitHullMainFunction(
             .labelId = ilcSpvAllocId(compiler->module),
         };
     }
-    ilcSpvPutSelectionMerge(compiler->module, labelBreakId);
+    ilcSpvPutSelectionMerge(compiler->module, labelBreakId, SpvSelectionControlMaskNone);
     ilcSpvPutSwitch(compiler->module, instanceId, labelBreakId,
                     compiler->hsForkPhaseIdCount * sizeof(IlcCase) / sizeof(IlcSpvWord),
                     (IlcSpvWord*)cases);
@@ -3636,7 +4806,7 @@ static void emitHullMainFunction(
                                    instanceId, zeroId);
     IlcSpvId labelBeginId = ilcSpvAllocId(compiler->module);
     IlcSpvId labelEndId = ilcSpvAllocId(compiler->module);
-    ilcSpvPutSelectionMerge(compiler->module, labelEndId);
+    ilcSpvPutSelectionMerge(compiler->module, labelEndId, SpvSelectionControlMaskNone);
     ilcSpvPutBranchConditional(compiler->module, condId, labelBeginId, labelEndId);
 
     ilcSpvPutLabel(compiler->module, labelBeginId);
@@ -3649,6 +4819,193 @@ static void emitHullMainFunction(
 }
 #endif // TESS
 
+static void emitRectangleCall(
+    IlcCompiler* compiler,
+    IlcSpvId functionId,
+    const IlcRegister* vertexIdReg,
+    IlcSpvId vertexIndexId)
+{
+    IlcSpvId voidTypeId = ilcSpvPutVoidType(compiler->module);
+
+    if (vertexIdReg != NULL) {
+        ilcSpvPutStore(compiler->module, vertexIdReg->id, vertexIndexId);
+    }
+    ilcSpvPutFunctionCall(compiler->module, voidTypeId, functionId);
+}
+
+static IlcSpvId emitRectangleVertexSelect(
+    IlcCompiler* compiler,
+    IlcSpvId indexId,
+    const IlcSpvId* valueIds)
+{
+    const IlcSpvId indexIds[] = {
+        ilcSpvPutConstant(compiler->module, compiler->uintId, 0),
+        ilcSpvPutConstant(compiler->module, compiler->uintId, 1),
+    };
+
+    IlcSpvId isFirstId = ilcSpvPutOp2(compiler->module, SpvOpIEqual, compiler->boolId,
+                                      indexId, indexIds[0]);
+    IlcSpvId isSecondId = ilcSpvPutOp2(compiler->module, SpvOpIEqual, compiler->boolId,
+                                       indexId, indexIds[1]);
+    IlcSpvId resId = ilcSpvPutSelect(compiler->module, compiler->float4Id, isSecondId,
+                                     valueIds[1], valueIds[2]);
+    return ilcSpvPutSelect(compiler->module, compiler->float4Id, isFirstId, valueIds[0], resId);
+}
+
+static void emitRectangleMainFunction(
+    IlcCompiler* compiler,
+    IlcSpvId functionId)
+{
+    IlcSpvModule* module = compiler->module;
+    const IlcRegister* vertexIdReg = NULL;
+    unsigned outputCount = 0;
+    const IlcRegister** outputRegs = malloc(compiler->regCount * sizeof(IlcRegister*));
+    IlcSpvId* outputIds = malloc(compiler->regCount * sizeof(IlcSpvId));
+    int positionIndex = -1;
+
+    compiler->rectangleInterfaceIds = malloc((compiler->regCount + 2) * sizeof(IlcSpvId));
+
+    // Declare the real outputs of the private ones the shader function writes
+    for (int i = 0; i < compiler->regCount; i++) {
+        const IlcRegister* reg = &compiler->regs[i];
+
+        if (reg->ilType == IL_REGTYPE_INPUT && reg->ilImportUsage == IL_IMPORTUSAGE_VERTEXID) {
+            vertexIdReg = reg;
+        }
+        if (reg->ilType != IL_REGTYPE_OUTPUT || isUnlinkedOutput(compiler, reg) ||
+            (reg->ilImportUsage != IL_IMPORTUSAGE_POS &&
+             reg->ilImportUsage != IL_IMPORTUSAGE_GENERIC)) {
+            continue;
+        }
+
+        IlcSpvId outputId = emitVariable(compiler, reg->typeId, SpvStorageClassOutput);
+        if (reg->ilImportUsage == IL_IMPORTUSAGE_POS) {
+            IlcSpvWord builtInType = SpvBuiltInPosition;
+            ilcSpvPutDecoration(module, outputId, SpvDecorationBuiltIn, 1, &builtInType);
+            positionIndex = outputCount;
+        } else {
+            IlcSpvWord locationIdx = reg->ilNum;
+            ilcSpvPutDecoration(module, outputId, SpvDecorationLocation, 1, &locationIdx);
+        }
+
+        outputRegs[outputCount] = reg;
+        outputIds[outputCount] = outputId;
+        compiler->rectangleInterfaceIds[outputCount] = outputId;
+        outputCount++;
+    }
+
+    IlcSpvId vertexIndexVarId = emitVariable(compiler, compiler->intId, SpvStorageClassInput);
+    IlcSpvWord builtInType = SpvBuiltInVertexIndex;
+    ilcSpvPutDecoration(module, vertexIndexVarId, SpvDecorationBuiltIn, 1, &builtInType);
+    IlcSpvId baseVertexVarId = emitVariable(compiler, compiler->intId, SpvStorageClassInput);
+    builtInType = SpvBuiltInBaseVertex;
+    ilcSpvPutDecoration(module, baseVertexVarId, SpvDecorationBuiltIn, 1, &builtInType);
+    ilcSpvPutCapability(module, SpvCapabilityDrawParameters);
+    compiler->rectangleInterfaceIds[outputCount] = vertexIndexVarId;
+    compiler->rectangleInterfaceIds[outputCount + 1] = baseVertexVarId;
+    compiler->rectangleInterfaceCount = outputCount + 2;
+
+    emitFunc(compiler, compiler->entryPointId);
+
+    // Rectangles take 6 vertices, the first 3 are the rectangle vertices as-is and the last 3
+    // complete it with a triangle of the 2 other vertices and the fourth corner
+    IlcSpvId threeId = ilcSpvPutConstant(module, compiler->intId, 3);
+    IlcSpvId sixId = ilcSpvPutConstant(module, compiler->intId, 6);
+    IlcSpvId vertexIndexId = ilcSpvPutLoad(module, compiler->intId, vertexIndexVarId);
+    IlcSpvId baseVertexId = ilcSpvPutLoad(module, compiler->intId, baseVertexVarId);
+    IlcSpvId indexId = ilcSpvPutOp2(module, SpvOpISub, compiler->intId,
+                                    vertexIndexId, baseVertexId);
+    IlcSpvId rectIndexId = ilcSpvPutOp2(module, SpvOpSDiv, compiler->intId, indexId, sixId);
+    IlcSpvId cornerId = ilcSpvPutOp2(module, SpvOpISub, compiler->intId, indexId,
+                                     ilcSpvPutOp2(module, SpvOpIMul, compiler->intId,
+                                                  rectIndexId, sixId));
+    IlcSpvId firstVertexId = ilcSpvPutOp2(module, SpvOpIAdd, compiler->intId, baseVertexId,
+                                          ilcSpvPutOp2(module, SpvOpIMul, compiler->intId,
+                                                       rectIndexId, threeId));
+    IlcSpvId isFirstTriangleId = ilcSpvPutOp2(module, SpvOpSLessThan, compiler->boolId,
+                                              cornerId, threeId);
+
+    IlcSpvId labelFirstId = ilcSpvAllocId(module);
+    IlcSpvId labelSecondId = ilcSpvAllocId(module);
+    IlcSpvId labelEndId = ilcSpvAllocId(module);
+    ilcSpvPutSelectionMerge(module, labelEndId, SpvSelectionControlMaskNone);
+    ilcSpvPutBranchConditional(module, isFirstTriangleId, labelFirstId, labelSecondId);
+
+    // First triangle, run the shader on the vertex itself
+    ilcSpvPutLabel(module, labelFirstId);
+    emitRectangleCall(compiler, functionId, vertexIdReg,
+                      ilcSpvPutOp2(module, SpvOpIAdd, compiler->intId, firstVertexId, cornerId));
+    for (unsigned i = 0; i < outputCount; i++) {
+        IlcSpvId valueId = ilcSpvPutLoad(module, outputRegs[i]->typeId, outputRegs[i]->id);
+        ilcSpvPutStore(module, outputIds[i], valueId);
+    }
+    ilcSpvPutBranch(module, labelEndId);
+
+    // Second triangle, run the shader on the 3 rectangle vertices to find the corner.
+    // Shaders that write to memory are never expanded, see compileShader
+    ilcSpvPutLabel(module, labelSecondId);
+    IlcSpvId* valueIds = malloc(3 * outputCount * sizeof(IlcSpvId));
+    for (unsigned i = 0; i < 3; i++) {
+        IlcSpvId offsetId = ilcSpvPutConstant(module, compiler->intId, i);
+        emitRectangleCall(compiler, functionId, vertexIdReg,
+                          ilcSpvPutOp2(module, SpvOpIAdd, compiler->intId, firstVertexId,
+                                       offsetId));
+        for (unsigned j = 0; j < outputCount; j++) {
+            valueIds[3 * j + i] = ilcSpvPutLoad(module, outputRegs[j]->typeId, outputRegs[j]->id);
+        }
+    }
+
+    IlcSpvId positionIds[3];
+    for (unsigned i = 0; i < 3; i++) {
+        positionIds[i] = positionIndex >= 0 ? valueIds[3 * positionIndex + i]
+                                            : ilcSpvPutConstantNull(module, compiler->float4Id);
+    }
+
+    // Same vertex order as the strip the geometry shader emits
+    IlcSpvId weightIds[3];
+    IlcSpvId rectCornerId = ilcPutRectangleCorner(module, positionIds, weightIds);
+    IlcSpvId uintThreeId = ilcSpvPutConstant(module, compiler->uintId, 3);
+    const IlcSpvId nextIds[] = {
+        ilcSpvPutOp2(module, SpvOpIAdd, compiler->uintId, rectCornerId,
+                     ilcSpvPutConstant(module, compiler->uintId, 2)),
+        ilcSpvPutOp2(module, SpvOpIAdd, compiler->uintId, rectCornerId,
+                     ilcSpvPutConstant(module, compiler->uintId, 1)),
+    };
+    IlcSpvId isThirdId = ilcSpvPutOp2(module, SpvOpIEqual, compiler->boolId, cornerId, threeId);
+    IlcSpvId isFourthId = ilcSpvPutOp2(module, SpvOpIEqual, compiler->boolId, cornerId,
+                                       ilcSpvPutConstant(module, compiler->intId, 5));
+    IlcSpvId vertexId = ilcSpvPutSelect(module, compiler->uintId, isThirdId,
+                                        nextIds[0], nextIds[1]);
+    vertexId = ilcSpvPutOp2(module, SpvOpUMod, compiler->uintId, vertexId, uintThreeId);
+
+    for (unsigned i = 0; i < outputCount; i++) {
+        const IlcRegister* reg = outputRegs[i];
+        IlcSpvId valueId;
+
+        if (reg->ilImportUsage == IL_IMPORTUSAGE_GENERIC && reg->ilNum < 32 &&
+            (compiler->flatOutputMask & (1u << reg->ilNum)) != 0) {
+            // The first vertex of the second triangle provokes it
+            valueId = valueIds[3 * i];
+        } else {
+            IlcSpvId fourthId = ilcPutRectangleFourthVertex(module, compiler->float4Id,
+                                                            weightIds, &valueIds[3 * i]);
+            valueId = emitRectangleVertexSelect(compiler, vertexId, &valueIds[3 * i]);
+            valueId = ilcSpvPutSelect(module, compiler->float4Id, isFourthId, fourthId, valueId);
+        }
+        ilcSpvPutStore(module, outputIds[i], valueId);
+    }
+    ilcSpvPutBranch(module, labelEndId);
+
+    ilcSpvPutLabel(module, labelEndId);
+    ilcSpvPutReturn(module);
+    ilcSpvPutFunctionEnd(module);
+    compiler->isInFunction = false;
+
+    free(outputRegs);
+    free(outputIds);
+    free(valueIds);
+}
+
 static void emitEntryPoint(
     IlcCompiler* compiler)
 {
@@ -3680,13 +5037,19 @@ static void emitEntryPoint(
 
     unsigned interfaceCount = compiler->regCount +
                               compiler->resourceCount +
-                              compiler->samplerCount;
+                              compiler->samplerCount +
+                              compiler->rectangleInterfaceCount;
     IlcSpvWord* interfaces = malloc(sizeof(IlcSpvWord) * interfaceCount);
     unsigned interfaceIndex = 0;
 
     for (int i = 0; i < compiler->regCount; i++) {
         const IlcRegister* reg = &compiler->regs[i];
 
+        if (reg->interfaceId == 0) {
+            // Literals have no variable
+            continue;
+        }
+
         interfaces[interfaceIndex] = reg->interfaceId;
         interfaceIndex++;
     }
@@ -3702,9 +5065,13 @@ static void emitEntryPoint(
         interfaces[interfaceIndex] = sampler->id;
         interfaceIndex++;
     }
+    for (int i = 0; i < compiler->rectangleInterfaceCount; i++) {
+        interfaces[interfaceIndex] = compiler->rectangleInterfaceIds[i];
+        interfaceIndex++;
+    }
 
     ilcSpvPutEntryPoint(compiler->module, compiler->entryPointId, execution, name,
-                        interfaceCount, interfaces);
+                        interfaceIndex, interfaces);
     ilcSpvPutName(compiler->module, compiler->entryPointId, name);
 
     switch (compiler->kernel->shaderType) {
@@ -3718,16 +5085,438 @@ static void emitEntryPoint(
     free(interfaces);
 }
 
+static IlcValueType getSourceValueType(
+    const Instruction* instr,
+    unsigned srcIndex)
+{
+    // Mirrors the types operands are loaded with, see emitInstr
+    switch (instr->opcode) {
+    case IL_OP_ABS:
+    case IL_OP_ACOS:
+    case IL_OP_ADD:
+    case IL_OP_ASIN:
+    case IL_OP_ATAN:
+    case IL_OP_DIV:
+    case IL_OP_DP3:
+    case IL_OP_DP4:
+    case IL_OP_DSX:
+    case IL_OP_DSY:
+    case IL_OP_FRC:
+    case IL_OP_MAD:
+    case IL_OP_MAX:
+    case IL_OP_MIN:
+    case IL_OP_MUL:
+    case IL_OP_FTOI:
+    case IL_OP_FTOU:
+    case IL_OP_ROUND_NEAR:
+    case IL_OP_ROUND_NEG_INF:
+    case IL_OP_ROUND_PLUS_INF:
+    case IL_OP_ROUND_ZERO:
+    case IL_OP_EXP_VEC:
+    case IL_OP_LOG_VEC:
+    case IL_OP_RSQ_VEC:
+    case IL_OP_SIN_VEC:
+    case IL_OP_COS_VEC:
+    case IL_OP_SQRT_VEC:
+    case IL_OP_DP2:
+    case IL_OP_F_2_F16:
+    case IL_OP_RCP_VEC:
+    case IL_OP_EQ:
+    case IL_OP_GE:
+    case IL_OP_LT:
+    case IL_OP_NE:
+    case IL_OP_BREAKC:
+    case IL_OP_SAMPLE:
+    case IL_OP_SAMPLE_B:
+    case IL_OP_SAMPLE_G:
+    case IL_OP_SAMPLE_L:
+    case IL_OP_SAMPLE_C_LZ:
+    case IL_OP_FETCH4:
+    case IL_OP_FETCH4_C:
+        return VALUE_TYPE_FLOAT;
+    case IL_OP_ITOF:
+    case IL_OP_F16_2_F:
+    case IL_OP_I_NOT:
+    case IL_OP_I_OR:
+    case IL_OP_I_XOR:
+    case IL_OP_I_ADD:
+    case IL_OP_I_MAD:
+    case IL_OP_I_MAX:
+    case IL_OP_I_MIN:
+    case IL_OP_I_MUL:
+    case IL_OP_I_NEGATE:
+    case IL_OP_I_SHL:
+    case IL_OP_I_SHR:
+    case IL_OP_U_SHR:
+    case IL_OP_U_MAX:
+    case IL_OP_U_MIN:
+    case IL_OP_AND:
+    case IL_OP_I_FIRSTBIT:
+    case IL_OP_I_BIT_EXTRACT:
+    case IL_OP_U_BIT_EXTRACT:
+    case IL_OP_U_BIT_INSERT:
+    case IL_OP_I_EQ:
+    case IL_OP_I_GE:
+    case IL_OP_I_LT:
+    case IL_OP_I_NE:
+    case IL_OP_U_LT:
+    case IL_OP_U_GE:
+    case IL_OP_IF_LOGICALZ:
+    case IL_OP_IF_LOGICALNZ:
+    case IL_OP_BREAK_LOGICALZ:
+    case IL_OP_BREAK_LOGICALNZ:
+    case IL_OP_CONTINUE_LOGICALZ:
+    case IL_OP_CONTINUE_LOGICALNZ:
+    case IL_OP_DISCARD_LOGICALZ:
+    case IL_OP_DISCARD_LOGICALNZ:
+    case IL_OP_SWITCH:
+        return VALUE_TYPE_INT;
+    case IL_OP_UTOF:
+    case IL_OP_U_DIV:
+    case IL_OP_U_MOD:
+        return VALUE_TYPE_UINT;
+    case IL_OP_CMOV_LOGICAL:
+    case IL_OP_LOAD:
+    case IL_OP_RESINFO:
+    case IL_OP_UAV_LOAD:
+    case IL_OP_UAV_STRUCT_LOAD:
+    case IL_OP_SRV_STRUCT_LOAD:
+        // Condition or address
+        return srcIndex == 0 ? VALUE_TYPE_INT : VALUE_TYPE_NONE;
+    default:
+        return VALUE_TYPE_NONE;
+    }
+}
+
+static IlcValueType getDestinationValueType(
+    const Instruction* instr)
+{
+    switch (instr->opcode) {
+    case IL_OP_MOV:
+    case IL_OP_CMOV_LOGICAL:
+        return VALUE_TYPE_NONE;
+    case IL_OP_FTOI:
+    case IL_OP_F_2_F16:
+    case IL_OP_EQ:
+    case IL_OP_GE:
+    case IL_OP_LT:
+    case IL_OP_NE:
+    case IL_OP_I_EQ:
+    case IL_OP_I_GE:
+    case IL_OP_I_LT:
+    case IL_OP_I_NE:
+    case IL_OP_U_LT:
+    case IL_OP_U_GE:
+        return VALUE_TYPE_INT;
+    case IL_OP_FTOU:
+    case IL_OP_U_DIV:
+    case IL_OP_U_MOD:
+        return VALUE_TYPE_UINT;
+    case IL_OP_ITOF:
+    case IL_OP_UTOF:
+    case IL_OP_F16_2_F:
+    case IL_OP_SAMPLE:
+    case IL_OP_SAMPLE_B:
+    case IL_OP_SAMPLE_G:
+    case IL_OP_SAMPLE_L:
+    case IL_OP_SAMPLE_C_LZ:
+    case IL_OP_FETCH4:
+    case IL_OP_FETCH4_C:
+    case IL_OP_FETCH4_PO:
+    case IL_OP_FETCH4_PO_C:
+        return VALUE_TYPE_FLOAT;
+    default:
+        // Same as the sources for ALU ops
+        return instr->dstCount > 0 && instr->srcCount > 0 ? getSourceValueType(instr, 0)
+                                                          : VALUE_TYPE_NONE;
+    }
+}
+
+static unsigned getSourceTempCount(
+    const Source* src)
+{
+    unsigned tempCount = src->registerType == IL_REGTYPE_TEMP ? src->registerNum + 1 : 0;
+
+    for (unsigned i = 0; i < src->srcCount; i++) {
+        tempCount = MAX(tempCount, getSourceTempCount(&src->srcs[i]));
+    }
+
+    return tempCount;
+}
+
+static void countSourceUsage(
+    IlcTempUsage* usages,
+    const Source* src,
+    IlcValueType type,
+    uint8_t readMask)
+{
+    if (src->registerType == IL_REGTYPE_TEMP) {
+        IlcTempUsage* usage = &usages[src->registerNum];
+
+        usage->typeCounts[type]++;
+        for (unsigned i = 0; i < 4; i++) {
+            if ((readMask & (1 << i)) && src->swizzle[i] <= IL_COMPSEL_W_A) {
+                usage->componentMask |= 1 << src->swizzle[i];
+            }
+        }
+    }
+
+    // Relative addressing, only the first component is used as index
+    for (unsigned i = 0; i < src->srcCount; i++) {
+        countSourceUsage(usages, &src->srcs[i], VALUE_TYPE_INT, COMP_MASK_X);
+    }
+}
+
+static void analyzeTemps(
+    IlcCompiler* compiler)
+{
+    const Kernel* kernel = compiler->kernel;
+
+    // Size the table after the highest r# in use
+    unsigned tempCount = 0;
+    for (unsigned i = 0; i < kernel->instrCount; i++) {
+        const Instruction* instr = &kernel->instrs[i];
+
+        for (unsigned j = 0; j < instr->dstCount; j++) {
+            const Destination* dst = &instr->dsts[j];
+
+            if (dst->registerType == IL_REGTYPE_TEMP) {
+                tempCount = MAX(tempCount, dst->registerNum + 1);
+            }
+            for (unsigned k = 0; k < dst->relativeSrcCount; k++) {
+                tempCount = MAX(tempCount, getSourceTempCount(&dst->relativeSrcs[k]));
+            }
+        }
+        for (unsigned j = 0; j < instr->srcCount; j++) {
+            tempCount = MAX(tempCount, getSourceTempCount(&instr->srcs[j]));
+        }
+    }
+
+    if (tempCount == 0) {
+        return;
+    }
+
+    // Count how each register is written and read, and which components are read back
+    IlcTempUsage* usages = calloc(tempCount, sizeof(IlcTempUsage));
+    for (unsigned i = 0; i < kernel->instrCount; i++) {
+        const Instruction* instr = &kernel->instrs[i];
+        uint8_t readMask = COMP_MASK_XYZW;
+
+        for (unsigned j = 0; j < instr->dstCount; j++) {
+            const Destination* dst = &instr->dsts[j];
+
+            if (dst->registerType == IL_REGTYPE_TEMP) {
+                usages[dst->registerNum].typeCounts[getDestinationValueType(instr)]++;
+            }
+            for (unsigned k = 0; k < dst->relativeSrcCount; k++) {
+                countSourceUsage(usages, &dst->relativeSrcs[k], VALUE_TYPE_INT, COMP_MASK_X);
+            }
+        }
+
+        if (instr->dstCount > 0) {
+            // Sources feeding masked out or constant components are ignored
+            readMask = getOperationMask(compiler, instr);
+        }
+
+        for (unsigned j = 0; j < instr->srcCount; j++) {
+            countSourceUsage(usages, &instr->srcs[j], getSourceValueType(instr, j), readMask);
+        }
+    }
+
+    // Registers are reused across unrelated values, and a cast in front of a swizzle doesn't fold
+    // away after promotion, so only move away from float when integer usage clearly dominates.
+    // Components that are never read are dead, writes to them are dropped. Narrow registers are
+    // only worth it once promoted.
+    compiler->tempInfoCount = tempCount;
+    compiler->tempInfos = malloc(sizeof(IlcTempInfo) * tempCount);
+    for (unsigned i = 0; i < tempCount; i++) {
+        const unsigned* typeCounts = usages[i].typeCounts;
+        IlcValueType intType = typeCounts[VALUE_TYPE_UINT] > typeCounts[VALUE_TYPE_INT]
+                             ? VALUE_TYPE_UINT : VALUE_TYPE_INT;
+        uint8_t componentMask = usages[i].componentMask;
+
+        if (!compiler->optimize) {
+            componentMask = COMP_MASK_XYZW;
+        } else if (componentMask == 0) {
+            // Never read, keep a single component around
+            componentMask = COMP_MASK_X;
+        }
+
+        compiler->tempInfos[i] = (IlcTempInfo) {
+            .type = typeCounts[intType] > 2 * typeCounts[VALUE_TYPE_FLOAT]
+                  ? intType : VALUE_TYPE_FLOAT,
+            .componentMask = componentMask,
+        };
+    }
+
+    free(usages);
+}
+
+static bool isPromotableRegister(
+    const IlcCompiler* compiler,
+    const IlcRegister* reg)
+{
+    return reg->ilType == IL_REGTYPE_TEMP || isUnlinkedOutput(compiler, reg);
+}
+
+static void promoteRegisters(
+    IlcCompiler* compiler)
+{
+    IlcSpvId* varIds = malloc(sizeof(IlcSpvId) * compiler->regCount);
+    unsigned varCount = 0;
+
+    // Only non-indexed temporaries and unlinked outputs, x# arrays are accessed through access
+    // chains
+    for (int i = 0; i < compiler->regCount; i++) {
+        if (isPromotableRegister(compiler, &compiler->regs[i])) {
+            varIds[varCount] = compiler->regs[i].id;
+            varCount++;
+        }
+    }
+
+    ilcSpvPromoteVariables(compiler->module, varCount, varIds);
+
+    // Drop promoted registers from the entry point interface
+    unsigned varIndex = 0;
+    unsigned regCount = 0;
+    for (int i = 0; i < compiler->regCount; i++) {
+        const IlcRegister* reg = &compiler->regs[i];
+
+        if (isPromotableRegister(compiler, reg) && varIds[varIndex++] == 0) {
+            continue;
+        }
+
+        compiler->regs[regCount] = *reg;
+        regCount++;
+    }
+
+    LOGV("promoted %u/%u registers\n", compiler->regCount - regCount, varCount);
+    compiler->regCount = regCount;
+    rebuildIndices(compiler);
+    free(varIds);
+}
+
+static bool isOutputRegister(
+    const IlcRegister* reg)
+{
+    return reg->ilType == IL_REGTYPE_OUTPUT || reg->ilType == IL_REGTYPE_DEPTH ||
+           reg->ilType == IL_REGTYPE_OMASK;
+}
+
+static bool hasRemovableVariable(
+    const IlcCompiler* compiler,
+    const IlcRegister* reg)
+{
+    return reg->interfaceId != 0 &&
+           (!isOutputRegister(reg) || isUnlinkedOutput(compiler, reg));
+}
+
+static void eliminateDeadCode(
+    IlcCompiler* compiler)
+{
+    unsigned maxVarCount = compiler->regCount + compiler->resourceCount + compiler->samplerCount;
+    IlcSpvId* varIds = malloc(sizeof(IlcSpvId) * maxVarCount);
+    unsigned varCount = 0;
+
+    ilcSpvFoldInstructions(compiler->module);
+    ilcSpvEliminateDeadCode(compiler->module);
+
+    // Keep linked outputs, they're part of the interface with the next stage
+    for (int i = 0; i < compiler->regCount; i++) {
+        if (hasRemovableVariable(compiler, &compiler->regs[i])) {
+            varIds[varCount] = compiler->regs[i].interfaceId;
+            varCount++;
+        }
+    }
+    for (int i = 0; i < compiler->resourceCount; i++) {
+        varIds[varCount] = compiler->resources[i].id;
+        varCount++;
+    }
+    for (int i = 0; i < compiler->samplerCount; i++) {
+        varIds[varCount] = compiler->samplers[i].id;
+        varCount++;
+    }
+
+    ilcSpvRemoveUnusedVariables(compiler->module, varCount, varIds);
+
+    // Drop removed variables from the entry point interface
+    unsigned regCount = 0;
+    unsigned resourceCount = 0;
+    unsigned samplerCount = 0;
+    unsigned varIndex = 0;
+
+    for (int i = 0; i < compiler->regCount; i++) {
+        const IlcRegister* reg = &compiler->regs[i];
+
+        if (!hasRemovableVariable(compiler, reg) || varIds[varIndex++] != 0) {
+            compiler->regs[regCount] = *reg;
+            regCount++;
+        }
+    }
+    for (int i = 0; i < compiler->resourceCount; i++) {
+        if (varIds[varIndex] != 0) {
+            compiler->resources[resourceCount] = compiler->resources[i];
+            resourceCount++;
+        }
+        varIndex++;
+    }
+    for (int i = 0; i < compiler->samplerCount; i++) {
+        if (varIds[varIndex] != 0) {
+            compiler->samplers[samplerCount] = compiler->samplers[i];
+            samplerCount++;
+        }
+        varIndex++;
+    }
+
+    LOGV("removed %u/%u unused variables\n",
+         maxVarCount - regCount - resourceCount - samplerCount, varCount);
+    compiler->regCount = regCount;
+    compiler->resourceCount = resourceCount;
+    compiler->samplerCount = samplerCount;
+    rebuildIndices(compiler);
+    free(varIds);
+}
+
+static void relaxColorPrecision(
+    IlcCompiler* compiler)
+{
+    IlcSpvId* outputIds = malloc(sizeof(IlcSpvId) * compiler->regCount);
+    unsigned outputCount = 0;
+
+    // Depth and sample mask outputs need full precision
+    for (int i = 0; i < compiler->regCount; i++) {
+        const IlcRegister* reg = &compiler->regs[i];
+
+        if (reg->ilType == IL_REGTYPE_OUTPUT && reg->ilImportUsage == IL_IMPORTUSAGE_GENERIC) {
+            outputIds[outputCount] = reg->id;
+            outputCount++;
+        }
+    }
+
+    ilcSpvRelaxPrecision(compiler->module, outputCount, outputIds);
+    free(outputIds);
+}
+
 IlcShader ilcCompileKernel(
     const Kernel* kernel,
-    const char* name)
+    const char* name,
+    bool optimize,
+    bool relaxedPrecision,
+    IlcControlFlowHints controlFlowHints,
+    bool debugInfo,
+    uint32_t linkedOutputMask,
+    bool expandRectangles,
+    uint32_t flatOutputMask)
 {
     IlcSpvModule module;
 
     ilcSpvInit(&module);
+    module.hasDebugInfo = debugInfo;
 
-    IlcSpvId nameId = ilcSpvPutString(&module, name);
-    ilcSpvPutSource(&module, nameId);
+    if (debugInfo) {
+        IlcSpvId nameId = ilcSpvPutString(&module, name);
+        ilcSpvPutSource(&module, nameId);
+    }
 
     IlcSpvId uintId = ilcSpvPutIntType(&module, false);
     IlcSpvId intId = ilcSpvPutIntType(&module, true);
@@ -3752,11 +5541,21 @@ IlcShader ilcCompileKernel(
         .bool4Id = ilcSpvPutVectorType(&module, boolId, 4),
         .currentStrideIndex = 0,
         .regCount = 0,
+        .regSize = 0,
         .regs = NULL,
+        .tempIndexSize = 0,
+        .tempIndices = NULL,
+        .regIndex = { 0, 0, NULL },
+        .tempInfoCount = 0,
+        .tempInfos = NULL,
         .resourceCount = 0,
+        .resourceSize = 0,
         .resources = NULL,
+        .resourceIndex = { 0, 0, NULL },
         .samplerCount = 0,
+        .samplerSize = 0,
         .samplers = NULL,
+        .samplerIndex = { 0, 0, NULL },
         .controlFlowBlockCount = 0,
         .controlFlowBlocks = NULL,
         .hsForkPhaseIdCount = 0,
@@ -3764,13 +5563,27 @@ IlcShader ilcCompileKernel(
         .hsJoinPhaseId = 0,
         .isInFunction = false,
         .isAfterReturn = false,
+        .optimize = optimize,
+        .relaxedPrecision = relaxedPrecision,
+        .controlFlowHints = controlFlowHints,
+        .outputMask = 0,
+        .linkedOutputMask = linkedOutputMask,
+        .expandRectangles = expandRectangles && kernel->shaderType == IL_SHADER_VERTEX,
+        .flatOutputMask = flatOutputMask,
+        .rectangleInterfaceCount = 0,
+        .rectangleInterfaceIds = NULL,
     };
 
+    // Rectangle expansion calls the shader from its own entry point
+    IlcSpvId mainFunctionId = compiler.expandRectangles ? ilcSpvAllocId(&module)
+                                                        : compiler.entryPointId;
+
+    analyzeTemps(&compiler);
     emitImplicitInputs(&compiler);
 
 #ifdef TESS
     if (compiler.kernel->shaderType != IL_SHADER_HULL) {
-        emitFunc(&compiler, compiler.entryPointId);
+        emitFunc(&compiler, mainFunctionId);
     }
 
     for (int i = 0; i < kernel->instrCount; i++) {
@@ -3781,7 +5594,7 @@ IlcShader ilcCompileKernel(
         emitHullMainFunction(&compiler);
     }
 #else
-    emitFunc(&compiler, compiler.entryPointId);
+    emitFunc(&compiler, mainFunctionId);
 
     if (compiler.kernel->shaderType == IL_SHADER_HULL ||
         compiler.kernel->shaderType == IL_SHADER_DOMAIN) {
@@ -3795,13 +5608,32 @@ IlcShader ilcCompileKernel(
     }
 #endif
 
+    if (compiler.expandRectangles) {
+        emitRectangleMainFunction(&compiler, mainFunctionId);
+    }
+
+    if (optimize) {
+        promoteRegisters(&compiler);
+        eliminateDeadCode(&compiler);
+
+        if (relaxedPrecision && compiler.kernel->shaderType == IL_SHADER_PIXEL) {
+            relaxColorPrecision(&compiler);
+        }
+    }
+
     emitEntryPoint(&compiler);
 
     free(compiler.regs);
+    free(compiler.tempIndices);
+    free(compiler.regIndex.entries);
+    free(compiler.tempInfos);
     free(compiler.resources);
+    free(compiler.resourceIndex.entries);
     free(compiler.samplers);
+    free(compiler.samplerIndex.entries);
     free(compiler.controlFlowBlocks);
     free(compiler.hsForkPhaseIds);
+    free(compiler.rectangleInterfaceIds);
     ilcSpvFinish(&module);
 
     return (IlcShader) {
@@ -3811,6 +5643,8 @@ IlcShader ilcCompileKernel(
         .bindings = compiler.bindings,
         .inputCount = compiler.inputCount,
         .inputs = compiler.inputs,
+        .outputMask = compiler.outputMask,
+        .isOverridden = false,
         .name = strdup(name),
     };
 }
@@ -7,6 +7,12 @@ typedef struct {
     uint8_t extraCount;
 } OpcodeInfo;
 
+typedef struct {
+    uint8_t* data; // NULL when measuring
+    size_t size;
+    size_t offset;
+} Arena;
+
 static const OpcodeInfo mOpcodeInfos[IL_OP_LAST] = {
     [IL_OP_ABS] = { IL_OP_ABS, 1, 1, 0 },
     [IL_OP_ACOS] = { IL_OP_ACOS, 1, 1, 0 },
@@ -149,6 +155,23 @@ static const OpcodeInfo mOpcodeInfos[IL_OP_LAST] = {
     [IL_UNK_660] = { IL_UNK_660, 1, 0, 0 }, // FIXME undocumented
 };
 
+static void* arenaAlloc(
+    Arena* arena,
+    size_t size)
+{
+    // Keep all allocations 8-byte aligned
+    size_t alignedSize = (size + 7) & ~(size_t)7;
+    void* ptr = NULL;
+
+    if (arena->data != NULL) {
+        assert(arena->offset + alignedSize <= arena->size);
+        ptr = &arena->data[arena->offset];
+    }
+
+    arena->offset += alignedSize;
+    return ptr;
+}
+
 static bool hasIndexedResourceSampler(
     const Instruction* instr)
 {
@@ -166,7 +189,8 @@ static bool hasIndexedResourceSampler(
 
 static unsigned decodeSource(
     Source* src,
-    const Token* token);
+    const Token* token,
+    Arena* arena);
 
 static unsigned getSourceCount(
     const Instruction* instr)
@@ -227,9 +251,47 @@ static unsigned decodeIlVersion(
     return 1;
 }
 
+static unsigned measureOperand(
+    const Token* token,
+    Arena* arena)
+{
+    // Same layout as decodeSource/decodeDestination, but only account for nested sources
+    unsigned idx = 0;
+    bool modifierPresent = GET_BIT(token[idx], 22);
+    uint8_t relativeAddress = GET_BITS(token[idx], 23, 24);
+    bool dimension = GET_BIT(token[idx], 25);
+    bool hasImmediate = GET_BIT(token[idx], 26);
+    unsigned srcCount = 0;
+    idx++;
+
+    if (modifierPresent) {
+        idx++;
+    }
+
+    if (relativeAddress == IL_ADDR_ABSOLUTE) {
+        srcCount = dimension ? 1 : 0;
+    } else if (relativeAddress == IL_ADDR_REG_RELATIVE) {
+        srcCount = dimension ? 2 : 1;
+    }
+
+    if (srcCount > 0) {
+        arenaAlloc(arena, srcCount * sizeof(Source));
+        for (unsigned i = 0; i < srcCount; i++) {
+            idx += measureOperand(&token[idx], arena);
+        }
+    }
+
+    if (hasImmediate) {
+        idx++;
+    }
+
+    return idx;
+}
+
 static unsigned decodeDestination(
     Destination* dst,
-    const Token* token)
+    const Token* token,
+    Arena* arena)
 {
     unsigned idx = 0;
     bool modifierPresent;
@@ -267,8 +329,8 @@ static unsigned decodeDestination(
 
     if (relativeAddress == IL_ADDR_ABSOLUTE) {
         if (dimension) {
-            dst->absoluteSrc = malloc(sizeof(Source));
-            idx += decodeSource(dst->absoluteSrc, &token[idx]);
+            dst->absoluteSrc = arenaAlloc(arena, sizeof(Source));
+            idx += decodeSource(dst->absoluteSrc, &token[idx], arena);
         }
     } else if (relativeAddress == IL_ADDR_RELATIVE) {
         // TODO
@@ -276,9 +338,9 @@ static unsigned decodeDestination(
         assert(!dimension);
     } else if (relativeAddress == IL_ADDR_REG_RELATIVE) {
         dst->relativeSrcCount = dimension ? 2 : 1;
-        dst->relativeSrcs = malloc(dst->relativeSrcCount * sizeof(Source));
+        dst->relativeSrcs = arenaAlloc(arena, dst->relativeSrcCount * sizeof(Source));
         for (unsigned i = 0; i < dst->relativeSrcCount; i++) {
-            idx += decodeSource(&dst->relativeSrcs[i], &token[idx]);
+            idx += decodeSource(&dst->relativeSrcs[i], &token[idx], arena);
         }
     } else {
         assert(false);
@@ -299,7 +361,8 @@ static unsigned decodeDestination(
 
 static unsigned decodeSource(
     Source* src,
-    const Token* token)
+    const Token* token,
+    Arena* arena)
 {
     unsigned idx = 0;
     bool modifierPresent;
@@ -345,8 +408,8 @@ static unsigned decodeSource(
     if (relativeAddress == IL_ADDR_ABSOLUTE) {
         if (dimension) {
             src->srcCount = 1;
-            src->srcs = malloc(sizeof(Source));
-            idx += decodeSource(&src->srcs[0], &token[idx]);
+            src->srcs = arenaAlloc(arena, sizeof(Source));
+            idx += decodeSource(&src->srcs[0], &token[idx], arena);
         }
     } else if (relativeAddress == IL_ADDR_RELATIVE) {
         // TODO
@@ -354,9 +417,9 @@ static unsigned decodeSource(
         assert(!dimension);
     } else if (relativeAddress == IL_ADDR_REG_RELATIVE) {
         src->srcCount = dimension ? 2 : 1;
-        src->srcs = malloc(src->srcCount * sizeof(Source));
+        src->srcs = arenaAlloc(arena, src->srcCount * sizeof(Source));
         for (unsigned i = 0; i < src->srcCount; i++) {
-            idx += decodeSource(&src->srcs[i], &token[idx]);
+            idx += decodeSource(&src->srcs[i], &token[idx], arena);
         }
     } else {
         assert(false);
@@ -378,8 +441,10 @@ static unsigned decodeSource(
 static unsigned decodeInstruction(
     Instruction* instr,
     const Token* token,
-    uint16_t prefixControl)
+    uint16_t prefixControl,
+    Arena* arena)
 {
+    bool measure = arena->data == NULL;
     unsigned idx = 0;
 
     memset(instr, 0, sizeof(*instr));
@@ -390,18 +455,23 @@ static unsigned decodeInstruction(
 
     if (instr->opcode == IL_OP_PREFIX) {
         // Pass prefix info to the next instruction
-        return idx + decodeInstruction(instr, &token[idx], instr->control);
+        return idx + decodeInstruction(instr, &token[idx], instr->control, arena);
     }
 
+    // Only log once, when decoding for real
     if (instr->opcode >= IL_OP_LAST) {
-        LOGE("invalid opcode %d\n", instr->opcode);
+        if (!measure) {
+            LOGE("invalid opcode %d\n", instr->opcode);
+        }
         return idx;
     }
 
     const OpcodeInfo* info = &mOpcodeInfos[instr->opcode];
 
     if (info->opcode != instr->opcode) {
-        LOGW("unhandled opcode %d\n", instr->opcode);
+        if (!measure) {
+            LOGW("unhandled opcode %d\n", instr->opcode);
+        }
         return idx;
     }
 
@@ -430,20 +500,24 @@ static unsigned decodeInstruction(
     }
 
     instr->dstCount = info->dstCount;
-    instr->dsts = malloc(sizeof(Destination) * instr->dstCount);
+    instr->dsts = arenaAlloc(arena, sizeof(Destination) * instr->dstCount);
     for (int i = 0; i < instr->dstCount; i++) {
-        idx += decodeDestination(&instr->dsts[i], &token[idx]);
+        idx += measure ? measureOperand(&token[idx], arena)
+                       : decodeDestination(&instr->dsts[i], &token[idx], arena);
     }
 
     instr->srcCount = getSourceCount(instr);
-    instr->srcs = malloc(sizeof(Source) * instr->srcCount);
+    instr->srcs = arenaAlloc(arena, sizeof(Source) * instr->srcCount);
     for (int i = 0; i < instr->srcCount; i++) {
-        idx += decodeSource(&instr->srcs[i], &token[idx]);
+        idx += measure ? measureOperand(&token[idx], arena)
+                       : decodeSource(&instr->srcs[i], &token[idx], arena);
     }
 
     instr->extraCount = getExtraCount(instr);
-    instr->extras = malloc(sizeof(Token) * instr->extraCount);
-    memcpy(instr->extras, &token[idx], sizeof(Token) * instr->extraCount);
+    instr->extras = arenaAlloc(arena, sizeof(Token) * instr->extraCount);
+    if (!measure) {
+        memcpy(instr->extras, &token[idx], sizeof(Token) * instr->extraCount);
+    }
     idx += instr->extraCount;
 
     instr->preciseMask = GET_BITS(prefixControl, 0, 3);
@@ -455,19 +529,35 @@ Kernel* ilcDecodeStream(
     const Token* tokens,
     unsigned count)
 {
-    Kernel* kernel = malloc(sizeof(Kernel));
+    // Dry run to size the arena holding the whole kernel
+    Arena arena = { NULL, 0, 0 };
+    Instruction instr;
+    unsigned instrCount = 0;
+
+    // Skip the language and version tokens
+    arenaAlloc(&arena, sizeof(Kernel));
+    for (unsigned idx = 2; idx < count; instrCount++) {
+        idx += decodeInstruction(&instr, &tokens[idx], 0, &arena);
+    }
+    arenaAlloc(&arena, sizeof(Instruction) * instrCount);
+
+    arena.size = arena.offset;
+    arena.offset = 0;
+    arena.data = malloc(arena.size);
+
+    // The kernel comes first so that freeing it releases the arena
+    Kernel* kernel = arenaAlloc(&arena, sizeof(Kernel));
     unsigned idx = 0;
 
     idx += decodeIlLang(kernel, &tokens[idx]);
     idx += decodeIlVersion(kernel, &tokens[idx]);
 
-    kernel->instrCount = 0;
-    kernel->instrs = NULL;
-    while (idx < count) {
-        kernel->instrCount++;
-        kernel->instrs = realloc(kernel->instrs, sizeof(Instruction) * kernel->instrCount);
-        idx += decodeInstruction(&kernel->instrs[kernel->instrCount - 1], &tokens[idx], 0);
+    kernel->instrCount = instrCount;
+    kernel->instrs = arenaAlloc(&arena, sizeof(Instruction) * instrCount);
+    for (unsigned i = 0; i < instrCount; i++) {
+        idx += decodeInstruction(&kernel->instrs[i], &tokens[idx], 0, &arena);
     }
 
+    assert(arena.offset == arena.size);
     return kernel;
 }
@@ -0,0 +1,401 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "amdilc_internal.h"
+
+#define QUEUE_SIZE          (64)
+#define FILE_NAME_LEN       (96)
+#define ARCHIVE_MAGIC       (0x44565247) // "GRVD"
+
+typedef struct {
+    char* name;
+    void* ilCode;
+    unsigned ilCodeSize;
+    IlcShader shader;
+} DumpJob;
+
+// Followed by the file contents
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    char fileName[FILE_NAME_LEN];
+} ArchiveRecordHeader;
+
+#ifdef _WIN32
+static SRWLOCK mDumpLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE mDumpCond = CONDITION_VARIABLE_INIT;
+#else
+static pthread_mutex_t mDumpLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mDumpCond = PTHREAD_COND_INITIALIZER;
+#endif
+static bool mWriterStarted = false;
+static bool mWriterFailed = false; // Don't retry starting the writer, write synchronously
+static FILE* mArchiveFile = NULL; // Owned by the writer thread, if it could be started
+static FILE* mTextFile = NULL; // Scratch file for the archived text records
+static DumpJob mJobs[QUEUE_SIZE]; // Ring buffer
+static unsigned mJobIndex = 0;
+static unsigned mJobCount = 0;
+static bool mIsWriting = false;
+
+static void lockDumps()
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mDumpLock);
+#else
+    pthread_mutex_lock(&mDumpLock);
+#endif
+}
+
+static void unlockDumps()
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mDumpLock);
+#else
+    pthread_mutex_unlock(&mDumpLock);
+#endif
+}
+
+// Must be called with the lock held
+static void waitDumps()
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(&mDumpCond, &mDumpLock, INFINITE, 0);
+#else
+    pthread_cond_wait(&mDumpCond, &mDumpLock);
+#endif
+}
+
+static void wakeDumps()
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&mDumpCond);
+#else
+    pthread_cond_broadcast(&mDumpCond);
+#endif
+}
+
+static void writeRecordHeader(
+    const char* fileName,
+    unsigned size)
+{
+    ArchiveRecordHeader header = {
+        .magic = ARCHIVE_MAGIC,
+        .size = size,
+        .fileName = { 0 }, // Initialized below
+    };
+
+    strncpy(header.fileName, fileName, FILE_NAME_LEN - 1);
+    fwrite(&header, 1, sizeof(header), mArchiveFile);
+}
+
+static void writeFile(
+    const char* fileName,
+    const void* data,
+    unsigned size)
+{
+    if (mArchiveFile != NULL) {
+        writeRecordHeader(fileName, size);
+        fwrite(data, 1, size, mArchiveFile);
+        return;
+    }
+
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL) {
+        LOGW("failed to open %s\n", fileName);
+        return;
+    }
+
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+static void writeText(
+    const char* fileName,
+    void (*write)(FILE*, const DumpJob*),
+    const DumpJob* job)
+{
+    if (mArchiveFile != NULL) {
+        // The text size is only known once written, format it in the scratch file first and
+        // append the whole record to the archive
+        rewind(mTextFile);
+        write(mTextFile, job);
+        long size = ftell(mTextFile);
+        void* data = malloc(size);
+
+        rewind(mTextFile);
+        if (fread(data, 1, size, mTextFile) == (size_t)size) {
+            writeFile(fileName, data, size);
+        } else {
+            LOGW("failed to format %s\n", fileName);
+        }
+
+        free(data);
+        return;
+    }
+
+    FILE* file = fopen(fileName, "w");
+    if (file == NULL) {
+        LOGW("failed to open %s\n", fileName);
+        return;
+    }
+
+    write(file, job);
+    fclose(file);
+}
+
+static void writeDisassembly(
+    FILE* file,
+    const DumpJob* job)
+{
+    ilcDisassembleShader(file, job->ilCode, job->ilCodeSize);
+}
+
+static void writeMetadata(
+    FILE* file,
+    const DumpJob* job)
+{
+    ilcWriteShaderMetadata(file, &job->shader);
+}
+
+static void writeJob(
+    const DumpJob* job)
+{
+    char fileName[FILE_NAME_LEN];
+
+    snprintf(fileName, FILE_NAME_LEN, "%s_il.bin", job->name);
+    writeFile(fileName, job->ilCode, job->ilCodeSize);
+    snprintf(fileName, FILE_NAME_LEN, "%s_il.txt", job->name);
+    writeText(fileName, writeDisassembly, job);
+    snprintf(fileName, FILE_NAME_LEN, "%s_spv.bin", job->name);
+    writeFile(fileName, job->shader.code, job->shader.codeSize);
+    // Usable as-is as a GRVK_SHADER_OVERRIDE_PATH sidecar
+    snprintf(fileName, FILE_NAME_LEN, "%s.meta", job->name);
+    writeText(fileName, writeMetadata, job);
+
+    // Keep the archive readable if the process gets killed
+    if (mArchiveFile != NULL) {
+        fflush(mArchiveFile);
+    }
+}
+
+static void freeJob(
+    DumpJob* job)
+{
+    free(job->name);
+    free(job->ilCode);
+    free(job->shader.code);
+    free(job->shader.bindings);
+    free(job->shader.inputs);
+}
+
+static void runWriter()
+{
+    lockDumps();
+
+    for (;;) {
+        while (mJobCount == 0) {
+            waitDumps();
+        }
+
+        DumpJob job = mJobs[mJobIndex];
+        mJobIndex = (mJobIndex + 1) % QUEUE_SIZE;
+        mJobCount--;
+        mIsWriting = true;
+        wakeDumps();
+
+        // Disassemble and write without blocking the compiling threads
+        unlockDumps();
+        writeJob(&job);
+        freeJob(&job);
+        lockDumps();
+
+        mIsWriting = false;
+        wakeDumps();
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writerThread(
+    LPVOID param)
+{
+    runWriter();
+    return 0;
+}
+#else
+static void* writerThread(
+    void* param)
+{
+    runWriter();
+    return NULL;
+}
+#endif
+
+static void closeArchive()
+{
+    if (mArchiveFile != NULL) {
+        fclose(mArchiveFile);
+        mArchiveFile = NULL;
+    }
+
+    if (mTextFile != NULL) {
+        fclose(mTextFile);
+        mTextFile = NULL;
+    }
+}
+
+static bool startWriter()
+{
+    const char* archivePath = getenv("GRVK_SHADER_DUMP_ARCHIVE");
+
+    if (archivePath != NULL && archivePath[0] != '\0') {
+        mArchiveFile = fopen(archivePath, "ab");
+        mTextFile = tmpfile();
+
+        if (mArchiveFile == NULL || mTextFile == NULL) {
+            LOGW("failed to open %s, dumping to separate files\n", archivePath);
+            closeArchive();
+        }
+    }
+
+#ifdef _WIN32
+    HANDLE thread = CreateThread(NULL, 0, writerThread, NULL, 0, NULL);
+    if (thread != NULL) {
+        CloseHandle(thread);
+        return true;
+    }
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writerThread, NULL) == 0) {
+        pthread_detach(thread);
+        return true;
+    }
+#endif
+
+    // The archive stays open, dumps get written synchronously
+    return false;
+}
+
+void ilcQueueShaderDump(
+    const char* name,
+    const void* ilCode,
+    unsigned ilCodeSize,
+    const IlcShader* shader)
+{
+    DumpJob job = {
+        .name = strdup(name),
+        .ilCode = malloc(ilCodeSize),
+        .ilCodeSize = ilCodeSize,
+        .shader = {
+            .codeSize = shader->codeSize,
+            .code = malloc(shader->codeSize),
+            .bindingCount = shader->bindingCount,
+            .bindings = malloc(shader->bindingCount * sizeof(IlcBinding)),
+            .inputCount = shader->inputCount,
+            .inputs = malloc(shader->inputCount * sizeof(IlcInput)),
+            .outputMask = shader->outputMask,
+            .isOverridden = shader->isOverridden,
+            .name = NULL,
+        },
+    };
+
+    memcpy(job.ilCode, ilCode, ilCodeSize);
+    memcpy(job.shader.code, shader->code, shader->codeSize);
+    memcpy(job.shader.bindings, shader->bindings, shader->bindingCount * sizeof(IlcBinding));
+    memcpy(job.shader.inputs, shader->inputs, shader->inputCount * sizeof(IlcInput));
+
+    lockDumps();
+
+    if (!mWriterStarted && !mWriterFailed) {
+        if (startWriter()) {
+            mWriterStarted = true;
+        } else {
+            LOGW("failed to start the shader dump writer\n");
+            mWriterFailed = true;
+        }
+    }
+
+    if (mWriterFailed) {
+        // Write from this thread instead
+        writeJob(&job);
+        unlockDumps();
+        freeJob(&job);
+        return;
+    }
+
+    // Bounded queue, wait for the writer to catch up rather than piling up copies
+    while (mJobCount == QUEUE_SIZE) {
+        waitDumps();
+    }
+
+    mJobs[(mJobIndex + mJobCount) % QUEUE_SIZE] = job;
+    mJobCount++;
+    wakeDumps();
+
+    unlockDumps();
+}
+
+void ilcFlushShaderDumps()
+{
+    lockDumps();
+
+    while (mJobCount > 0 || mIsWriting) {
+        waitDumps();
+    }
+
+    unlockDumps();
+}
+
+bool ilcExtractShaderDumps(
+    const char* path)
+{
+    FILE* archive = fopen(path, "rb");
+    if (archive == NULL) {
+        LOGE("failed to open %s\n", path);
+        return false;
+    }
+
+    ArchiveRecordHeader header;
+    bool isValid = true;
+
+    while (fread(&header, 1, sizeof(header), archive) == sizeof(header)) {
+        if (header.magic != ARCHIVE_MAGIC) {
+            LOGE("invalid record in %s\n", path);
+            isValid = false;
+            break;
+        }
+
+        void* data = malloc(header.size);
+        if (fread(data, 1, header.size, archive) != header.size) {
+            LOGE("truncated record %s in %s\n", header.fileName, path);
+            free(data);
+            isValid = false;
+            break;
+        }
+
+        // Keep the file name within the record and the working directory
+        header.fileName[FILE_NAME_LEN - 1] = '\0';
+        if (strpbrk(header.fileName, "/\\:") != NULL || strstr(header.fileName, "..") != NULL) {
+            LOGE("invalid file name %s in %s\n", header.fileName, path);
+            free(data);
+            isValid = false;
+            continue;
+        }
+
+        FILE* file = fopen(header.fileName, "wb");
+        if (file != NULL) {
+            fwrite(data, 1, header.size, file);
+            fclose(file);
+        } else {
+            LOGE("failed to open %s\n", header.fileName);
+            isValid = false;
+        }
+
+        free(data);
+    }
+
+    fclose(archive);
+    return isValid;
+}
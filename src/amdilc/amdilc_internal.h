@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "amdil/amdil.h"
+#include "amdilc_sha1.h"
+#include "amdilc_spirv.h"
 #include "logger.h"
 #include "amdilc.h"
 
@@ -16,6 +18,9 @@
 #define GET_BIT(dword, bit) \
     (GET_BITS(dword, bit, bit))
 
+#define MIN(a, b) \
+    ((a) < (b) ? (a) : (b))
+
 #define MAX(a, b) \
     ((a) > (b) ? (a) : (b))
 
@@ -82,6 +87,11 @@ typedef struct {
 
 extern const char* mIlShaderTypeNames[IL_SHADER_LAST];
 
+bool ilcIsOptimizationEnabled();
+
+bool ilcIsRelaxedPrecisionEnabled();
+
+// The kernel is a single allocation, release it with free()
 Kernel* ilcDecodeStream(
     const Token* tokens,
     unsigned count);
@@ -90,8 +100,57 @@ void ilcDumpKernel(
     FILE* file,
     const Kernel* kernel);
 
+// relaxedPrecision lets pixel shader color math run at half precision, it needs optimize.
+// debugInfo emits OpSource, OpString and OpName instructions. Generic outputs of vertex, domain
+// and geometry shaders that are outside of linkedOutputMask are compiled out. expandRectangles
+// turns a vertex shader into a RECT_LIST expansion one, see ilcCompileRectangleVertexShader
 IlcShader ilcCompileKernel(
     const Kernel* kernel,
+    const char* name,
+    bool optimize,
+    bool relaxedPrecision,
+    IlcControlFlowHints controlFlowHints,
+    bool debugInfo,
+    uint32_t linkedOutputMask,
+    bool expandRectangles,
+    uint32_t flatOutputMask);
+
+// Finds the right-angle corner of the rectangle spanned by three float4 positions. Returns its
+// index, and the weights that sum the three vertices into the fourth one
+IlcSpvId ilcPutRectangleCorner(
+    IlcSpvModule* module,
+    const IlcSpvId* positions,
+    IlcSpvId* barycentricCoords);
+
+IlcSpvId ilcPutRectangleFourthVertex(
+    IlcSpvModule* module,
+    IlcSpvId resTypeId,
+    const IlcSpvId* barycentricCoords,
+    const IlcSpvId* inputs);
+
+// Copies the IL code and the shader, the IL disassembly and the file writes happen on a
+// background thread. Files go to the working directory, or to GRVK_SHADER_DUMP_ARCHIVE if set
+void ilcQueueShaderDump(
+    const char* name,
+    const void* ilCode,
+    unsigned ilCodeSize,
+    const IlcShader* shader);
+
+// Loads <name>.spv and its <name>.meta bindings and inputs from GRVK_SHADER_OVERRIDE_PATH
+bool ilcOverrideLoad(
+    IlcShader* shader,
     const char* name);
 
+void ilcWriteShaderMetadata(
+    FILE* file,
+    const IlcShader* shader);
+
+bool ilcCacheLoad(
+    IlcShader* shader,
+    const uint8_t* hash);
+
+void ilcCacheStore(
+    const IlcShader* shader,
+    const uint8_t* hash);
+
 #endif // AMDILC_INTERNAL_H_
@@ -0,0 +1,259 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <pthread.h>
+#endif
+#include "amdilc_internal.h"
+
+#define PATH_LEN            (512)
+#define SPIRV_MAGIC         (0x07230203)
+#define CODE_EXTENSION      ".spv"
+#define METADATA_EXTENSION  ".meta"
+
+#ifdef _WIN32
+static SRWLOCK mOverrideLock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t mOverrideLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static bool mOverrideInitialized = false;
+static const char* mOverridePath = NULL;
+static unsigned mOverrideNameCount = 0;
+static char** mOverrideNames = NULL; // Sorted, without the extension
+
+static void lockOverrides()
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mOverrideLock);
+#else
+    pthread_mutex_lock(&mOverrideLock);
+#endif
+}
+
+static void unlockOverrides()
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mOverrideLock);
+#else
+    pthread_mutex_unlock(&mOverrideLock);
+#endif
+}
+
+static int compareNames(
+    const void* a,
+    const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void addOverrideName(
+    const char* fileName)
+{
+    size_t len = strlen(fileName);
+    size_t extensionLen = strlen(CODE_EXTENSION);
+
+    if (len <= extensionLen || strcmp(&fileName[len - extensionLen], CODE_EXTENSION) != 0) {
+        return;
+    }
+
+    mOverrideNameCount++;
+    mOverrideNames = realloc(mOverrideNames, mOverrideNameCount * sizeof(char*));
+    mOverrideNames[mOverrideNameCount - 1] = malloc(len - extensionLen + 1);
+    memcpy(mOverrideNames[mOverrideNameCount - 1], fileName, len - extensionLen);
+    mOverrideNames[mOverrideNameCount - 1][len - extensionLen] = '\0';
+}
+
+static void initOverrides()
+{
+    mOverridePath = getenv("GRVK_SHADER_OVERRIDE_PATH");
+
+    if (mOverridePath == NULL || strlen(mOverridePath) == 0) {
+        mOverridePath = NULL;
+        return;
+    }
+
+    // List the directory once, so that shaders without an override don't touch the file system
+#ifdef _WIN32
+    char pattern[PATH_LEN];
+    WIN32_FIND_DATAA findData;
+
+    snprintf(pattern, sizeof(pattern), "%s\\*" CODE_EXTENSION, mOverridePath);
+    HANDLE find = FindFirstFileA(pattern, &findData);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                addOverrideName(findData.cFileName);
+            }
+        } while (FindNextFileA(find, &findData));
+
+        FindClose(find);
+    }
+#else
+    DIR* dir = opendir(mOverridePath);
+    if (dir != NULL) {
+        struct dirent* entry;
+
+        while ((entry = readdir(dir)) != NULL) {
+            addOverrideName(entry->d_name);
+        }
+
+        closedir(dir);
+    }
+#endif
+
+    qsort(mOverrideNames, mOverrideNameCount, sizeof(char*), compareNames);
+    LOGI("found %u shader overrides in %s\n", mOverrideNameCount, mOverridePath);
+}
+
+static void* readFile(
+    const char* fileName,
+    unsigned* size)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* data = malloc(fileSize > 0 ? fileSize : 1);
+    if (fileSize <= 0 || fread(data, 1, fileSize, file) != fileSize) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = fileSize;
+    return data;
+}
+
+static bool readMetadata(
+    IlcShader* shader,
+    const char* fileName)
+{
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char key[16];
+    bool isValid = true;
+
+    while (isValid && fscanf(file, "%15s", key) == 1) {
+        if (strcmp(key, "outputMask") == 0) {
+            isValid = fscanf(file, "%x", &shader->outputMask) == 1;
+        } else if (strcmp(key, "binding") == 0) {
+            unsigned type;
+            unsigned descriptorType;
+            IlcBinding binding;
+
+            isValid = fscanf(file, "%u %u %u %u %d", &type, &binding.ilIndex, &binding.vkIndex,
+                             &descriptorType, &binding.strideIndex) == 5;
+            binding.type = type;
+            binding.descriptorType = descriptorType;
+
+            shader->bindingCount++;
+            shader->bindings = realloc(shader->bindings,
+                                       shader->bindingCount * sizeof(IlcBinding));
+            shader->bindings[shader->bindingCount - 1] = binding;
+        } else if (strcmp(key, "input") == 0) {
+            unsigned locationIndex;
+            unsigned interpMode;
+
+            isValid = fscanf(file, "%u %u", &locationIndex, &interpMode) == 2;
+
+            shader->inputCount++;
+            shader->inputs = realloc(shader->inputs, shader->inputCount * sizeof(IlcInput));
+            shader->inputs[shader->inputCount - 1] = (IlcInput) {
+                .locationIndex = locationIndex,
+                .interpMode = interpMode,
+            };
+        } else {
+            isValid = false;
+        }
+    }
+
+    fclose(file);
+    return isValid;
+}
+
+bool ilcOverrideLoad(
+    IlcShader* shader,
+    const char* name)
+{
+    lockOverrides();
+
+    if (!mOverrideInitialized) {
+        initOverrides();
+        mOverrideInitialized = true;
+    }
+
+    bool hasOverride = mOverrideNameCount > 0 &&
+                       bsearch(&name, mOverrideNames, mOverrideNameCount, sizeof(char*),
+                               compareNames) != NULL;
+
+    unlockOverrides();
+
+    if (!hasOverride) {
+        return false;
+    }
+
+    char fileName[PATH_LEN];
+    *shader = (IlcShader) {
+        .codeSize = 0,
+        .code = NULL,
+        .bindingCount = 0,
+        .bindings = NULL,
+        .inputCount = 0,
+        .inputs = NULL,
+        .outputMask = 0,
+        .isOverridden = true,
+        .name = NULL,
+    };
+
+    snprintf(fileName, sizeof(fileName), "%s/%s" CODE_EXTENSION, mOverridePath, name);
+    shader->code = readFile(fileName, &shader->codeSize);
+    if (shader->code == NULL || shader->codeSize % sizeof(uint32_t) != 0 ||
+        shader->code[0] != SPIRV_MAGIC) {
+        LOGW("invalid SPIR-V override %s, compiling instead\n", fileName);
+        goto bail;
+    }
+
+    snprintf(fileName, sizeof(fileName), "%s/%s" METADATA_EXTENSION, mOverridePath, name);
+    if (!readMetadata(shader, fileName)) {
+        LOGW("missing or invalid override metadata %s, compiling instead\n", fileName);
+        goto bail;
+    }
+
+    return true;
+
+bail:
+    free(shader->code);
+    free(shader->bindings);
+    free(shader->inputs);
+    return false;
+}
+
+void ilcWriteShaderMetadata(
+    FILE* file,
+    const IlcShader* shader)
+{
+    fprintf(file, "outputMask %08X\n", shader->outputMask);
+
+    for (unsigned i = 0; i < shader->bindingCount; i++) {
+        const IlcBinding* binding = &shader->bindings[i];
+
+        fprintf(file, "binding %u %u %u %u %d\n", binding->type, binding->ilIndex,
+                binding->vkIndex, binding->descriptorType, binding->strideIndex);
+    }
+
+    for (unsigned i = 0; i < shader->inputCount; i++) {
+        const IlcInput* input = &shader->inputs[i];
+
+        fprintf(file, "input %u %u\n", input->locationIndex, input->interpMode);
+    }
+}
@@ -6,7 +6,7 @@
 #define ONE_LITERAL         (0x3F800000)
 #define MINUS_ONE_LITERAL   (0xBF800000)
 
-static IlcSpvId interpolateToLastPoint(
+IlcSpvId ilcPutRectangleFourthVertex(
     IlcSpvModule* module,
     IlcSpvId resTypeId,
     const IlcSpvId* barycentricCoords,
@@ -22,6 +22,53 @@ static IlcSpvId interpolateToLastPoint(
     return ilcSpvPutOp2(module, SpvOpFAdd, resTypeId, resId, termIds[2]);
 }
 
+IlcSpvId ilcPutRectangleCorner(
+    IlcSpvModule* module,
+    const IlcSpvId* positions,
+    IlcSpvId* barycentricCoords)
+{
+    IlcSpvId uintTypeId = ilcSpvPutIntType(module, false);
+    IlcSpvId floatId = ilcSpvPutFloatType(module);
+    IlcSpvId boolTypeId = ilcSpvPutBoolType(module);
+
+    IlcSpvId positionsX[3];
+    IlcSpvId positionsY[3];
+    for (unsigned i = 0; i < 3; i++) {
+        unsigned xIndex = 0;
+        unsigned yIndex = 1;
+        positionsX[i] = ilcSpvPutCompositeExtract(module, floatId, positions[i], 1, &xIndex);
+        positionsY[i] = ilcSpvPutCompositeExtract(module, floatId, positions[i], 1, &yIndex);
+    }
+    IlcSpvId pointCoordEqualX[3];
+    IlcSpvId pointCoordEqualY[3];
+    IlcSpvId isEdgeVertex[3];
+    IlcSpvId fOneId = ilcSpvPutConstant(module, floatId, ONE_LITERAL);
+    IlcSpvId fMinusOneId = ilcSpvPutConstant(module, floatId, MINUS_ONE_LITERAL);
+    for (unsigned i = 0; i < 3; i++) {
+        pointCoordEqualX[i] = ilcSpvPutOp2(module, SpvOpFOrdEqual, boolTypeId,
+                                           positionsX[i], positionsX[(i + 1) % 3]);
+        pointCoordEqualY[i] = ilcSpvPutOp2(module, SpvOpFOrdEqual, boolTypeId,
+                                           positionsY[i], positionsY[(i + 1) % 3]);
+    }
+    for (unsigned i = 0; i < 3; i++) {
+        IlcSpvId xyEqual = ilcSpvPutOp2(module, SpvOpLogicalAnd, boolTypeId,
+                                        pointCoordEqualX[i], pointCoordEqualY[(i + 2) % 3]);
+        IlcSpvId yxEqual = ilcSpvPutOp2(module, SpvOpLogicalAnd, boolTypeId,
+                                        pointCoordEqualY[i], pointCoordEqualX[(i + 2) % 3]);
+        isEdgeVertex[i] = ilcSpvPutOp2(module, SpvOpLogicalOr, boolTypeId, xyEqual, yxEqual);
+        barycentricCoords[i] = ilcSpvPutSelect(module, floatId, isEdgeVertex[i],
+                                               fMinusOneId, fOneId);
+    }
+    // good now gotta select first vertex index dynamically (bs)
+    IlcSpvId vertexIndexId = ilcSpvPutSelect(module, uintTypeId,
+                                             isEdgeVertex[1],
+                                             ilcSpvPutConstant(module, uintTypeId, 1),
+                                             ilcSpvPutConstant(module, uintTypeId, 0));
+    return ilcSpvPutSelect(module, uintTypeId,
+                           isEdgeVertex[2],
+                           ilcSpvPutConstant(module, uintTypeId, 2), vertexIndexId);
+}
+
 static IlcSpvId createEndPrimitiveFunction(
     IlcSpvModule* module,
     IlcSpvId vertexCounterVarId,
@@ -60,39 +107,10 @@ static IlcSpvId createEndPrimitiveFunction(
         positionElements[i] = ilcSpvPutAccessChain(module, float4PtrId, outputPositionBufferVarId, 1, &counterIds[i]);
         positionElements[i] = ilcSpvPutLoad(module, float4Id, positionElements[i]);
     }
-    IlcSpvId positionsX[3];
-    IlcSpvId positionsY[3];
-    for (unsigned i = 0; i < 3; i++) {
-        unsigned xIndex = 0;
-        unsigned yIndex = 1;
-        positionsX[i] = ilcSpvPutCompositeExtract(module, floatId, positionElements[i], 1, &xIndex);
-        positionsY[i] = ilcSpvPutCompositeExtract(module, floatId, positionElements[i], 1, &yIndex);
-    }
-    IlcSpvId pointCoordEqualX[3];
-    IlcSpvId pointCoordEqualY[3];
-    IlcSpvId isEdgeVertex[3];
     IlcSpvId barycentricCoords[3];
-    IlcSpvId boolTypeId = ilcSpvPutBoolType(module);
-    IlcSpvId fOneId = ilcSpvPutConstant(module, floatId, ONE_LITERAL);
-    IlcSpvId fMinusOneId = ilcSpvPutConstant(module, floatId, MINUS_ONE_LITERAL);
-    for (unsigned i = 0; i < 3; i++) {
-        pointCoordEqualX[i] = ilcSpvPutOp2(module, SpvOpFOrdEqual, boolTypeId, positionsX[i], positionsX[(i + 1) % 3]);
-        pointCoordEqualY[i] = ilcSpvPutOp2(module, SpvOpFOrdEqual, boolTypeId, positionsY[i], positionsY[(i + 1) % 3]);
-    }
-    for (unsigned i = 0; i < 3; i++) {
-        IlcSpvId xyEqual = ilcSpvPutOp2(module, SpvOpLogicalAnd, boolTypeId, pointCoordEqualX[i], pointCoordEqualY[(i + 2) % 3]);
-        IlcSpvId yxEqual = ilcSpvPutOp2(module, SpvOpLogicalAnd, boolTypeId, pointCoordEqualY[i], pointCoordEqualX[(i + 2) % 3]);
-        isEdgeVertex[i] = ilcSpvPutOp2(module, SpvOpLogicalOr, boolTypeId, xyEqual, yxEqual);
-        barycentricCoords[i] = ilcSpvPutSelect(module, floatId, isEdgeVertex[i], fMinusOneId, fOneId);
-    }
-    positionElements[3] = interpolateToLastPoint(module, float4Id, barycentricCoords, positionElements);
-    // good now gotta select first vertex index dynamically (bs)
-    IlcSpvId vertexIndexId = ilcSpvPutSelect(module, uintTypeId,
-                                             isEdgeVertex[1],
-                                             counterIds[1], counterIds[0]);
-    vertexIndexId = ilcSpvPutSelect(module, uintTypeId,
-                                    isEdgeVertex[2],
-                                    counterIds[2], vertexIndexId);
+    IlcSpvId vertexIndexId = ilcPutRectangleCorner(module, positionElements, barycentricCoords);
+    positionElements[3] = ilcPutRectangleFourthVertex(module, float4Id, barycentricCoords,
+                                                      positionElements);
     // idk about the order of vertices
     for (unsigned i = 0; i < 3; i++) {
         IlcSpvId posPtrId = ilcSpvPutAccessChain(module, float4PtrId, outputPositionBufferVarId, 1, &vertexIndexId);
@@ -124,7 +142,7 @@ static IlcSpvId createEndPrimitiveFunction(
             for (unsigned j = 0; j < 3; j++) {
                 outputs[j] = ilcSpvPutLoad(module, float4Id, outputs[j]);
             }
-            valueId = interpolateToLastPoint(module, float4Id, barycentricCoords, outputs);
+            valueId = ilcPutRectangleFourthVertex(module, float4Id, barycentricCoords, outputs);
         }
         ilcSpvPutStore(module, outputIds[i], valueId);
     }
@@ -215,6 +233,8 @@ IlcShader ilcCompileRectangleGeometryShader(
         .bindings = NULL,
         .inputCount = 0,
         .inputs = NULL,
+        .outputMask = 0,
+        .isOverridden = false,
         .name = NULL,
     };
  }
@@ -0,0 +1,109 @@
+#include <string.h>
+#include "amdilc_sha1.h"
+
+// FIPS 180-4 SHA-1
+
+#define BLOCK_SIZE  (64)
+
+#define ROTL(x, n) \
+    (((x) << (n)) | ((x) >> (32 - (n))))
+
+static uint32_t loadBigEndian(
+    const uint8_t* bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+           ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static void storeBigEndian(
+    uint8_t* bytes,
+    uint32_t value)
+{
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+#define ROUND(f, k, i) \
+    do { \
+        if ((i) >= 16) { \
+            w[(i) % 16] = ROTL(w[((i) - 3) % 16] ^ w[((i) - 8) % 16] ^ \
+                               w[((i) - 14) % 16] ^ w[(i) % 16], 1); \
+        } \
+        uint32_t temp = ROTL(a, 5) + (f) + e + (k) + w[(i) % 16]; \
+        e = d; \
+        d = c; \
+        c = ROTL(b, 30); \
+        b = a; \
+        a = temp; \
+    } while (0)
+
+static void processBlock(
+    uint32_t* state,
+    const uint8_t* block)
+{
+    uint32_t w[16];
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (unsigned i = 0; i < 16; i++) {
+        w[i] = loadBigEndian(&block[4 * i]);
+    }
+
+    // Branch-free round groups, the message schedule is kept in a 16-word ring buffer
+    for (unsigned i = 0; i < 20; i++) {
+        ROUND(d ^ (b & (c ^ d)), 0x5A827999, i);
+    }
+    for (unsigned i = 20; i < 40; i++) {
+        ROUND(b ^ c ^ d, 0x6ED9EBA1, i);
+    }
+    for (unsigned i = 40; i < 60; i++) {
+        ROUND((b & c) | (d & (b | c)), 0x8F1BBCDC, i);
+    }
+    for (unsigned i = 60; i < 80; i++) {
+        ROUND(b ^ c ^ d, 0xCA62C1D6, i);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void ilcSha1(
+    uint8_t* digest,
+    const void* data,
+    unsigned size)
+{
+    const uint8_t* bytes = data;
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t block[2 * BLOCK_SIZE] = { 0 };
+    unsigned offset = 0;
+
+    for (; offset + BLOCK_SIZE <= size; offset += BLOCK_SIZE) {
+        processBlock(state, &bytes[offset]);
+    }
+
+    // Pad the tail with 0x80, zeroes and the message length in bits
+    unsigned tailSize = size - offset;
+    unsigned blockCount = tailSize + 1 + 8 <= BLOCK_SIZE ? 1 : 2;
+    uint64_t bitCount = (uint64_t)size * 8;
+
+    memcpy(block, &bytes[offset], tailSize);
+    block[tailSize] = 0x80;
+    storeBigEndian(&block[blockCount * BLOCK_SIZE - 8], bitCount >> 32);
+    storeBigEndian(&block[blockCount * BLOCK_SIZE - 4], bitCount);
+
+    for (unsigned i = 0; i < blockCount; i++) {
+        processBlock(state, &block[i * BLOCK_SIZE]);
+    }
+
+    for (unsigned i = 0; i < 5; i++) {
+        storeBigEndian(&digest[4 * i], state[i]);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef AMDILC_SHA1_H_
+#define AMDILC_SHA1_H_
+
+#include <stdint.h>
+
+#define SHA1_SIZE   (20)
+
+// Reentrant, no global state
+void ilcSha1(
+    uint8_t* digest,
+    const void* data,
+    unsigned size);
+
+#endif // AMDILC_SHA1_H_
@@ -79,6 +79,336 @@ static void putHeader(
     putWord(buffer, 0);
 }
 
+static uint32_t hashInstr(
+    IlcSpvBufferId bufferId,
+    SpvOp op,
+    IlcSpvId resultTypeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    IlcSpvWord key[] = { bufferId, op, resultTypeId, argCount };
+
+    for (unsigned i = 0; i < sizeof(key) / sizeof(key[0]); i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    for (unsigned i = 0; i < argCount; i++) {
+        hash = (hash ^ args[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool matchInstr(
+    const IlcSpvModule* module,
+    const IlcSpvIndexEntry* entry,
+    IlcSpvBufferId bufferId,
+    SpvOp op,
+    IlcSpvId resultTypeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    if (entry->bufferId != bufferId) {
+        return false;
+    }
+
+    // Constants have a result type before the result ID, types have none
+    const IlcSpvWord* words = &module->buffer[bufferId].words[entry->wordIndex];
+    bool hasResultType = resultTypeId != 0;
+    unsigned argOffset = hasResultType ? 3 : 2;
+
+    if (words[0] != (op | ((argOffset + argCount) << SpvWordCountShift)) ||
+        (hasResultType && words[1] != resultTypeId)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < argCount; i++) {
+        if (words[argOffset + i] != args[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static IlcSpvIndexEntry* findIndexEntry(
+    const IlcSpvModule* module,
+    uint32_t hash,
+    IlcSpvBufferId bufferId,
+    SpvOp op,
+    IlcSpvId resultTypeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    const IlcSpvIndex* index = &module->typeIndex;
+
+    if (index->entrySize == 0) {
+        return NULL;
+    }
+
+    // Linear probing, the table is never full
+    unsigned mask = index->entrySize - 1;
+    for (unsigned i = hash & mask;; i = (i + 1) & mask) {
+        IlcSpvIndexEntry* entry = &index->entries[i];
+
+        if (entry->id == 0 ||
+            (entry->hash == hash &&
+             matchInstr(module, entry, bufferId, op, resultTypeId, argCount, args))) {
+            return entry;
+        }
+    }
+}
+
+static void growIndex(
+    IlcSpvIndex* index)
+{
+    unsigned oldEntrySize = index->entrySize;
+    IlcSpvIndexEntry* oldEntries = index->entries;
+
+    index->entrySize = oldEntrySize == 0 ? 256 : 2 * oldEntrySize;
+    index->entries = calloc(index->entrySize, sizeof(IlcSpvIndexEntry));
+
+    // Rehash existing entries
+    unsigned mask = index->entrySize - 1;
+    for (unsigned i = 0; i < oldEntrySize; i++) {
+        const IlcSpvIndexEntry* oldEntry = &oldEntries[i];
+
+        if (oldEntry->id != 0) {
+            unsigned j = oldEntry->hash & mask;
+            while (index->entries[j].id != 0) {
+                j = (j + 1) & mask;
+            }
+            index->entries[j] = *oldEntry;
+        }
+    }
+
+    free(oldEntries);
+}
+
+static void addIndexEntry(
+    IlcSpvModule* module,
+    uint32_t hash,
+    IlcSpvBufferId bufferId,
+    unsigned wordIndex,
+    IlcSpvId id)
+{
+    IlcSpvIndex* index = &module->typeIndex;
+
+    // Keep the load factor under 1/2
+    if (2 * (index->entryCount + 1) > index->entrySize) {
+        growIndex(index);
+    }
+
+    unsigned mask = index->entrySize - 1;
+    unsigned i = hash & mask;
+    while (index->entries[i].id != 0) {
+        i = (i + 1) & mask;
+    }
+
+    index->entries[i] = (IlcSpvIndexEntry) {
+        .hash = hash,
+        .bufferId = bufferId,
+        .wordIndex = wordIndex,
+        .id = id,
+    };
+    index->entryCount++;
+}
+
+static void setValue(
+    IlcSpvModule* module,
+    IlcSpvId id,
+    SpvOp op,
+    IlcSpvId typeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    if (id >= module->valueCount) {
+        unsigned valueCount = MAX(2 * module->valueCount, id + 1);
+
+        module->values = realloc(module->values, valueCount * sizeof(IlcSpvValue));
+        memset(&module->values[module->valueCount], 0,
+               (valueCount - module->valueCount) * sizeof(IlcSpvValue));
+        module->valueCount = valueCount;
+    }
+
+    if (argCount > MAX_VALUE_ARG_COUNT) {
+        // Too long to be folded, only keep the type
+        op = SpvOpNop;
+        argCount = 0;
+    }
+
+    IlcSpvValue* value = &module->values[id];
+    value->op = op;
+    value->typeId = typeId;
+    value->argCount = argCount;
+    if (argCount > 0) {
+        memcpy(value->args, args, argCount * sizeof(IlcSpvWord));
+    }
+}
+
+static const IlcSpvValue* getValue(
+    const IlcSpvModule* module,
+    IlcSpvId id)
+{
+    static const IlcSpvValue unknownValue = { SpvOpNop, 0, 0, { 0 } };
+
+    return id < module->valueCount ? &module->values[id] : &unknownValue;
+}
+
+static IlcSpvId getPointerVariable(
+    const IlcSpvModule* module,
+    IlcSpvId pointerId)
+{
+    const IlcSpvValue* value = getValue(module, pointerId);
+
+    while (value->op == SpvOpAccessChain) {
+        pointerId = value->args[0];
+        value = getValue(module, pointerId);
+    }
+
+    return value->op == SpvOpVariable ? pointerId : 0;
+}
+
+static bool isReadOnlyVariable(
+    const IlcSpvModule* module,
+    IlcSpvId variableId)
+{
+    switch (getValue(module, variableId)->args[0]) {
+    case SpvStorageClassUniformConstant:
+    case SpvStorageClassInput:
+    case SpvStorageClassUniform:
+    case SpvStorageClassPushConstant:
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+static bool isPrivateVariable(
+    const IlcSpvModule* module,
+    IlcSpvId variableId)
+{
+    SpvStorageClass storageClass = getValue(module, variableId)->args[0];
+
+    return storageClass == SpvStorageClassFunction || storageClass == SpvStorageClassPrivate;
+}
+
+static void writeMemory(
+    IlcSpvModule* module,
+    IlcSpvId pointerId)
+{
+    // A pointer ID of 0 stands for any memory but private variables
+    IlcSpvId variableId = pointerId != 0 ? getPointerVariable(module, pointerId) : 0;
+
+    module->memoryIndex++;
+    if (variableId != 0 && isPrivateVariable(module, variableId)) {
+        module->values[variableId].memoryIndex = module->memoryIndex;
+    } else {
+        module->sharedMemoryIndex = module->memoryIndex;
+        if (pointerId != 0 && variableId == 0) {
+            module->privateMemoryIndex = module->memoryIndex;
+        }
+    }
+}
+
+static bool getLoadDependency(
+    const IlcSpvModule* module,
+    IlcSpvId pointerId,
+    unsigned* memoryIndex,
+    IlcSpvId* variableId)
+{
+    IlcSpvId pointerVariableId = getPointerVariable(module, pointerId);
+
+    // Loads through unknown pointers can't be tracked
+    if (pointerVariableId == 0) {
+        return false;
+    }
+
+    if (isReadOnlyVariable(module, pointerVariableId)) {
+        *memoryIndex = 0;
+        *variableId = 0;
+    } else if (isPrivateVariable(module, pointerVariableId)) {
+        *memoryIndex = module->memoryIndex;
+        *variableId = pointerVariableId;
+    } else {
+        *memoryIndex = module->memoryIndex;
+        *variableId = 0;
+    }
+    return true;
+}
+
+static bool isLiveValueEntry(
+    const IlcSpvModule* module,
+    const IlcSpvValueEntry* entry)
+{
+    if (entry->blockIndex != module->blockIndex) {
+        return false;
+    } else if (entry->memoryIndex == 0) {
+        return true;
+    } else if (entry->variableId != 0) {
+        return entry->memoryIndex >= getValue(module, entry->variableId)->memoryIndex &&
+               entry->memoryIndex >= module->privateMemoryIndex;
+    }
+    return entry->memoryIndex >= module->sharedMemoryIndex;
+}
+
+static IlcSpvId findValue(
+    const IlcSpvModule* module,
+    uint32_t hash,
+    SpvOp op,
+    IlcSpvId resultTypeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    if (module->valueCache == NULL) {
+        return 0;
+    }
+
+    const IlcSpvValueEntry* entry = &module->valueCache[hash % VALUE_CACHE_SIZE];
+    if (entry->id == 0 || entry->hash != hash || !isLiveValueEntry(module, entry)) {
+        return 0;
+    }
+
+    const IlcSpvValue* value = getValue(module, entry->id);
+    if (entry->pointerId != 0) {
+        // Forwarded store
+        if (op == SpvOpLoad && value->typeId == resultTypeId && args[0] == entry->pointerId) {
+            return entry->id;
+        }
+    } else if (value->op == op && value->typeId == resultTypeId && value->argCount == argCount &&
+               memcmp(value->args, args, argCount * sizeof(IlcSpvWord)) == 0) {
+        return entry->id;
+    }
+
+    return 0;
+}
+
+static void addValue(
+    IlcSpvModule* module,
+    uint32_t hash,
+    unsigned memoryIndex,
+    IlcSpvId variableId,
+    IlcSpvId id,
+    IlcSpvId pointerId)
+{
+    if (module->valueCache == NULL) {
+        module->valueCache = calloc(VALUE_CACHE_SIZE, sizeof(IlcSpvValueEntry));
+    }
+
+    // Direct-mapped, a colliding value evicts the previous one
+    module->valueCache[hash % VALUE_CACHE_SIZE] = (IlcSpvValueEntry) {
+        .hash = hash,
+        .blockIndex = module->blockIndex,
+        .memoryIndex = memoryIndex,
+        .variableId = variableId,
+        .id = id,
+        .pointerId = pointerId,
+    };
+}
+
 static IlcSpvId putType(
     IlcSpvModule* module,
     SpvOp op,
@@ -87,44 +417,31 @@ static IlcSpvId putType(
     bool hasConstants,
     bool unique)
 {
-    IlcSpvBuffer* buffer = &module->buffer[hasConstants ? ID_TYPES_WITH_CONSTANTS : ID_TYPES];
-
-    if (!unique) {
-        // Check if the type is already present
-        for (int i = 0; i < buffer->wordCount;) {
-            SpvOp typeOp = buffer->words[i] & SpvOpCodeMask;
-            unsigned typeWordCount = buffer->words[i] >> SpvWordCountShift;
-            unsigned typeArgCount = typeWordCount - 2;
-
-            // Got a potential match
-            if (op == typeOp && argCount == typeArgCount) {
-                bool match = true;
-                IlcSpvId typeId = buffer->words[i + 1];
-
-                // Check that the args also match
-                for (unsigned j = 0; j < typeArgCount; j++) {
-                    if (args[j] != buffer->words[i + 2 + j]) {
-                        match = false;
-                        break;
-                    }
-                }
-
-                if (match) {
-                    return typeId;
-                }
-            }
+    IlcSpvBufferId bufferId = hasConstants ? ID_TYPES_WITH_CONSTANTS : ID_TYPES;
+    IlcSpvBuffer* buffer = &module->buffer[bufferId];
+    uint32_t hash = hashInstr(bufferId, op, 0, argCount, args);
 
-            i += typeWordCount;
-        }
+    // Check if the type is already present
+    const IlcSpvIndexEntry* entry = findIndexEntry(module, hash, bufferId, op, 0, argCount, args);
+    bool isIndexed = entry != NULL && entry->id != 0;
+
+    if (!unique && isIndexed) {
+        return entry->id;
     }
 
     IlcSpvId id = ilcSpvAllocId(module);
+    unsigned wordIndex = buffer->wordCount;
     putInstr(buffer, op, 2 + argCount);
     putWord(buffer, id);
     for (int i = 0; i < argCount; i++) {
         putWord(buffer, args[i]);
     }
 
+    if (!isIndexed) {
+        addIndexEntry(module, hash, bufferId, wordIndex, id);
+    }
+
+    setValue(module, id, op, 0, argCount, args);
     return id;
 }
 
@@ -135,36 +452,447 @@ static IlcSpvId putConstant(
     unsigned argCount,
     const IlcSpvWord* args)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CONSTANTS];
+    // Array constants depend on the array type, which itself depends on the length constant
+    IlcSpvBufferId bufferId = getValue(module, resultTypeId)->op == SpvOpTypeArray ?
+                              ID_TYPES_WITH_CONSTANTS : ID_CONSTANTS;
+    IlcSpvBuffer* buffer = &module->buffer[bufferId];
+    uint32_t hash = hashInstr(bufferId, op, resultTypeId, argCount, args);
 
     // Check if the constant is already present
-    for (int i = 0; i < buffer->wordCount;) {
-        SpvOp constantOp = buffer->words[i] & SpvOpCodeMask;
-        unsigned constantWordCount = buffer->words[i] >> SpvWordCountShift;
-        unsigned constantArgCount = constantWordCount - 3;
-        IlcSpvId constantResultTypeId = buffer->words[i + 1];
-
-        // Got a potential match
-        if (op == constantOp &&
-            resultTypeId == constantResultTypeId &&
-            argCount == constantArgCount) {
-            bool match = true;
-            IlcSpvId constantId = buffer->words[i + 2];
-
-            // Check that the args also match
-            for (unsigned j = 0; j < constantArgCount; j++) {
-                if (args[j] != buffer->words[i + 3 + j]) {
-                    match = false;
-                    break;
-                }
+    const IlcSpvIndexEntry* entry = findIndexEntry(module, hash, bufferId, op, resultTypeId,
+                                                   argCount, args);
+    if (entry != NULL && entry->id != 0) {
+        return entry->id;
+    }
+
+    IlcSpvId id = ilcSpvAllocId(module);
+    unsigned wordIndex = buffer->wordCount;
+    putInstr(buffer, op, 3 + argCount);
+    putWord(buffer, resultTypeId);
+    putWord(buffer, id);
+    for (int i = 0; i < argCount; i++) {
+        putWord(buffer, args[i]);
+    }
+
+    addIndexEntry(module, hash, bufferId, wordIndex, id);
+
+    setValue(module, id, op, resultTypeId, argCount, args);
+    return id;
+}
+
+static unsigned getComponentCount(
+    const IlcSpvModule* module,
+    IlcSpvId typeId)
+{
+    const IlcSpvValue* type = getValue(module, typeId);
+
+    if (type->op == SpvOpTypeVector) {
+        return type->args[1];
+    } else if (type->op == SpvOpTypeInt || type->op == SpvOpTypeFloat) {
+        return 1;
+    }
+    return 0;
+}
+
+static IlcSpvId getComponentTypeId(
+    const IlcSpvModule* module,
+    IlcSpvId typeId)
+{
+    const IlcSpvValue* type = getValue(module, typeId);
+
+    return type->op == SpvOpTypeVector ? type->args[0] : typeId;
+}
+
+static IlcSpvId getConstantComponent(
+    const IlcSpvModule* module,
+    IlcSpvId id,
+    unsigned index)
+{
+    const IlcSpvValue* value = getValue(module, id);
+
+    if (value->op == SpvOpConstantComposite && index < value->argCount &&
+        getValue(module, value->args[index])->op == SpvOpConstant) {
+        return value->args[index];
+    } else if (value->op == SpvOpConstant && index == 0) {
+        return id;
+    }
+    return 0;
+}
+
+static bool resolveComponent(
+    const IlcSpvModule* module,
+    IlcSpvId vec1Id,
+    IlcSpvId vec2Id,
+    IlcSpvWord component,
+    IlcSpvId* id,
+    unsigned* index)
+{
+    // Follow shuffles back to the vector the component comes from
+    for (;;) {
+        unsigned vec1ComponentCount = getComponentCount(module, getValue(module, vec1Id)->typeId);
+
+        if (vec1ComponentCount == 0 || component == 0xFFFFFFFF) {
+            return false;
+        }
+
+        *id = component < vec1ComponentCount ? vec1Id : vec2Id;
+        *index = component < vec1ComponentCount ? component : component - vec1ComponentCount;
+
+        const IlcSpvValue* value = getValue(module, *id);
+        if (value->op != SpvOpVectorShuffle) {
+            return true;
+        }
+
+        vec1Id = value->args[0];
+        vec2Id = value->args[1];
+        component = value->args[2 + *index];
+    }
+}
+
+static IlcSpvId foldVectorShuffle(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    IlcSpvId resultTypeId = instr[1];
+    unsigned componentCount = (instr[0] >> SpvWordCountShift) - 5;
+    IlcSpvId ids[4];
+    unsigned indices[4];
+    IlcSpvId constituentIds[4];
+    bool isConstant = true;
+
+    for (unsigned i = 0; i < componentCount; i++) {
+        if (!resolveComponent(module, instr[3], instr[4], instr[5 + i], &ids[i], &indices[i])) {
+            return 0;
+        }
+
+        constituentIds[i] = getConstantComponent(module, ids[i], indices[i]);
+        isConstant = isConstant && constituentIds[i] != 0;
+    }
+
+    if (isConstant) {
+        return ilcSpvPutConstantComposite(module, resultTypeId, componentCount, constituentIds);
+    }
+
+    // Shuffle the original vectors directly if there are no more than two
+    IlcSpvId sourceIds[2] = { ids[0], ids[0] };
+    for (unsigned i = 1; i < componentCount; i++) {
+        if (ids[i] != sourceIds[0] && ids[i] != sourceIds[1]) {
+            if (sourceIds[1] != sourceIds[0]) {
+                return 0;
             }
+            sourceIds[1] = ids[i];
+        }
+    }
+
+    IlcSpvId source0TypeId = getValue(module, sourceIds[0])->typeId;
+    unsigned source0ComponentCount = getComponentCount(module, source0TypeId);
+    bool isIdentity = sourceIds[0] == sourceIds[1] && source0TypeId == resultTypeId;
+
+    for (unsigned i = 0; i < componentCount; i++) {
+        instr[5 + i] = ids[i] == sourceIds[0] ? indices[i] : source0ComponentCount + indices[i];
+        isIdentity = isIdentity && instr[5 + i] == i;
+    }
+
+    if (isIdentity) {
+        return sourceIds[0];
+    }
+
+    instr[3] = sourceIds[0];
+    instr[4] = sourceIds[1];
+    return 0;
+}
 
-            if (match) {
-                return constantId;
+static IlcSpvId foldCompositeConstruct(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    IlcSpvId resultTypeId = instr[1];
+    unsigned constituentCount = (instr[0] >> SpvWordCountShift) - 3;
+    const IlcSpvId* constituentIds = &instr[3];
+    bool isConstant = true;
+    bool isExtracted = true;
+    IlcSpvId compositeId = getValue(module, constituentIds[0])->args[0];
+
+    for (unsigned i = 0; i < constituentCount; i++) {
+        const IlcSpvValue* value = getValue(module, constituentIds[i]);
+
+        isConstant = isConstant && value->op == SpvOpConstant;
+        isExtracted = isExtracted && value->op == SpvOpCompositeExtract &&
+                      value->argCount == 2 && value->args[0] == compositeId && value->args[1] == i;
+    }
+
+    if (isConstant) {
+        return ilcSpvPutConstantComposite(module, resultTypeId, constituentCount, constituentIds);
+    } else if (isExtracted && getValue(module, compositeId)->typeId == resultTypeId) {
+        // Reassembled vector
+        return compositeId;
+    }
+    return 0;
+}
+
+static IlcSpvId foldCompositeExtract(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    IlcSpvId resultTypeId = instr[1];
+
+    if ((instr[0] >> SpvWordCountShift) != 5) {
+        return 0;
+    }
+
+    const IlcSpvValue* value = getValue(module, instr[3]);
+    if (value->op == SpvOpVectorShuffle) {
+        IlcSpvId id;
+        unsigned index;
+
+        if (resolveComponent(module, value->args[0], value->args[1], value->args[2 + instr[4]],
+                             &id, &index)) {
+            instr[3] = id;
+            instr[4] = index;
+            value = getValue(module, id);
+        }
+    }
+
+    unsigned index = instr[4];
+    if (value->op == SpvOpConstantComposite && index < value->argCount) {
+        return value->args[index];
+    } else if (value->op == SpvOpCompositeConstruct && index < value->argCount &&
+               value->argCount == getComponentCount(module, value->typeId) &&
+               getValue(module, value->args[index])->typeId == resultTypeId) {
+        return value->args[index];
+    }
+    return 0;
+}
+
+static IlcSpvId foldBitcast(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    IlcSpvId resultTypeId = instr[1];
+    const IlcSpvValue* value = getValue(module, instr[3]);
+
+    if (value->op == SpvOpBitcast) {
+        // Bitcast the original value directly
+        instr[3] = value->args[0];
+        value = getValue(module, instr[3]);
+    }
+
+    unsigned componentCount = getComponentCount(module, resultTypeId);
+    IlcSpvId componentTypeId = getComponentTypeId(module, resultTypeId);
+
+    if (value->typeId == resultTypeId) {
+        return instr[3];
+    } else if (componentCount == 0 ||
+               componentCount != getComponentCount(module, value->typeId)) {
+        return 0;
+    }
+
+    IlcSpvId constituentIds[4];
+    for (unsigned i = 0; i < componentCount; i++) {
+        IlcSpvId id = getConstantComponent(module, instr[3], i);
+
+        if (id == 0) {
+            return 0;
+        }
+        constituentIds[i] = id;
+    }
+
+    // Same bits, new type
+    for (unsigned i = 0; i < componentCount; i++) {
+        constituentIds[i] = ilcSpvPutConstant(module, componentTypeId,
+                                              getValue(module, constituentIds[i])->args[0]);
+    }
+
+    if (componentCount == 1) {
+        return constituentIds[0];
+    }
+    return ilcSpvPutConstantComposite(module, resultTypeId, componentCount, constituentIds);
+}
+
+static bool foldLiteral(
+    SpvOp op,
+    IlcSpvWord a,
+    IlcSpvWord b,
+    IlcSpvWord* result)
+{
+    float fa, fb, fr;
+
+    memcpy(&fa, &a, sizeof(fa));
+    memcpy(&fb, &b, sizeof(fb));
+
+    switch (op) {
+    case SpvOpSNegate:
+        *result = -a;
+        return true;
+    case SpvOpNot:
+        *result = ~a;
+        return true;
+    case SpvOpIAdd:
+        *result = a + b;
+        return true;
+    case SpvOpISub:
+        *result = a - b;
+        return true;
+    case SpvOpIMul:
+        *result = a * b;
+        return true;
+    case SpvOpBitwiseAnd:
+        *result = a & b;
+        return true;
+    case SpvOpBitwiseOr:
+        *result = a | b;
+        return true;
+    case SpvOpBitwiseXor:
+        *result = a ^ b;
+        return true;
+    case SpvOpShiftLeftLogical:
+        *result = a << b;
+        return b < 32;
+    case SpvOpShiftRightLogical:
+        *result = a >> b;
+        return b < 32;
+    case SpvOpShiftRightArithmetic:
+        *result = (int32_t)a >> b;
+        return b < 32;
+    case SpvOpFNegate:
+        *result = a ^ 0x80000000;
+        return true;
+    case SpvOpFAdd:
+        fr = fa + fb;
+        break;
+    case SpvOpFSub:
+        fr = fa - fb;
+        break;
+    case SpvOpFMul:
+        fr = fa * fb;
+        break;
+    default:
+        return false;
+    }
+
+    memcpy(result, &fr, sizeof(fr));
+    return true;
+}
+
+static IlcSpvId foldOp(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    SpvOp op = instr[0] & SpvOpCodeMask;
+    IlcSpvId resultTypeId = instr[1];
+    unsigned argCount = (instr[0] >> SpvWordCountShift) - 3;
+    unsigned componentCount = getComponentCount(module, resultTypeId);
+    IlcSpvId componentTypeId = getComponentTypeId(module, resultTypeId);
+    IlcSpvWord literals[4];
+
+    if (componentCount == 0 || argCount > 2) {
+        return 0;
+    }
+
+    // Arithmetic on constants
+    for (unsigned i = 0; i < componentCount; i++) {
+        IlcSpvWord args[2] = { 0, 0 };
+
+        for (unsigned j = 0; j < argCount; j++) {
+            IlcSpvId id = getConstantComponent(module, instr[3 + j], i);
+
+            if (id == 0) {
+                return 0;
             }
+            args[j] = getValue(module, id)->args[0];
+        }
+
+        if (!foldLiteral(op, args[0], args[1], &literals[i])) {
+            return 0;
         }
+    }
+
+    IlcSpvId constituentIds[4];
+    for (unsigned i = 0; i < componentCount; i++) {
+        constituentIds[i] = ilcSpvPutConstant(module, componentTypeId, literals[i]);
+    }
 
-        i += constantWordCount;
+    if (componentCount == 1) {
+        return constituentIds[0];
+    }
+    return ilcSpvPutConstantComposite(module, resultTypeId, componentCount, constituentIds);
+}
+
+static IlcSpvId foldInstr(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    switch (instr[0] & SpvOpCodeMask) {
+    case SpvOpVectorShuffle:
+        return foldVectorShuffle(module, instr);
+    case SpvOpCompositeConstruct:
+        return foldCompositeConstruct(module, instr);
+    case SpvOpCompositeExtract:
+        return foldCompositeExtract(module, instr);
+    case SpvOpBitcast:
+        return foldBitcast(module, instr);
+    case SpvOpSNegate:
+    case SpvOpNot:
+    case SpvOpIAdd:
+    case SpvOpISub:
+    case SpvOpIMul:
+    case SpvOpBitwiseAnd:
+    case SpvOpBitwiseOr:
+    case SpvOpBitwiseXor:
+    case SpvOpShiftLeftLogical:
+    case SpvOpShiftRightLogical:
+    case SpvOpShiftRightArithmetic:
+    case SpvOpFNegate:
+    case SpvOpFAdd:
+    case SpvOpFSub:
+    case SpvOpFMul:
+        return foldOp(module, instr);
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static IlcSpvId putValue(
+    IlcSpvModule* module,
+    SpvOp op,
+    IlcSpvId resultTypeId,
+    unsigned argCount,
+    const IlcSpvWord* args)
+{
+    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    IlcSpvWord instr[3 + MAX_VALUE_ARG_COUNT];
+    bool isNumbered = argCount <= MAX_VALUE_ARG_COUNT;
+    uint32_t hash = 0;
+    unsigned memoryIndex = 0;
+    IlcSpvId variableId = 0;
+
+    if (argCount <= MAX_VALUE_ARG_COUNT) {
+        instr[0] = op | ((3 + argCount) << SpvWordCountShift);
+        instr[1] = resultTypeId;
+        instr[2] = 0;
+        memcpy(&instr[3], args, argCount * sizeof(IlcSpvWord));
+
+        IlcSpvId id = foldInstr(module, instr);
+        if (id != 0) {
+            return id;
+        }
+        args = &instr[3];
+
+        // Values are pure, except for loads from memory that can be written to
+        if (op == SpvOpLoad) {
+            isNumbered = getLoadDependency(module, args[0], &memoryIndex, &variableId);
+        }
+
+        // Reuse an identical value from the current block
+        if (isNumbered) {
+            hash = hashInstr(ID_CODE, op, resultTypeId, argCount, args);
+            id = findValue(module, hash, op, resultTypeId, argCount, args);
+            if (id != 0) {
+                return id;
+            }
+        }
     }
 
     IlcSpvId id = ilcSpvAllocId(module);
@@ -175,6 +903,10 @@ static IlcSpvId putConstant(
         putWord(buffer, args[i]);
     }
 
+    setValue(module, id, op, resultTypeId, argCount, args);
+    if (isNumbered) {
+        addValue(module, hash, memoryIndex, variableId, id, 0);
+    }
     return id;
 }
 
@@ -207,9 +939,18 @@ void ilcSpvInit(
 {
     module->currentId = 1;
     module->glsl450ImportId = ilcSpvAllocId(module);
+    module->hasDebugInfo = false;
     for (int i = 0; i < ID_MAX; i++) {
         module->buffer[i] = (IlcSpvBuffer) { 0, 0, NULL };
     }
+    module->typeIndex = (IlcSpvIndex) { 0, 0, NULL };
+    module->valueCount = 0;
+    module->values = NULL;
+    module->valueCache = NULL;
+    module->blockIndex = 0;
+    module->memoryIndex = 1;
+    module->sharedMemoryIndex = 1;
+    module->privateMemoryIndex = 1;
 
     ilcSpvPutCapability(module, SpvCapabilityShader);
     putExtInstImport(module, module->glsl450ImportId, "GLSL.std.450");
@@ -226,6 +967,10 @@ void ilcSpvFinish(
         putBuffer(&module->buffer[ID_MAIN], &module->buffer[i]);
         free(module->buffer[i].words);
     }
+
+    free(module->typeIndex.entries);
+    free(module->values);
+    free(module->valueCache);
 }
 
 unsigned ilcSpvGetWordIndex(
@@ -273,6 +1018,10 @@ void ilcSpvPutSource(
     IlcSpvModule* module,
     IlcSpvId nameId)
 {
+    if (!module->hasDebugInfo) {
+        return;
+    }
+
     IlcSpvBuffer* buffer = &module->buffer[ID_DEBUG];
 
     putInstr(buffer, SpvOpSource, 4);
@@ -286,6 +1035,10 @@ void ilcSpvPutName(
     IlcSpvId target,
     const char* name)
 {
+    if (!module->hasDebugInfo) {
+        return;
+    }
+
     IlcSpvBuffer* buffer = &module->buffer[ID_DEBUG];
 
     putInstr(buffer, SpvOpName, 2 + strlenw(name));
@@ -297,6 +1050,10 @@ IlcSpvId ilcSpvPutString(
     IlcSpvModule* module,
     const char* string)
 {
+    if (!module->hasDebugInfo) {
+        return 0;
+    }
+
     IlcSpvBuffer* buffer = &module->buffer[ID_DEBUG];
 
     IlcSpvId id = ilcSpvAllocId(module);
@@ -506,6 +1263,13 @@ IlcSpvId ilcSpvPutConstantComposite(
                        consistuentCount, consistuents);
 }
 
+IlcSpvId ilcSpvPutConstantNull(
+    IlcSpvModule* module,
+    IlcSpvId resultTypeId)
+{
+    return putConstant(module, SpvOpConstantNull, resultTypeId, 0, NULL);
+}
+
 void ilcSpvPutFunction(
     IlcSpvModule* module,
     IlcSpvId resultTypeId,
@@ -537,6 +1301,9 @@ IlcSpvId ilcSpvPutFunctionCall(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+    module->privateMemoryIndex = module->memoryIndex;
+
     IlcSpvId id = ilcSpvAllocId(module);
     putInstr(buffer, SpvOpFunctionCall, 4);
     putWord(buffer, resultTypeId);
@@ -557,6 +1324,27 @@ IlcSpvId ilcSpvPutVariable(
     putWord(buffer, resultTypeId);
     putWord(buffer, id);
     putWord(buffer, storageClass);
+
+    setValue(module, id, SpvOpVariable, resultTypeId, 1, &storageClass);
+    return id;
+}
+
+IlcSpvId ilcSpvPutInitializedVariable(
+    IlcSpvModule* module,
+    IlcSpvId resultTypeId,
+    IlcSpvWord storageClass,
+    IlcSpvId initializerId)
+{
+    IlcSpvBuffer* buffer = &module->buffer[ID_VARIABLES];
+
+    IlcSpvId id = ilcSpvAllocId(module);
+    putInstr(buffer, SpvOpVariable, 5);
+    putWord(buffer, resultTypeId);
+    putWord(buffer, id);
+    putWord(buffer, storageClass);
+    putWord(buffer, initializerId);
+
+    setValue(module, id, SpvOpVariable, resultTypeId, 1, &storageClass);
     return id;
 }
 
@@ -584,14 +1372,7 @@ IlcSpvId ilcSpvPutLoad(
     IlcSpvId typeId,
     IlcSpvId pointerId)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
-
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpLoad, 4);
-    putWord(buffer, typeId);
-    putWord(buffer, id);
-    putWord(buffer, pointerId);
-    return id;
+    return putValue(module, SpvOpLoad, typeId, 1, &pointerId);
 }
 
 void ilcSpvPutStore(
@@ -601,9 +1382,20 @@ void ilcSpvPutStore(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, pointerId);
+
     putInstr(buffer, SpvOpStore, 3);
     putWord(buffer, pointerId);
     putWord(buffer, objectId);
+
+    // Forward the object to loads until the memory is written again
+    IlcSpvId typeId = getValue(module, objectId)->typeId;
+    unsigned memoryIndex;
+    IlcSpvId variableId;
+    if (typeId != 0 && getLoadDependency(module, pointerId, &memoryIndex, &variableId)) {
+        uint32_t hash = hashInstr(ID_CODE, SpvOpLoad, typeId, 1, &pointerId);
+        addValue(module, hash, memoryIndex, variableId, objectId, pointerId);
+    }
 }
 
 IlcSpvId ilcSpvPutAccessChain(
@@ -615,6 +1407,13 @@ IlcSpvId ilcSpvPutAccessChain(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    // Keep track of the base variable
+    if (indexIdCount < MAX_VALUE_ARG_COUNT) {
+        IlcSpvWord args[MAX_VALUE_ARG_COUNT] = { baseId };
+        memcpy(&args[1], indexIds, indexIdCount * sizeof(IlcSpvId));
+        return putValue(module, SpvOpAccessChain, resultTypeId, 1 + indexIdCount, args);
+    }
+
     IlcSpvId id = ilcSpvAllocId(module);
     putInstr(buffer, SpvOpAccessChain, 4 + indexIdCount);
     putWord(buffer, resultTypeId);
@@ -643,6 +1442,23 @@ void ilcSpvPutDecoration(
     }
 }
 
+void ilcSpvPutNoContraction(
+    IlcSpvModule* module,
+    IlcSpvId id)
+{
+    const IlcSpvValue* value = getValue(module, id);
+
+    if (value->isPrecise ||
+        (value->op != SpvOpFAdd && value->op != SpvOpFSub && value->op != SpvOpFMul &&
+         value->op != SpvOpFDiv && value->op != SpvOpDot &&
+         (value->op != SpvOpExtInst || value->args[1] != GLSLstd450Fma))) {
+        return;
+    }
+
+    module->values[id].isPrecise = true;
+    ilcSpvPutDecoration(module, id, SpvDecorationNoContraction, 0, NULL);
+}
+
 void ilcSpvPutMemberDecoration(
     IlcSpvModule* module,
     IlcSpvId structureTypeId,
@@ -670,18 +1486,11 @@ IlcSpvId ilcSpvPutVectorShuffle(
     unsigned componentCount,
     const IlcSpvWord* components)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    IlcSpvWord args[2 + 4] = { vec1Id, vec2Id };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpVectorShuffle, 5 + componentCount);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, vec1Id);
-    putWord(buffer, vec2Id);
-    for (int i = 0; i < componentCount; i++) {
-        putWord(buffer, components[i]);
-    }
-    return id;
+    assert(componentCount <= 4);
+    memcpy(&args[2], components, componentCount * sizeof(IlcSpvWord));
+    return putValue(module, SpvOpVectorShuffle, resultTypeId, 2 + componentCount, args);
 }
 
 IlcSpvId ilcSpvPutCompositeConstruct(
@@ -690,16 +1499,7 @@ IlcSpvId ilcSpvPutCompositeConstruct(
     unsigned consistuentCount,
     const IlcSpvId* consistuents)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
-
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpCompositeConstruct, 3 + consistuentCount);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    for (int i = 0; i < consistuentCount; i++) {
-        putWord(buffer, consistuents[i]);
-    }
-    return id;
+    return putValue(module, SpvOpCompositeConstruct, resultTypeId, consistuentCount, consistuents);
 }
 
 IlcSpvId ilcSpvPutCompositeExtract(
@@ -709,17 +1509,11 @@ IlcSpvId ilcSpvPutCompositeExtract(
     unsigned indexCount,
     const IlcSpvId* indexes)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    IlcSpvWord args[1 + 4] = { compositeId };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpCompositeExtract, 4 + indexCount);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, compositeId);
-    for (int i = 0; i < indexCount; i++) {
-        putWord(buffer, indexes[i]);
-    }
-    return id;
+    assert(indexCount <= 4);
+    memcpy(&args[1], indexes, indexCount * sizeof(IlcSpvWord));
+    return putValue(module, SpvOpCompositeExtract, resultTypeId, 1 + indexCount, args);
 }
 
 IlcSpvId ilcSpvPutSampledImage(
@@ -728,15 +1522,9 @@ IlcSpvId ilcSpvPutSampledImage(
     IlcSpvId imageId,
     IlcSpvId samplerId)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { imageId, samplerId };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpSampledImage, 5);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, imageId);
-    putWord(buffer, samplerId);
-    return id;
+    return putValue(module, SpvOpSampledImage, resultTypeId, 2, args);
 }
 
 IlcSpvId ilcSpvPutImageSample(
@@ -823,6 +1611,8 @@ void ilcSpvPutImageWrite(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+
     putInstr(buffer, SpvOpImageWrite, 4);
     putWord(buffer, imageId);
     putWord(buffer, coordinateId);
@@ -835,15 +1625,9 @@ IlcSpvId ilcSpvPutImageQuerySizeLod(
     IlcSpvId imageId,
     IlcSpvId lodId)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { imageId, lodId };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpImageQuerySizeLod, 5);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, imageId);
-    putWord(buffer, lodId);
-    return id;
+    return putValue(module, SpvOpImageQuerySizeLod, resultTypeId, 2, args);
 }
 
 IlcSpvId ilcSpvPutImageQueryLevels(
@@ -851,14 +1635,7 @@ IlcSpvId ilcSpvPutImageQueryLevels(
     IlcSpvId resultTypeId,
     IlcSpvId imageId)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
-
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpImageQueryLevels, 4);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, imageId);
-    return id;
+    return putValue(module, SpvOpImageQueryLevels, resultTypeId, 1, &imageId);
 }
 
 IlcSpvId ilcSpvPutOp1(
@@ -867,14 +1644,7 @@ IlcSpvId ilcSpvPutOp1(
     IlcSpvId resultTypeId,
     IlcSpvId arg0Id)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
-
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 4);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, arg0Id);
-    return id;
+    return putValue(module, op, resultTypeId, 1, &arg0Id);
 }
 
 IlcSpvId ilcSpvPutOp2(
@@ -884,15 +1654,9 @@ IlcSpvId ilcSpvPutOp2(
     IlcSpvId arg0Id,
     IlcSpvId arg1Id)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { arg0Id, arg1Id };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 5);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, arg0Id);
-    putWord(buffer, arg1Id);
-    return id;
+    return putValue(module, op, resultTypeId, 2, args);
 }
 
 IlcSpvId ilcSpvPutOp3(
@@ -903,16 +1667,9 @@ IlcSpvId ilcSpvPutOp3(
     IlcSpvId arg1Id,
     IlcSpvId arg2Id)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { arg0Id, arg1Id, arg2Id };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 6);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, arg0Id);
-    putWord(buffer, arg1Id);
-    putWord(buffer, arg2Id);
-    return id;
+    return putValue(module, op, resultTypeId, 3, args);
 }
 
 IlcSpvId ilcSpvPutOp4(
@@ -924,17 +1681,9 @@ IlcSpvId ilcSpvPutOp4(
     IlcSpvId arg2Id,
     IlcSpvId arg3Id)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { arg0Id, arg1Id, arg2Id, arg3Id };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 7);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, arg0Id);
-    putWord(buffer, arg1Id);
-    putWord(buffer, arg2Id);
-    putWord(buffer, arg3Id);
-    return id;
+    return putValue(module, op, resultTypeId, 4, args);
 }
 
 IlcSpvId ilcSpvPutAtomicOp(
@@ -948,6 +1697,8 @@ IlcSpvId ilcSpvPutAtomicOp(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, pointerId);
+
     IlcSpvId id = ilcSpvAllocId(module);
     putInstr(buffer, op, 6 + (valueId != 0));
     putWord(buffer, resultTypeId);
@@ -966,14 +1717,7 @@ IlcSpvId ilcSpvPutBitcast(
     IlcSpvId resultTypeId,
     IlcSpvId operandId)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
-
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpBitcast, 4);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, operandId);
-    return id;
+    return putValue(module, SpvOpBitcast, resultTypeId, 1, &operandId);
 }
 
 IlcSpvId ilcSpvPutSelect(
@@ -983,16 +1727,9 @@ IlcSpvId ilcSpvPutSelect(
     IlcSpvId obj1Id,
     IlcSpvId obj2Id)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    const IlcSpvWord args[] = { conditionId, obj1Id, obj2Id };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpSelect, 6);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, conditionId);
-    putWord(buffer, obj1Id);
-    putWord(buffer, obj2Id);
-    return id;
+    return putValue(module, SpvOpSelect, resultTypeId, 3, args);
 }
 
 void ilcSpvPutEmitVertex(
@@ -1000,6 +1737,8 @@ void ilcSpvPutEmitVertex(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+
     putInstr(buffer, SpvOpEmitVertex, 1);
 }
 
@@ -1008,6 +1747,8 @@ void ilcSpvPutEndPrimitive(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+
     putInstr(buffer, SpvOpEndPrimitive, 1);
 }
 
@@ -1019,6 +1760,8 @@ void ilcSpvPutControlBarrier(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+
     putInstr(buffer, SpvOpControlBarrier, 4);
     putWord(buffer, executionId);
     putWord(buffer, memoryId);
@@ -1032,6 +1775,8 @@ void ilcSpvPutMemoryBarrier(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    writeMemory(module, 0);
+
     putInstr(buffer, SpvOpMemoryBarrier, 3);
     putWord(buffer, memoryId);
     putWord(buffer, semanticsId);
@@ -1040,25 +1785,27 @@ void ilcSpvPutMemoryBarrier(
 void ilcSpvPutLoopMerge(
     IlcSpvModule* module,
     IlcSpvId mergeBlockId,
-    IlcSpvId continueTargetId)
+    IlcSpvId continueTargetId,
+    SpvLoopControlMask loopControl)
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
     putInstr(buffer, SpvOpLoopMerge, 4);
     putWord(buffer, mergeBlockId);
     putWord(buffer, continueTargetId);
-    putWord(buffer, SpvLoopControlMaskNone);
+    putWord(buffer, loopControl);
 }
 
 void ilcSpvPutSelectionMerge(
     IlcSpvModule* module,
-    IlcSpvId mergeBlockId)
+    IlcSpvId mergeBlockId,
+    SpvSelectionControlMask selectionControl)
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
     putInstr(buffer, SpvOpSelectionMerge, 3);
     putWord(buffer, mergeBlockId);
-    putWord(buffer, SpvSelectionControlMaskNone);
+    putWord(buffer, selectionControl);
 }
 
 IlcSpvId ilcSpvPutLabel(
@@ -1067,6 +1814,9 @@ IlcSpvId ilcSpvPutLabel(
 {
     IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
 
+    // Values of the previous block don't necessarily dominate this one
+    module->blockIndex++;
+
     IlcSpvId id = labelId != 0 ? labelId : ilcSpvAllocId(module);
     putInstr(buffer, SpvOpLabel, 2);
     putWord(buffer, id);
@@ -1129,18 +1879,11 @@ IlcSpvId ilcSpvPutGLSLOp(
     unsigned idCount,
     const IlcSpvId* ids)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CODE];
+    IlcSpvWord args[MAX_VALUE_ARG_COUNT] = { module->glsl450ImportId, glslOp };
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, SpvOpExtInst, 5 + idCount);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    putWord(buffer, module->glsl450ImportId);
-    putWord(buffer, glslOp);
-    for (int i = 0; i < idCount; i++) {
-        putWord(buffer, ids[i]);
-    }
-    return id;
+    assert(idCount <= MAX_VALUE_ARG_COUNT - 2);
+    memcpy(&args[2], ids, idCount * sizeof(IlcSpvWord));
+    return putValue(module, SpvOpExtInst, resultTypeId, 2 + idCount, args);
 }
 
 void ilcSpvPutDemoteToHelperInvocation(
@@ -1150,3 +1893,97 @@ void ilcSpvPutDemoteToHelperInvocation(
 
     putInstr(buffer, SpvOpDemoteToHelperInvocationEXT, 1);
 }
+
+static uint32_t getAlignment(
+    const IlcSpvModule* module,
+    IlcSpvId id,
+    unsigned index,
+    unsigned depth)
+{
+    // Component-wise, index selects the component of vector values
+    const uint32_t maxAlignment = 1u << 31;
+    const IlcSpvValue* value = getValue(module, id);
+
+    if (depth == 0) {
+        return 1;
+    }
+    depth--;
+
+    switch (value->op) {
+    case SpvOpConstant:
+        return value->args[0] != 0 ? value->args[0] & -value->args[0] : maxAlignment;
+    case SpvOpConstantNull:
+        return maxAlignment;
+    case SpvOpConstantComposite:
+        return index < value->argCount ? getAlignment(module, value->args[index], 0, depth) : 1;
+    case SpvOpCompositeConstruct:
+        if (index < value->argCount &&
+            getComponentCount(module, getValue(module, value->args[index])->typeId) == 1) {
+            return getAlignment(module, value->args[index], 0, depth);
+        }
+        break;
+    case SpvOpCompositeExtract:
+        if (value->argCount == 2) {
+            return getAlignment(module, value->args[0], value->args[1], depth);
+        }
+        break;
+    case SpvOpVectorShuffle: {
+        IlcSpvId componentId;
+        unsigned componentIndex;
+        if (index + 2 < value->argCount &&
+            resolveComponent(module, value->args[0], value->args[1], value->args[2 + index],
+                             &componentId, &componentIndex)) {
+            return getAlignment(module, componentId, componentIndex, depth);
+        }
+        break;
+    }
+    case SpvOpIAdd:
+    case SpvOpISub:
+        return MIN(getAlignment(module, value->args[0], index, depth),
+                   getAlignment(module, value->args[1], index, depth));
+    case SpvOpIMul: {
+        uint64_t alignment = (uint64_t)getAlignment(module, value->args[0], index, depth) *
+                             getAlignment(module, value->args[1], index, depth);
+        return MIN(alignment, maxAlignment);
+    }
+    case SpvOpShiftLeftLogical: {
+        IlcSpvId shiftId = getConstantComponent(module, value->args[1], index);
+        IlcSpvWord shift = getValue(module, shiftId)->args[0];
+        if (shiftId == 0 || shift >= 32) {
+            break;
+        }
+        uint64_t alignment = (uint64_t)getAlignment(module, value->args[0], index, depth) << shift;
+        return MIN(alignment, maxAlignment);
+    }
+    case SpvOpBitwiseAnd:
+        return MAX(getAlignment(module, value->args[0], index, depth),
+                   getAlignment(module, value->args[1], index, depth));
+    case SpvOpBitcast:
+        return getAlignment(module, value->args[0], index, depth);
+    default:
+        break;
+    }
+
+    return 1;
+}
+
+IlcSpvId ilcSpvFoldInstruction(
+    IlcSpvModule* module,
+    IlcSpvWord* instr)
+{
+    IlcSpvId id = foldInstr(module, instr);
+
+    if (id == 0) {
+        setValue(module, instr[2], instr[0] & SpvOpCodeMask, instr[1],
+                 (instr[0] >> SpvWordCountShift) - 3, &instr[3]);
+    }
+    return id;
+}
+
+uint32_t ilcSpvGetAlignment(
+    const IlcSpvModule* module,
+    IlcSpvId id)
+{
+    // Bound the walk, addresses are shallow expressions
+    return getAlignment(module, id, 0, 8);
+}
@@ -6,6 +6,9 @@
 #include "spirv/GLSL.std.450.h"
 #include "spirv/spirv.h"
 
+#define MAX_VALUE_ARG_COUNT (6)
+#define VALUE_CACHE_SIZE (1024)
+
 typedef enum {
     ID_MAIN,
     ID_CAPABILITIES,
@@ -33,10 +36,50 @@ typedef struct {
     IlcSpvWord* words;
 } IlcSpvBuffer;
 
+typedef struct {
+    uint32_t hash;
+    IlcSpvBufferId bufferId;
+    unsigned wordIndex;
+    IlcSpvId id; // 0 if empty
+} IlcSpvIndexEntry;
+
+typedef struct {
+    unsigned entryCount;
+    unsigned entrySize;
+    IlcSpvIndexEntry* entries;
+} IlcSpvIndex;
+
+typedef struct {
+    uint32_t hash;
+    unsigned blockIndex;
+    unsigned memoryIndex; // 0 if the value doesn't depend on memory
+    IlcSpvId variableId; // Private variable the value depends on, if any
+    IlcSpvId id; // 0 if empty
+    IlcSpvId pointerId; // Set if the value was stored there, loading it gives the value back
+} IlcSpvValueEntry;
+
+typedef struct {
+    SpvOp op; // SpvOpNop if unknown
+    IlcSpvId typeId;
+    unsigned argCount;
+    IlcSpvWord args[MAX_VALUE_ARG_COUNT];
+    unsigned memoryIndex; // Last write to the variable, for private variables
+    bool isPrecise; // Decorated with NoContraction
+} IlcSpvValue;
+
 typedef struct {
     IlcSpvId currentId;
     IlcSpvId glsl450ImportId;
+    bool hasDebugInfo; // Emit OpSource, OpString and OpName
     IlcSpvBuffer buffer[ID_MAX];
+    IlcSpvIndex typeIndex; // Types and constants
+    unsigned valueCount;
+    IlcSpvValue* values; // Defining instructions by ID, for folding
+    IlcSpvValueEntry* valueCache; // Recent values of the current block, for reuse
+    unsigned blockIndex; // Incremented at each label
+    unsigned memoryIndex; // Incremented at each instruction that may write memory
+    unsigned sharedMemoryIndex; // Last write to memory other than private variables
+    unsigned privateMemoryIndex; // Last write that may affect any private variable
 } IlcSpvModule;
 
 void ilcSpvInit(
@@ -166,6 +209,10 @@ IlcSpvId ilcSpvPutConstantComposite(
     unsigned consistuentCount,
     const IlcSpvId* consistuents);
 
+IlcSpvId ilcSpvPutConstantNull(
+    IlcSpvModule* module,
+    IlcSpvId resultTypeId);
+
 void ilcSpvPutFunction(
     IlcSpvModule* module,
     IlcSpvId resultType,
@@ -186,6 +233,12 @@ IlcSpvId ilcSpvPutVariable(
     IlcSpvId resultTypeId,
     IlcSpvWord storageClass);
 
+IlcSpvId ilcSpvPutInitializedVariable(
+    IlcSpvModule* module,
+    IlcSpvId resultTypeId,
+    IlcSpvWord storageClass,
+    IlcSpvId initializerId);
+
 IlcSpvId ilcSpvPutImageTexelPointer(
     IlcSpvModule* module,
     IlcSpvId resultTypeId,
@@ -217,6 +270,12 @@ void ilcSpvPutDecoration(
     unsigned argCount,
     const IlcSpvWord* args);
 
+// Keeps an arithmetic value from being fused with other operations. Values that were folded
+// into a constant or an operand are left alone.
+void ilcSpvPutNoContraction(
+    IlcSpvModule* module,
+    IlcSpvId id);
+
 void ilcSpvPutMemberDecoration(
     IlcSpvModule* module,
     IlcSpvId structureTypeId,
@@ -366,11 +425,13 @@ void ilcSpvPutMemoryBarrier(
 void ilcSpvPutLoopMerge(
     IlcSpvModule* module,
     IlcSpvId mergeBlockId,
-    IlcSpvId continueTargetId);
+    IlcSpvId continueTargetId,
+    SpvLoopControlMask loopControl);
 
 void ilcSpvPutSelectionMerge(
     IlcSpvModule* module,
-    IlcSpvId mergeBlockId);
+    IlcSpvId mergeBlockId,
+    SpvSelectionControlMask selectionControl);
 
 IlcSpvId ilcSpvPutLabel(
     IlcSpvModule* module,
@@ -406,4 +467,49 @@ IlcSpvId ilcSpvPutGLSLOp(
 void ilcSpvPutDemoteToHelperInvocation(
     IlcSpvModule* module);
 
+// Folds a code instruction against the previously folded ones. Returns the ID of an
+// equivalent value, or 0 if the instruction is still needed, possibly rewritten in place.
+IlcSpvId ilcSpvFoldInstruction(
+    IlcSpvModule* module,
+    IlcSpvWord* instr);
+
+// Returns the largest power of two known to divide an integer scalar value, from its
+// defining instructions.
+uint32_t ilcSpvGetAlignment(
+    const IlcSpvModule* module,
+    IlcSpvId id);
+
+bool ilcSpvIsIdWord(
+    const IlcSpvWord* instr,
+    unsigned wordIndex);
+
+// Promotes variables only accessed through whole loads and stores to SSA values.
+// Promoted variables are removed from the module and their ID is set to 0 in varIds.
+void ilcSpvPromoteVariables(
+    IlcSpvModule* module,
+    unsigned varCount,
+    IlcSpvId* varIds);
+
+// Removes instructions without side effects whose result is never used,
+// and stores to private and workgroup memory that is never read.
+void ilcSpvEliminateDeadCode(
+    IlcSpvModule* module);
+
+// Removes the variables the code doesn't reference, their ID is set to 0 in varIds.
+void ilcSpvRemoveUnusedVariables(
+    IlcSpvModule* module,
+    unsigned varCount,
+    IlcSpvId* varIds);
+
+// Refolds the code once register values are known, see ilcSpvFoldInstruction.
+void ilcSpvFoldInstructions(
+    IlcSpvModule* module);
+
+// Decorates the float arithmetic that only feeds the given color outputs with
+// RelaxedPrecision, so that it can run at half precision.
+void ilcSpvRelaxPrecision(
+    IlcSpvModule* module,
+    unsigned outputCount,
+    const IlcSpvId* outputIds);
+
 #endif // AMDILC_SPIRV_H_
@@ -0,0 +1,1401 @@
+#include "amdilc_internal.h"
+#include "amdilc_spirv.h"
+
+#define NO_INDEX    (~0u)
+
+typedef struct {
+    IlcSpvId labelId;
+    unsigned wordIndex; // OpLabel
+    unsigned terminatorWordIndex;
+    unsigned endWordIndex; // Past the block terminator
+    unsigned succCount;
+    unsigned* succs;
+    unsigned predCount;
+    unsigned* preds;
+    unsigned frontierCount;
+    unsigned* frontiers; // Dominance frontier
+    unsigned childCount;
+    unsigned* children; // Immediately dominated blocks
+    unsigned postIndex; // NO_INDEX if unreachable
+    unsigned idom;
+    unsigned firstPhiIndex;
+} Block;
+
+typedef struct {
+    unsigned varIndex;
+    IlcSpvId id;
+    unsigned nextPhiIndex;
+    IlcSpvId* valueIds; // One per predecessor
+} Phi;
+
+typedef struct {
+    IlcSpvId id;
+    IlcSpvId typeId; // Pointee type, 0 if never loaded
+    IlcSpvId nullId;
+    unsigned funcIndex;
+    bool isPromotable;
+} Variable;
+
+typedef struct {
+    unsigned varIndex;
+    IlcSpvId valueId;
+} ValueUndo;
+
+typedef struct {
+    unsigned blockIndex;
+    unsigned nextChildIndex;
+    unsigned undoCount;
+} RenameFrame;
+
+typedef struct {
+    IlcSpvModule* module;
+    const IlcSpvWord* words;
+    unsigned idCount;
+    unsigned* varIndices; // Index + 1 by variable ID, 0 if not a candidate
+    IlcSpvId* valueIds; // Replacement by promoted load ID
+    unsigned* blockIndices; // Index + 1 by label ID
+    unsigned varCount;
+    Variable* vars;
+    unsigned blockCount;
+    Block* blocks;
+    unsigned phiCount;
+    Phi* phis;
+    unsigned setWordCount; // Words per liveness bitset
+} Promoter;
+
+static void setValueId(
+    IlcSpvId* valueIds,
+    unsigned varIndex,
+    IlcSpvId valueId,
+    unsigned* undoCount,
+    ValueUndo** undos)
+{
+    (*undoCount)++;
+    *undos = realloc(*undos, *undoCount * sizeof(ValueUndo));
+    (*undos)[*undoCount - 1] = (ValueUndo) { varIndex, valueIds[varIndex] };
+
+    valueIds[varIndex] = valueId;
+}
+
+static void putWords(
+    IlcSpvBuffer* buffer,
+    const IlcSpvWord* words,
+    unsigned wordCount)
+{
+    unsigned size = (buffer->wordCount + wordCount) * sizeof(IlcSpvWord);
+    if (buffer->wordSize < size) {
+        buffer->wordSize = MAX(2 * buffer->wordSize, size);
+        buffer->words = realloc(buffer->words, buffer->wordSize);
+    }
+
+    memcpy(&buffer->words[buffer->wordCount], words, wordCount * sizeof(IlcSpvWord));
+    buffer->wordCount += wordCount;
+}
+
+static void addIndex(
+    unsigned* count,
+    unsigned** indices,
+    unsigned index)
+{
+    for (unsigned i = 0; i < *count; i++) {
+        if ((*indices)[i] == index) {
+            return;
+        }
+    }
+
+    (*count)++;
+    *indices = realloc(*indices, *count * sizeof(unsigned));
+    (*indices)[*count - 1] = index;
+}
+
+static bool isTerminator(
+    SpvOp op)
+{
+    return op == SpvOpBranch || op == SpvOpBranchConditional || op == SpvOpSwitch ||
+           op == SpvOpReturn || op == SpvOpReturnValue || op == SpvOpKill ||
+           op == SpvOpUnreachable || op == SpvOpTerminateInvocation;
+}
+
+static const Variable* getVariable(
+    const Promoter* promoter,
+    IlcSpvId id)
+{
+    if (id >= promoter->idCount || promoter->varIndices[id] == 0) {
+        return NULL;
+    }
+
+    const Variable* var = &promoter->vars[promoter->varIndices[id] - 1];
+    return var->isPromotable ? var : NULL;
+}
+
+static IlcSpvId getValueId(
+    Promoter* promoter,
+    unsigned varIndex,
+    IlcSpvId valueId)
+{
+    Variable* var = &promoter->vars[varIndex];
+
+    if (valueId != 0) {
+        return valueId;
+    }
+
+    // Read before any write, use the zero value instead of undef to stay on the safe side
+    if (var->nullId == 0) {
+        var->nullId = ilcSpvPutConstantNull(promoter->module, var->typeId);
+    }
+    return var->nullId;
+}
+
+static bool checkVariables(
+    Promoter* promoter,
+    unsigned wordCount)
+{
+    const IlcSpvWord* words = promoter->words;
+    unsigned funcIndex = 0;
+
+    for (unsigned i = 0; i < wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+        unsigned instrWordCount = words[i] >> SpvWordCountShift;
+
+        if (instrWordCount == 0) {
+            // Malformed code, leave everything in place
+            return false;
+        }
+
+        if (op == SpvOpFunction) {
+            funcIndex++;
+        }
+
+        for (unsigned j = 1; j < instrWordCount; j++) {
+            IlcSpvId id = words[i + j];
+            if (id >= promoter->idCount || promoter->varIndices[id] == 0) {
+                continue;
+            }
+
+            Variable* var = &promoter->vars[promoter->varIndices[id] - 1];
+            bool isLoad = op == SpvOpLoad && instrWordCount == 4 && j == 3;
+            bool isStore = op == SpvOpStore && instrWordCount == 3 && j == 1;
+
+            if (!isLoad && !isStore) {
+                // Pointer escapes (or a literal collides, stay conservative)
+                var->isPromotable = false;
+            } else if (var->funcIndex != funcIndex && var->funcIndex != 0) {
+                // Values can't be carried across functions
+                var->isPromotable = false;
+            } else if (isLoad && var->typeId != 0 && var->typeId != words[i + 1]) {
+                var->isPromotable = false;
+            }
+
+            var->funcIndex = funcIndex;
+            if (isLoad) {
+                var->typeId = words[i + 1];
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < promoter->varCount; i++) {
+        if (promoter->vars[i].isPromotable) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool addSuccessor(
+    Promoter* promoter,
+    Block* block,
+    IlcSpvId labelId)
+{
+    if (labelId >= promoter->idCount || promoter->blockIndices[labelId] == 0) {
+        return false;
+    }
+
+    addIndex(&block->succCount, &block->succs, promoter->blockIndices[labelId] - 1);
+    return true;
+}
+
+static bool parseBlocks(
+    Promoter* promoter,
+    unsigned beginWordIndex,
+    unsigned endWordIndex)
+{
+    const IlcSpvWord* words = promoter->words;
+    Block* block = NULL;
+
+    // Split the function into blocks
+    for (unsigned i = beginWordIndex; i < endWordIndex; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+
+        if (op == SpvOpLabel) {
+            if (block != NULL || words[i + 1] >= promoter->idCount) {
+                return false;
+            }
+
+            promoter->blockCount++;
+            promoter->blocks = realloc(promoter->blocks, promoter->blockCount * sizeof(Block));
+            block = &promoter->blocks[promoter->blockCount - 1];
+            *block = (Block) {
+                .labelId = words[i + 1],
+                .wordIndex = i,
+                .terminatorWordIndex = 0,
+                .endWordIndex = 0,
+                .succCount = 0,
+                .succs = NULL,
+                .predCount = 0,
+                .preds = NULL,
+                .frontierCount = 0,
+                .frontiers = NULL,
+                .childCount = 0,
+                .children = NULL,
+                .postIndex = NO_INDEX,
+                .idom = NO_INDEX,
+                .firstPhiIndex = NO_INDEX,
+            };
+            promoter->blockIndices[block->labelId] = promoter->blockCount;
+        } else if (block == NULL) {
+            // Instruction outside of a block
+            return false;
+        } else if (isTerminator(op)) {
+            block->terminatorWordIndex = i;
+            block->endWordIndex = i + (words[i] >> SpvWordCountShift);
+            block = NULL;
+        }
+    }
+
+    if (block != NULL || promoter->blockCount == 0) {
+        return false;
+    }
+
+    // Link blocks
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        Block* block = &promoter->blocks[i];
+        const IlcSpvWord* terminator = &words[block->terminatorWordIndex];
+        unsigned terminatorWordCount = terminator[0] >> SpvWordCountShift;
+
+        switch (terminator[0] & SpvOpCodeMask) {
+        case SpvOpBranch:
+            if (!addSuccessor(promoter, block, terminator[1])) {
+                return false;
+            }
+            break;
+        case SpvOpBranchConditional:
+            if (!addSuccessor(promoter, block, terminator[2]) ||
+                !addSuccessor(promoter, block, terminator[3])) {
+                return false;
+            }
+            break;
+        case SpvOpSwitch:
+            // Default, then (literal, label) pairs
+            for (unsigned j = 2; j < terminatorWordCount; j += 2) {
+                if (!addSuccessor(promoter, block, terminator[j])) {
+                    return false;
+                }
+            }
+            break;
+        }
+
+        for (unsigned j = 0; j < block->succCount; j++) {
+            Block* succ = &promoter->blocks[block->succs[j]];
+
+            addIndex(&succ->predCount, &succ->preds, i);
+        }
+    }
+
+    return true;
+}
+
+static unsigned intersectDominators(
+    const Promoter* promoter,
+    unsigned index1,
+    unsigned index2)
+{
+    const Block* blocks = promoter->blocks;
+
+    while (index1 != index2) {
+        while (blocks[index1].postIndex < blocks[index2].postIndex) {
+            index1 = blocks[index1].idom;
+        }
+        while (blocks[index2].postIndex < blocks[index1].postIndex) {
+            index2 = blocks[index2].idom;
+        }
+    }
+
+    return index1;
+}
+
+static unsigned computeDominators(
+    Promoter* promoter,
+    unsigned* postOrder)
+{
+    Block* blocks = promoter->blocks;
+    unsigned* stack = malloc(promoter->blockCount * sizeof(unsigned));
+    unsigned* nextSuccs = calloc(promoter->blockCount, sizeof(unsigned));
+    bool* isVisited = calloc(promoter->blockCount, sizeof(bool));
+    unsigned stackSize = 0;
+    unsigned postCount = 0;
+
+    // Depth-first walk from the entry block
+    stack[stackSize++] = 0;
+    isVisited[0] = true;
+    while (stackSize > 0) {
+        unsigned index = stack[stackSize - 1];
+        Block* block = &blocks[index];
+
+        if (nextSuccs[index] < block->succCount) {
+            unsigned succIndex = block->succs[nextSuccs[index]++];
+
+            if (!isVisited[succIndex]) {
+                isVisited[succIndex] = true;
+                stack[stackSize++] = succIndex;
+            }
+        } else {
+            block->postIndex = postCount;
+            postOrder[postCount++] = index;
+            stackSize--;
+        }
+    }
+
+    free(stack);
+    free(nextSuccs);
+    free(isVisited);
+
+    // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+    blocks[0].idom = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (int i = postCount - 2; i >= 0; i--) {
+            Block* block = &blocks[postOrder[i]];
+            unsigned idom = NO_INDEX;
+
+            for (unsigned j = 0; j < block->predCount; j++) {
+                unsigned predIndex = block->preds[j];
+
+                if (blocks[predIndex].idom == NO_INDEX) {
+                    // Unreachable or not processed yet
+                    continue;
+                }
+                idom = idom == NO_INDEX ? predIndex
+                                        : intersectDominators(promoter, predIndex, idom);
+            }
+
+            if (block->idom != idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < postCount; i++) {
+        unsigned index = postOrder[i];
+        Block* block = &blocks[index];
+
+        if (index != 0) {
+            Block* idomBlock = &blocks[block->idom];
+            addIndex(&idomBlock->childCount, &idomBlock->children, index);
+        }
+
+        if (block->predCount < 2) {
+            continue;
+        }
+
+        for (unsigned j = 0; j < block->predCount; j++) {
+            unsigned runnerIndex = block->preds[j];
+
+            if (blocks[runnerIndex].postIndex == NO_INDEX) {
+                continue;
+            }
+
+            while (runnerIndex != block->idom) {
+                Block* runner = &blocks[runnerIndex];
+
+                addIndex(&runner->frontierCount, &runner->frontiers, index);
+                runnerIndex = runner->idom;
+            }
+        }
+    }
+
+    return postCount;
+}
+
+static void computeLiveness(
+    Promoter* promoter,
+    const unsigned* postOrder,
+    unsigned postCount,
+    uint32_t* liveIns,
+    uint32_t* defs)
+{
+    const IlcSpvWord* words = promoter->words;
+    unsigned setWordCount = promoter->setWordCount;
+    uint32_t* uses = calloc(promoter->blockCount * setWordCount, sizeof(uint32_t));
+
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        const Block* block = &promoter->blocks[i];
+        uint32_t* use = &uses[i * setWordCount];
+        uint32_t* def = &defs[i * setWordCount];
+
+        for (unsigned j = block->wordIndex; j < block->endWordIndex;
+             j += words[j] >> SpvWordCountShift) {
+            SpvOp op = words[j] & SpvOpCodeMask;
+            const Variable* var = NULL;
+
+            if (op == SpvOpLoad && (var = getVariable(promoter, words[j + 3])) != NULL) {
+                unsigned varIndex = var - promoter->vars;
+
+                if (!(def[varIndex / 32] & (1u << (varIndex % 32)))) {
+                    use[varIndex / 32] |= 1u << (varIndex % 32);
+                }
+            } else if (op == SpvOpStore && (var = getVariable(promoter, words[j + 1])) != NULL) {
+                unsigned varIndex = var - promoter->vars;
+
+                def[varIndex / 32] |= 1u << (varIndex % 32);
+            }
+        }
+    }
+
+    // Iterate backwards until a fixed point is reached
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (unsigned i = 0; i < postCount; i++) {
+            unsigned index = postOrder[i];
+            const Block* block = &promoter->blocks[index];
+            uint32_t* liveIn = &liveIns[index * setWordCount];
+
+            for (unsigned j = 0; j < setWordCount; j++) {
+                uint32_t liveOut = 0;
+
+                for (unsigned k = 0; k < block->succCount; k++) {
+                    liveOut |= liveIns[block->succs[k] * setWordCount + j];
+                }
+
+                uint32_t live = uses[index * setWordCount + j] |
+                                (liveOut & ~defs[index * setWordCount + j]);
+                if (live != liveIn[j]) {
+                    liveIn[j] = live;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(uses);
+}
+
+static void insertPhis(
+    Promoter* promoter,
+    const uint32_t* liveIns,
+    const uint32_t* defs)
+{
+    unsigned setWordCount = promoter->setWordCount;
+    unsigned blockCount = promoter->blockCount;
+    unsigned* worklist = malloc(blockCount * sizeof(unsigned));
+    unsigned* phiStamps = calloc(blockCount, sizeof(unsigned));
+    unsigned* workStamps = calloc(blockCount, sizeof(unsigned));
+
+    for (unsigned i = 0; i < promoter->varCount; i++) {
+        const Variable* var = &promoter->vars[i];
+        unsigned stamp = i + 1;
+        unsigned worklistSize = 0;
+
+        if (!var->isPromotable || var->typeId == 0) {
+            continue;
+        }
+
+        // Start from the reachable blocks writing the variable
+        for (unsigned j = 0; j < blockCount; j++) {
+            if (promoter->blocks[j].postIndex != NO_INDEX &&
+                (defs[j * setWordCount + i / 32] & (1u << (i % 32)))) {
+                worklist[worklistSize++] = j;
+                workStamps[j] = stamp;
+            }
+        }
+
+        // Only place phis where the variable is live (pruned SSA)
+        while (worklistSize > 0) {
+            const Block* block = &promoter->blocks[worklist[--worklistSize]];
+
+            for (unsigned j = 0; j < block->frontierCount; j++) {
+                unsigned frontierIndex = block->frontiers[j];
+                Block* frontier = &promoter->blocks[frontierIndex];
+                uint32_t liveIn = liveIns[frontierIndex * setWordCount + i / 32];
+
+                if (phiStamps[frontierIndex] == stamp || !(liveIn & (1u << (i % 32)))) {
+                    continue;
+                }
+
+                promoter->phiCount++;
+                promoter->phis = realloc(promoter->phis, promoter->phiCount * sizeof(Phi));
+                promoter->phis[promoter->phiCount - 1] = (Phi) {
+                    .varIndex = i,
+                    .id = ilcSpvAllocId(promoter->module),
+                    .nextPhiIndex = frontier->firstPhiIndex,
+                    .valueIds = calloc(frontier->predCount, sizeof(IlcSpvId)),
+                };
+                frontier->firstPhiIndex = promoter->phiCount - 1;
+                phiStamps[frontierIndex] = stamp;
+
+                if (workStamps[frontierIndex] != stamp) {
+                    worklist[worklistSize++] = frontierIndex;
+                    workStamps[frontierIndex] = stamp;
+                }
+            }
+        }
+    }
+
+    free(worklist);
+    free(phiStamps);
+    free(workStamps);
+}
+
+static void renameBlock(
+    Promoter* promoter,
+    unsigned index,
+    IlcSpvId* valueIds,
+    unsigned* undoCount,
+    ValueUndo** undos)
+{
+    const IlcSpvWord* words = promoter->words;
+    const Block* block = &promoter->blocks[index];
+
+    for (unsigned i = block->firstPhiIndex; i != NO_INDEX; i = promoter->phis[i].nextPhiIndex) {
+        setValueId(valueIds, promoter->phis[i].varIndex, promoter->phis[i].id, undoCount, undos);
+    }
+
+    for (unsigned i = block->wordIndex; i < block->endWordIndex;
+         i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+        const Variable* var = NULL;
+
+        if (op == SpvOpLoad && (var = getVariable(promoter, words[i + 3])) != NULL) {
+            unsigned varIndex = var - promoter->vars;
+
+            promoter->valueIds[words[i + 2]] = getValueId(promoter, varIndex, valueIds[varIndex]);
+        } else if (op == SpvOpStore && (var = getVariable(promoter, words[i + 1])) != NULL) {
+            IlcSpvId objectId = words[i + 2];
+
+            if (objectId < promoter->idCount && promoter->valueIds[objectId] != 0) {
+                objectId = promoter->valueIds[objectId];
+            }
+            setValueId(valueIds, var - promoter->vars, objectId, undoCount, undos);
+        }
+    }
+
+    // Feed the successor phis
+    for (unsigned i = 0; i < block->succCount; i++) {
+        const Block* succ = &promoter->blocks[block->succs[i]];
+        unsigned predIndex = 0;
+
+        while (succ->preds[predIndex] != index) {
+            predIndex++;
+        }
+
+        for (unsigned j = succ->firstPhiIndex; j != NO_INDEX; j = promoter->phis[j].nextPhiIndex) {
+            Phi* phi = &promoter->phis[j];
+
+            phi->valueIds[predIndex] = getValueId(promoter, phi->varIndex,
+                                                  valueIds[phi->varIndex]);
+        }
+    }
+}
+
+static void renameBlocks(
+    Promoter* promoter)
+{
+    IlcSpvId* valueIds = calloc(promoter->varCount, sizeof(IlcSpvId));
+    RenameFrame* frames = malloc(promoter->blockCount * sizeof(RenameFrame));
+    unsigned frameCount = 0;
+    unsigned undoCount = 0;
+    ValueUndo* undos = NULL;
+
+    // Walk the dominator tree without recursing, deep trees are common with long if chains
+    frames[frameCount++] = (RenameFrame) { 0, 0, 0 };
+    renameBlock(promoter, 0, valueIds, &undoCount, &undos);
+
+    while (frameCount > 0) {
+        RenameFrame* frame = &frames[frameCount - 1];
+        const Block* block = &promoter->blocks[frame->blockIndex];
+
+        if (frame->nextChildIndex < block->childCount) {
+            unsigned childIndex = block->children[frame->nextChildIndex++];
+
+            frames[frameCount++] = (RenameFrame) { childIndex, 0, undoCount };
+            renameBlock(promoter, childIndex, valueIds, &undoCount, &undos);
+        } else {
+            // Restore the values reaching the parent block
+            while (undoCount > frame->undoCount) {
+                undoCount--;
+                valueIds[undos[undoCount].varIndex] = undos[undoCount].valueId;
+            }
+            frameCount--;
+        }
+    }
+
+    free(valueIds);
+    free(frames);
+    free(undos);
+}
+
+static void renameUnreachableBlocks(
+    Promoter* promoter)
+{
+    const IlcSpvWord* words = promoter->words;
+
+    // Dead code reads zero
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        const Block* block = &promoter->blocks[i];
+
+        if (block->postIndex != NO_INDEX) {
+            continue;
+        }
+
+        for (unsigned j = block->wordIndex; j < block->endWordIndex;
+             j += words[j] >> SpvWordCountShift) {
+            const Variable* var = NULL;
+
+            if ((words[j] & SpvOpCodeMask) == SpvOpLoad &&
+                (var = getVariable(promoter, words[j + 3])) != NULL) {
+                promoter->valueIds[words[j + 2]] = getValueId(promoter, var - promoter->vars, 0);
+            }
+        }
+    }
+
+    // Phi inputs from unreachable predecessors
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        const Block* block = &promoter->blocks[i];
+
+        for (unsigned j = block->firstPhiIndex; j != NO_INDEX; j = promoter->phis[j].nextPhiIndex) {
+            Phi* phi = &promoter->phis[j];
+
+            for (unsigned k = 0; k < block->predCount; k++) {
+                phi->valueIds[k] = getValueId(promoter, phi->varIndex, phi->valueIds[k]);
+            }
+        }
+    }
+}
+
+static void putInstr(
+    Promoter* promoter,
+    IlcSpvBuffer* buffer,
+    const IlcSpvWord* instr)
+{
+    SpvOp op = instr[0] & SpvOpCodeMask;
+    unsigned wordCount = instr[0] >> SpvWordCountShift;
+
+    // Drop promoted accesses
+    if ((op == SpvOpLoad && getVariable(promoter, instr[3]) != NULL) ||
+        (op == SpvOpStore && getVariable(promoter, instr[1]) != NULL)) {
+        return;
+    }
+
+    unsigned wordIndex = buffer->wordCount;
+    putWords(buffer, instr, wordCount);
+
+    IlcSpvWord* words = &buffer->words[wordIndex];
+    for (unsigned i = 1; i < wordCount; i++) {
+        if (words[i] < promoter->idCount && promoter->valueIds[words[i]] != 0 &&
+            ilcSpvIsIdWord(instr, i)) {
+            words[i] = promoter->valueIds[words[i]];
+        }
+    }
+}
+
+static void putBlockPhis(
+    Promoter* promoter,
+    IlcSpvBuffer* buffer,
+    const Block* block)
+{
+    for (unsigned i = block->firstPhiIndex; i != NO_INDEX; i = promoter->phis[i].nextPhiIndex) {
+        const Phi* phi = &promoter->phis[i];
+        const IlcSpvWord header[] = {
+            SpvOpPhi | ((3 + 2 * block->predCount) << SpvWordCountShift),
+            promoter->vars[phi->varIndex].typeId,
+            phi->id,
+        };
+
+        putWords(buffer, header, 3);
+        for (unsigned j = 0; j < block->predCount; j++) {
+            const IlcSpvWord operands[] = {
+                phi->valueIds[j],
+                promoter->blocks[block->preds[j]].labelId,
+            };
+
+            putWords(buffer, operands, 2);
+        }
+    }
+}
+
+static void freeBlocks(
+    Promoter* promoter)
+{
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        Block* block = &promoter->blocks[i];
+
+        promoter->blockIndices[block->labelId] = 0;
+        free(block->succs);
+        free(block->preds);
+        free(block->frontiers);
+        free(block->children);
+    }
+    for (unsigned i = 0; i < promoter->phiCount; i++) {
+        free(promoter->phis[i].valueIds);
+    }
+
+    free(promoter->blocks);
+    free(promoter->phis);
+    promoter->blockCount = 0;
+    promoter->blocks = NULL;
+    promoter->phiCount = 0;
+    promoter->phis = NULL;
+}
+
+static void promoteFunction(
+    Promoter* promoter,
+    IlcSpvBuffer* buffer,
+    unsigned funcIndex,
+    unsigned beginWordIndex,
+    unsigned endWordIndex)
+{
+    const IlcSpvWord* words = promoter->words;
+
+    if (!parseBlocks(promoter, beginWordIndex, endWordIndex)) {
+        LOGW("unexpected control flow, skipping register promotion\n");
+
+        for (unsigned i = 0; i < promoter->varCount; i++) {
+            if (promoter->vars[i].funcIndex == funcIndex) {
+                promoter->vars[i].isPromotable = false;
+            }
+        }
+
+        for (unsigned i = beginWordIndex; i < endWordIndex; i += words[i] >> SpvWordCountShift) {
+            putInstr(promoter, buffer, &words[i]);
+        }
+        freeBlocks(promoter);
+        return;
+    }
+
+    unsigned setCount = promoter->blockCount * promoter->setWordCount;
+    unsigned* postOrder = malloc(promoter->blockCount * sizeof(unsigned));
+    uint32_t* liveIns = calloc(setCount, sizeof(uint32_t));
+    uint32_t* defs = calloc(setCount, sizeof(uint32_t));
+
+    unsigned postCount = computeDominators(promoter, postOrder);
+    computeLiveness(promoter, postOrder, postCount, liveIns, defs);
+    insertPhis(promoter, liveIns, defs);
+    renameBlocks(promoter);
+    renameUnreachableBlocks(promoter);
+
+    for (unsigned i = 0; i < promoter->blockCount; i++) {
+        const Block* block = &promoter->blocks[i];
+
+        putInstr(promoter, buffer, &words[block->wordIndex]);
+        putBlockPhis(promoter, buffer, block);
+        for (unsigned j = block->wordIndex + 2; j < block->endWordIndex;
+             j += words[j] >> SpvWordCountShift) {
+            putInstr(promoter, buffer, &words[j]);
+        }
+    }
+
+    free(postOrder);
+    free(liveIns);
+    free(defs);
+    freeBlocks(promoter);
+}
+
+static void removeInstructions(
+    IlcSpvBuffer* buffer,
+    SpvOp op,
+    unsigned idWordIndex,
+    const bool* isRemoved)
+{
+    unsigned wordCount = 0;
+
+    for (unsigned i = 0; i < buffer->wordCount; i += buffer->words[i] >> SpvWordCountShift) {
+        unsigned instrWordCount = buffer->words[i] >> SpvWordCountShift;
+
+        if ((buffer->words[i] & SpvOpCodeMask) == op && isRemoved[buffer->words[i + idWordIndex]]) {
+            continue;
+        }
+
+        memmove(&buffer->words[wordCount], &buffer->words[i], instrWordCount * sizeof(IlcSpvWord));
+        wordCount += instrWordCount;
+    }
+
+    buffer->wordCount = wordCount;
+}
+
+static bool isPure(
+    SpvOp op)
+{
+    // Instructions without side effects, they can be removed if their result is unused
+    switch (op) {
+    case SpvOpLoad:
+    case SpvOpAccessChain:
+    case SpvOpPhi:
+    case SpvOpSelect:
+    case SpvOpVectorShuffle:
+    case SpvOpCompositeConstruct:
+    case SpvOpCompositeExtract:
+    case SpvOpCompositeInsert:
+    case SpvOpBitcast:
+    case SpvOpConvertFToS:
+    case SpvOpConvertFToU:
+    case SpvOpConvertSToF:
+    case SpvOpConvertUToF:
+    case SpvOpFNegate:
+    case SpvOpFAdd:
+    case SpvOpFMul:
+    case SpvOpFDiv:
+    case SpvOpDot:
+    case SpvOpSNegate:
+    case SpvOpIAdd:
+    case SpvOpIMul:
+    case SpvOpSDiv:
+    case SpvOpUDiv:
+    case SpvOpUMod:
+    case SpvOpNot:
+    case SpvOpBitwiseAnd:
+    case SpvOpBitwiseOr:
+    case SpvOpBitwiseXor:
+    case SpvOpShiftLeftLogical:
+    case SpvOpShiftRightLogical:
+    case SpvOpShiftRightArithmetic:
+    case SpvOpBitFieldInsert:
+    case SpvOpBitFieldSExtract:
+    case SpvOpBitFieldUExtract:
+    case SpvOpIEqual:
+    case SpvOpINotEqual:
+    case SpvOpSLessThan:
+    case SpvOpSGreaterThanEqual:
+    case SpvOpULessThan:
+    case SpvOpUGreaterThanEqual:
+    case SpvOpFOrdEqual:
+    case SpvOpFOrdNotEqual:
+    case SpvOpFOrdLessThan:
+    case SpvOpFOrdLessThanEqual:
+    case SpvOpFOrdGreaterThan:
+    case SpvOpFOrdGreaterThanEqual:
+    case SpvOpDPdxCoarse:
+    case SpvOpDPdyCoarse:
+    case SpvOpDPdxFine:
+    case SpvOpDPdyFine:
+    case SpvOpExtInst:
+    case SpvOpSampledImage:
+    case SpvOpImageSampleImplicitLod:
+    case SpvOpImageSampleExplicitLod:
+    case SpvOpImageSampleDrefExplicitLod:
+    case SpvOpImageGather:
+    case SpvOpImageDrefGather:
+    case SpvOpImageFetch:
+    case SpvOpImageRead:
+    case SpvOpImageQuerySizeLod:
+    case SpvOpImageQueryLevels:
+    case SpvOpImageTexelPointer:
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+static bool isRelaxableArithmetic(
+    SpvOp op)
+{
+    return op == SpvOpFNegate || op == SpvOpFAdd || op == SpvOpFSub || op == SpvOpFMul ||
+           op == SpvOpFDiv || op == SpvOpDot || op == SpvOpVectorTimesScalar ||
+           op == SpvOpExtInst;
+}
+
+static bool isRelaxableCopy(
+    SpvOp op)
+{
+    // Moves float components around without computing anything
+    return op == SpvOpPhi || op == SpvOpSelect || op == SpvOpVectorShuffle ||
+           op == SpvOpCompositeConstruct || op == SpvOpCompositeExtract ||
+           op == SpvOpCompositeInsert;
+}
+
+static bool isLocalStorage(
+    SpvStorageClass storageClass)
+{
+    return storageClass == SpvStorageClassPrivate || storageClass == SpvStorageClassFunction ||
+           storageClass == SpvStorageClassWorkgroup;
+}
+
+static void findReadVariables(
+    const IlcSpvModule* module,
+    IlcSpvId* baseIds,
+    bool* isRead)
+{
+    const IlcSpvBuffer* varBuffer = &module->buffer[ID_VARIABLES];
+    const IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    const IlcSpvWord* words = codeBuffer->words;
+
+    // Track pointers to memory no other invocation or stage can observe
+    for (unsigned i = 0; i < varBuffer->wordCount; i += varBuffer->words[i] >> SpvWordCountShift) {
+        if ((varBuffer->words[i] & SpvOpCodeMask) == SpvOpVariable &&
+            isLocalStorage(varBuffer->words[i + 3])) {
+            baseIds[varBuffer->words[i + 2]] = varBuffer->words[i + 2];
+        }
+    }
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+
+        if (op == SpvOpVariable && isLocalStorage(words[i + 3])) {
+            baseIds[words[i + 2]] = words[i + 2];
+        } else if (op == SpvOpAccessChain) {
+            baseIds[words[i + 2]] = baseIds[words[i + 3]];
+        }
+    }
+
+    // Any use other than a store destination or an access chain base is a read
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+        unsigned wordCount = words[i] >> SpvWordCountShift;
+
+        if (op == SpvOpVariable) {
+            continue;
+        }
+
+        for (unsigned j = 1; j < wordCount; j++) {
+            IlcSpvId id = words[i + j];
+
+            if (id >= module->currentId || baseIds[id] == 0 || !ilcSpvIsIdWord(&words[i], j) ||
+                (op == SpvOpStore && j == 1) || (op == SpvOpAccessChain && j >= 2 && j <= 3)) {
+                continue;
+            }
+
+            isRead[baseIds[id]] = true;
+        }
+    }
+}
+
+bool ilcSpvIsIdWord(
+    const IlcSpvWord* instr,
+    unsigned wordIndex)
+{
+    // Tell IDs from literals for the instructions we emit
+    switch (instr[0] & SpvOpCodeMask) {
+    case SpvOpName:
+        return wordIndex == 1;
+    case SpvOpFunction:
+        return wordIndex != 3;
+    case SpvOpVariable:
+        return wordIndex != 3;
+    case SpvOpLoad:
+        return wordIndex <= 3;
+    case SpvOpStore:
+        return wordIndex <= 2;
+    case SpvOpSelectionMerge:
+        return wordIndex == 1;
+    case SpvOpLoopMerge:
+        return wordIndex <= 2;
+    case SpvOpBranchConditional:
+        return wordIndex <= 3;
+    case SpvOpSwitch:
+        return wordIndex <= 2 || (wordIndex % 2) == 0;
+    case SpvOpVectorShuffle:
+    case SpvOpCompositeInsert:
+        return wordIndex <= 4;
+    case SpvOpCompositeExtract:
+        return wordIndex <= 3;
+    case SpvOpExtInst:
+        return wordIndex != 4;
+    case SpvOpImageSampleImplicitLod:
+    case SpvOpImageSampleExplicitLod:
+    case SpvOpImageSampleProjImplicitLod:
+    case SpvOpImageSampleProjExplicitLod:
+    case SpvOpImageFetch:
+    case SpvOpImageRead:
+        return wordIndex != 5;
+    case SpvOpImageSampleDrefImplicitLod:
+    case SpvOpImageSampleDrefExplicitLod:
+    case SpvOpImageSampleProjDrefImplicitLod:
+    case SpvOpImageSampleProjDrefExplicitLod:
+    case SpvOpImageGather:
+    case SpvOpImageDrefGather:
+        return wordIndex != 6;
+    case SpvOpImageWrite:
+        return wordIndex != 4;
+    }
+
+    return true;
+}
+
+void ilcSpvPromoteVariables(
+    IlcSpvModule* module,
+    unsigned varCount,
+    IlcSpvId* varIds)
+{
+    IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    Promoter promoter = {
+        .module = module,
+        .words = codeBuffer->words,
+        .idCount = module->currentId,
+        .varIndices = calloc(module->currentId, sizeof(unsigned)),
+        .valueIds = calloc(module->currentId, sizeof(IlcSpvId)),
+        .blockIndices = calloc(module->currentId, sizeof(unsigned)),
+        .varCount = varCount,
+        .vars = malloc(varCount * sizeof(Variable)),
+        .blockCount = 0,
+        .blocks = NULL,
+        .phiCount = 0,
+        .phis = NULL,
+        .setWordCount = (varCount + 31) / 32,
+    };
+
+    for (unsigned i = 0; i < varCount; i++) {
+        promoter.varIndices[varIds[i]] = i + 1;
+        promoter.vars[i] = (Variable) {
+            .id = varIds[i],
+            .typeId = 0,
+            .nullId = 0,
+            .funcIndex = 0,
+            .isPromotable = true,
+        };
+    }
+
+    if (!checkVariables(&promoter, codeBuffer->wordCount)) {
+        free(promoter.varIndices);
+        free(promoter.valueIds);
+        free(promoter.blockIndices);
+        free(promoter.vars);
+        return;
+    }
+
+    // Rebuild the code, one function at a time
+    IlcSpvBuffer buffer = { 0, 0, NULL };
+    const IlcSpvWord* words = codeBuffer->words;
+    unsigned funcIndex = 0;
+    unsigned beginWordIndex = 0;
+
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+
+        if (op == SpvOpFunction) {
+            funcIndex++;
+            putInstr(&promoter, &buffer, &words[i]);
+            beginWordIndex = i + (words[i] >> SpvWordCountShift);
+        } else if (op == SpvOpFunctionEnd) {
+            promoteFunction(&promoter, &buffer, funcIndex, beginWordIndex, i);
+            putInstr(&promoter, &buffer, &words[i]);
+            beginWordIndex = 0;
+        } else if (beginWordIndex == 0) {
+            putInstr(&promoter, &buffer, &words[i]);
+        }
+    }
+
+    bool* isRemoved = calloc(module->currentId, sizeof(bool));
+    for (unsigned i = 0; i < varCount; i++) {
+        if (promoter.vars[i].isPromotable) {
+            isRemoved[varIds[i]] = true;
+            varIds[i] = 0;
+        }
+    }
+
+    removeInstructions(&module->buffer[ID_VARIABLES], SpvOpVariable, 2, isRemoved);
+    removeInstructions(&module->buffer[ID_DEBUG], SpvOpName, 1, isRemoved);
+    free(isRemoved);
+
+    free(codeBuffer->words);
+    *codeBuffer = buffer;
+
+    free(promoter.varIndices);
+    free(promoter.valueIds);
+    free(promoter.blockIndices);
+    free(promoter.vars);
+}
+
+void ilcSpvEliminateDeadCode(
+    IlcSpvModule* module)
+{
+    IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    IlcSpvWord* words = codeBuffer->words;
+    unsigned idCount = module->currentId;
+    IlcSpvId* baseIds = calloc(idCount, sizeof(IlcSpvId)); // Local variable by pointer ID
+    bool* isRead = calloc(idCount, sizeof(bool));
+    unsigned* defIndices = calloc(idCount, sizeof(unsigned)); // Word index + 1 by result ID
+    bool* isLive = calloc(codeBuffer->wordCount, sizeof(bool)); // By word index
+    unsigned* liveIndices = malloc(codeBuffer->wordCount * sizeof(unsigned));
+    unsigned liveCount = 0;
+
+    findReadVariables(module, baseIds, isRead);
+
+    // Everything with side effects is live, except stores to memory that is never read
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+
+        if (isPure(op)) {
+            defIndices[words[i + 2]] = i + 1;
+        } else if (op != SpvOpStore || baseIds[words[i + 1]] == 0 ||
+                   isRead[baseIds[words[i + 1]]]) {
+            isLive[i] = true;
+            liveIndices[liveCount] = i;
+            liveCount++;
+        }
+    }
+
+    // Propagate liveness to the operand definitions
+    while (liveCount > 0) {
+        liveCount--;
+        unsigned i = liveIndices[liveCount];
+        unsigned wordCount = words[i] >> SpvWordCountShift;
+
+        for (unsigned j = 1; j < wordCount; j++) {
+            IlcSpvId id = words[i + j];
+
+            if (id >= idCount || defIndices[id] == 0 || isLive[defIndices[id] - 1] ||
+                !ilcSpvIsIdWord(&words[i], j)) {
+                continue;
+            }
+
+            isLive[defIndices[id] - 1] = true;
+            liveIndices[liveCount] = defIndices[id] - 1;
+            liveCount++;
+        }
+    }
+
+    unsigned wordCount = 0;
+    unsigned removedCount = 0;
+    bool* isRemoved = calloc(idCount, sizeof(bool));
+    for (unsigned i = 0; i < codeBuffer->wordCount; ) {
+        unsigned instrWordCount = words[i] >> SpvWordCountShift;
+
+        if (isLive[i]) {
+            memmove(&words[wordCount], &words[i], instrWordCount * sizeof(IlcSpvWord));
+            wordCount += instrWordCount;
+        } else {
+            if (isPure(words[i] & SpvOpCodeMask)) {
+                isRemoved[words[i + 2]] = true;
+            }
+            removedCount++;
+        }
+
+        i += instrWordCount;
+    }
+
+    LOGV("removed %u dead instructions\n", removedCount);
+    codeBuffer->wordCount = wordCount;
+
+    // Decorations can't target removed values
+    removeInstructions(&module->buffer[ID_DECORATIONS], SpvOpDecorate, 1, isRemoved);
+
+    free(isRemoved);
+    free(baseIds);
+    free(isRead);
+    free(defIndices);
+    free(isLive);
+    free(liveIndices);
+}
+
+void ilcSpvRemoveUnusedVariables(
+    IlcSpvModule* module,
+    unsigned varCount,
+    IlcSpvId* varIds)
+{
+    const IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    const IlcSpvWord* words = codeBuffer->words;
+    bool* isUsed = calloc(module->currentId, sizeof(bool));
+    bool* isRemoved = calloc(module->currentId, sizeof(bool));
+
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        unsigned wordCount = words[i] >> SpvWordCountShift;
+
+        for (unsigned j = 1; j < wordCount; j++) {
+            if (words[i + j] < module->currentId && ilcSpvIsIdWord(&words[i], j)) {
+                isUsed[words[i + j]] = true;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < varCount; i++) {
+        if (!isUsed[varIds[i]]) {
+            isRemoved[varIds[i]] = true;
+            varIds[i] = 0;
+        }
+    }
+
+    removeInstructions(&module->buffer[ID_VARIABLES], SpvOpVariable, 2, isRemoved);
+    removeInstructions(&module->buffer[ID_DEBUG], SpvOpName, 1, isRemoved);
+    removeInstructions(&module->buffer[ID_DECORATIONS], SpvOpDecorate, 1, isRemoved);
+
+    free(isUsed);
+    free(isRemoved);
+}
+
+void ilcSpvFoldInstructions(
+    IlcSpvModule* module)
+{
+    IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    IlcSpvWord* words = codeBuffer->words;
+    unsigned idCount = module->currentId;
+    IlcSpvId* replacementIds = calloc(idCount, sizeof(IlcSpvId));
+    unsigned wordCount = 0;
+    unsigned foldedCount = 0;
+
+    // Definitions come before their uses, except for phi operands
+    for (unsigned i = 0; i < codeBuffer->wordCount; ) {
+        IlcSpvWord* instr = &words[i];
+        SpvOp op = instr[0] & SpvOpCodeMask;
+        unsigned instrWordCount = instr[0] >> SpvWordCountShift;
+
+        i += instrWordCount;
+
+        for (unsigned j = 1; j < instrWordCount; j++) {
+            if (instr[j] < idCount && replacementIds[instr[j]] != 0 && ilcSpvIsIdWord(instr, j)) {
+                instr[j] = replacementIds[instr[j]];
+            }
+        }
+
+        if (isPure(op)) {
+            IlcSpvId id = ilcSpvFoldInstruction(module, instr);
+
+            if (id != 0) {
+                replacementIds[instr[2]] = id;
+                foldedCount++;
+                continue;
+            }
+        }
+
+        memmove(&words[wordCount], instr, instrWordCount * sizeof(IlcSpvWord));
+        wordCount += instrWordCount;
+    }
+
+    codeBuffer->wordCount = wordCount;
+
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        if ((words[i] & SpvOpCodeMask) != SpvOpPhi) {
+            continue;
+        }
+
+        for (unsigned j = 3; j < (words[i] >> SpvWordCountShift); j += 2) {
+            if (words[i + j] < idCount && replacementIds[words[i + j]] != 0) {
+                words[i + j] = replacementIds[words[i + j]];
+            }
+        }
+    }
+
+    // Decorations can't target folded values
+    if (foldedCount > 0) {
+        bool* isRemoved = calloc(idCount, sizeof(bool));
+        for (unsigned i = 0; i < idCount; i++) {
+            isRemoved[i] = replacementIds[i] != 0;
+        }
+        removeInstructions(&module->buffer[ID_DECORATIONS], SpvOpDecorate, 1, isRemoved);
+        free(isRemoved);
+    }
+
+    LOGV("folded %u instructions\n", foldedCount);
+    free(replacementIds);
+}
+
+void ilcSpvRelaxPrecision(
+    IlcSpvModule* module,
+    unsigned outputCount,
+    const IlcSpvId* outputIds)
+{
+    const IlcSpvBuffer* typeBuffer = &module->buffer[ID_TYPES];
+    const IlcSpvBuffer* decorationBuffer = &module->buffer[ID_DECORATIONS];
+    const IlcSpvBuffer* codeBuffer = &module->buffer[ID_CODE];
+    const IlcSpvWord* words = codeBuffer->words;
+    unsigned idCount = module->currentId;
+    bool* isFloatType = calloc(idCount, sizeof(bool));
+    bool* isOutputPointer = calloc(idCount, sizeof(bool));
+    unsigned* defIndices = calloc(idCount, sizeof(unsigned)); // Word index + 1 of candidates
+    bool* isStrict = calloc(idCount, sizeof(bool)); // Must keep full precision
+    IlcSpvId* strictIds = malloc(idCount * sizeof(IlcSpvId));
+    unsigned strictCount = 0;
+
+    for (unsigned i = 0; i < typeBuffer->wordCount;
+         i += typeBuffer->words[i] >> SpvWordCountShift) {
+        const IlcSpvWord* instr = &typeBuffer->words[i];
+        SpvOp op = instr[0] & SpvOpCodeMask;
+
+        if ((op == SpvOpTypeFloat && instr[2] == 32) ||
+            (op == SpvOpTypeVector && isFloatType[instr[2]])) {
+            isFloatType[instr[1]] = true;
+        }
+    }
+    for (unsigned i = 0; i < outputCount; i++) {
+        isOutputPointer[outputIds[i]] = true;
+    }
+    for (unsigned i = 0; i < decorationBuffer->wordCount;
+         i += decorationBuffer->words[i] >> SpvWordCountShift) {
+        const IlcSpvWord* instr = &decorationBuffer->words[i];
+
+        if ((instr[0] & SpvOpCodeMask) == SpvOpDecorate &&
+            instr[2] == SpvDecorationNoContraction) {
+            isStrict[instr[1]] = true;
+        }
+    }
+
+    // Candidates are float values, other results are strict
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+
+        if (op == SpvOpAccessChain && isOutputPointer[words[i + 3]]) {
+            isOutputPointer[words[i + 2]] = true;
+        } else if ((isRelaxableArithmetic(op) || isRelaxableCopy(op)) &&
+                   isFloatType[words[i + 1]] && !isStrict[words[i + 2]]) {
+            defIndices[words[i + 2]] = i + 1;
+        }
+    }
+
+    // Any use other than by a candidate or a store to a color output makes a candidate strict
+    for (unsigned i = 0; i < codeBuffer->wordCount; i += words[i] >> SpvWordCountShift) {
+        SpvOp op = words[i] & SpvOpCodeMask;
+        unsigned wordCount = words[i] >> SpvWordCountShift;
+        bool isCandidate = (isRelaxableArithmetic(op) || isRelaxableCopy(op)) &&
+                           defIndices[words[i + 2]] != 0;
+
+        if (isCandidate || (op == SpvOpStore && isOutputPointer[words[i + 1]])) {
+            continue;
+        }
+
+        for (unsigned j = 1; j < wordCount; j++) {
+            IlcSpvId id = words[i + j];
+
+            if (id < idCount && defIndices[id] != 0 && !isStrict[id] &&
+                ilcSpvIsIdWord(&words[i], j)) {
+                isStrict[id] = true;
+                strictIds[strictCount] = id;
+                strictCount++;
+            }
+        }
+    }
+
+    // Operands of strict values are strict too
+    while (strictCount > 0) {
+        strictCount--;
+        const IlcSpvWord* instr = &words[defIndices[strictIds[strictCount]] - 1];
+        unsigned wordCount = instr[0] >> SpvWordCountShift;
+
+        for (unsigned j = 3; j < wordCount; j++) {
+            IlcSpvId id = instr[j];
+
+            if (id < idCount && defIndices[id] != 0 && !isStrict[id] &&
+                ilcSpvIsIdWord(instr, j)) {
+                isStrict[id] = true;
+                strictIds[strictCount] = id;
+                strictCount++;
+            }
+        }
+    }
+
+    unsigned relaxedCount = 0;
+    for (IlcSpvId id = 0; id < idCount; id++) {
+        if (defIndices[id] != 0 && !isStrict[id] &&
+            isRelaxableArithmetic(words[defIndices[id] - 1] & SpvOpCodeMask)) {
+            ilcSpvPutDecoration(module, id, SpvDecorationRelaxedPrecision, 0, NULL);
+            relaxedCount++;
+        }
+    }
+
+    LOGV("relaxed %u instructions\n", relaxedCount);
+    free(isFloatType);
+    free(isOutputPointer);
+    free(defIndices);
+    free(isStrict);
+    free(strictIds);
+}
@@ -1,44 +1,184 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "amdilc.h"
 #include "logger.h"
 
+typedef struct {
+    unsigned fileCount;
+    char** fileNames;
+    volatile LONG nextFileIndex;
+    volatile LONG failedCount;
+} Batch;
+
+static void addFile(
+    Batch* batch,
+    const char* fileName)
+{
+    batch->fileCount++;
+    batch->fileNames = realloc(batch->fileNames, batch->fileCount * sizeof(char*));
+    batch->fileNames[batch->fileCount - 1] = strdup(fileName);
+}
+
+static bool addDirectory(
+    Batch* batch,
+    const char* path)
+{
+    char pattern[MAX_PATH];
+    WIN32_FIND_DATAA findData;
+
+    snprintf(pattern, sizeof(pattern), "%s\\*.bin", path);
+    HANDLE find = FindFirstFileA(pattern, &findData);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    do {
+        const char* name = findData.cFileName;
+        size_t len = strlen(name);
+
+        // Skip SPIR-V dumps, keep IL dumps and raw IL binaries
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+            (len >= 8 && strcmp(&name[len - 8], "_spv.bin") == 0)) {
+            continue;
+        }
+
+        char fileName[MAX_PATH];
+        snprintf(fileName, sizeof(fileName), "%s\\%s", path, name);
+        addFile(batch, fileName);
+    } while (FindNextFileA(find, &findData));
+
+    FindClose(find);
+    return true;
+}
+
+static bool compileFile(
+    const char* fileName)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL) {
+        LOGE("failed to open %s\n", fileName);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    int size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* data = malloc(size);
+    fread(data, 1, size, file);
+    fclose(file);
+
+    IlcShader shader = ilcCompileShader(data, size, ILC_HINT_DEFAULT);
+
+    free(shader.code);
+    free(shader.bindings);
+    free(shader.inputs);
+    free(shader.name);
+    free(data);
+    return true;
+}
+
+static DWORD WINAPI compileThread(
+    LPVOID param)
+{
+    Batch* batch = param;
+
+    // Pull files until the list is exhausted
+    for (;;) {
+        unsigned i = InterlockedIncrement(&batch->nextFileIndex) - 1;
+        if (i >= batch->fileCount) {
+            break;
+        }
+
+        LOGI("compiling %s... (%d/%d)\n", batch->fileNames[i], i + 1, batch->fileCount);
+        if (!compileFile(batch->fileNames[i])) {
+            InterlockedIncrement(&batch->failedCount);
+        }
+    }
+
+    return 0;
+}
+
+static unsigned getProcessorCount()
+{
+    SYSTEM_INFO systemInfo;
+
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwNumberOfProcessors;
+}
+
 int main(int argc, char* argv[])
 {
     logInit("", "");
 
-    if (argc < 2) {
+    const char* cachePath = NULL;
+    unsigned threadCount = getProcessorCount();
+    Batch batch = { 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            cachePath = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            return ilcExtractShaderDumps(argv[++i]) ? 0 : 1;
+        } else if (!addDirectory(&batch, argv[i])) {
+            addFile(&batch, argv[i]);
+        }
+    }
+
+    if (batch.fileCount == 0) {
         LOGE("GRVK's amdilc -> SPIR-V offline compiler\n");
-        LOGE("usage: GRVK_DUMP_SHADERS=1 %s [IL binary] ...\n", argv[0]);
+        LOGE("usage: %s [-j threads] [-o cache directory] [IL binary | directory] ...\n", argv[0]);
+        LOGE("       %s -x dump archive\n", argv[0]);
+        LOGE("directories are scanned for *.bin files, excluding *_spv.bin dumps\n");
+        LOGE("-o packs the compiled shaders into the GRVK_SHADER_CACHE_PATH format\n");
+        LOGE("-x unpacks a GRVK_SHADER_DUMP_ARCHIVE file into the working directory\n");
         return 1;
     }
 
-    if (getenv("GRVK_DUMP_SHADERS") == NULL || strcmp(getenv("GRVK_DUMP_SHADERS"), "1") != 0) {
+    const char* dumpValue = getenv("GRVK_DUMP_SHADERS");
+    bool dump = dumpValue != NULL && strcmp(dumpValue, "1") == 0;
+
+    if (cachePath != NULL && dump) {
+        // Dumped shaders carry debug names and are kept out of the cache
+        LOGE("-o can't be used with GRVK_DUMP_SHADERS=1\n");
+        return 1;
+    } else if (cachePath != NULL) {
+        ilcSetShaderCachePath(cachePath);
+    } else if (!dump) {
         LOGW("GRVK_DUMP_SHADERS isn't set. Logs only.\n");
     }
 
-    for (unsigned i = 1; i < argc; i++) {
-        LOGW("compiling %s... (%d/%d)\n", argv[i], i, argc - 1);
+    if (threadCount == 0 || threadCount > batch.fileCount) {
+        threadCount = batch.fileCount;
+    }
 
-        FILE* file = fopen(argv[i], "rb");
-        if (file == NULL) {
-            LOGE("failed to open %s\n", argv[i]);
-            return 1;
-        }
+    HANDLE* threads = malloc(threadCount * sizeof(HANDLE));
 
-        fseek(file, 0, SEEK_END);
-        int size = ftell(file);
-        fseek(file, 0, SEEK_SET);
+    for (unsigned i = 0; i < threadCount; i++) {
+        threads[i] = CreateThread(NULL, 0, compileThread, &batch, 0, NULL);
+    }
 
-        void* data = malloc(size);
-        fread(data, 1, size, file);
-        fclose(file);
+    for (unsigned i = 0; i < threadCount; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    free(threads);
+    ilcFlushShaderDumps();
 
-        ilcCompileShader(data, size);
+    for (unsigned i = 0; i < batch.fileCount; i++) {
+        free(batch.fileNames[i]);
+    }
+    free(batch.fileNames);
 
-        free(data);
+    if (batch.failedCount > 0) {
+        LOGE("%d/%d files failed\n", batch.failedCount, batch.fileCount);
+        return 1;
     }
 
     return 0;
@@ -1,14 +1,50 @@
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "logger.h"
 
 LogLevel gLogLevel = LOG_LEVEL_INFO;
 static FILE* mLogFile = NULL;
+#ifdef _WIN32
 static SRWLOCK mLogLock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t mLogLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void lockLog()
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&mLogLock);
+#else
+    pthread_mutex_lock(&mLogLock);
+#endif
+}
+
+static void unlockLog()
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&mLogLock);
+#else
+    pthread_mutex_unlock(&mLogLock);
+#endif
+}
+
+static unsigned getThreadId()
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return (unsigned)(uintptr_t)pthread_self();
+#endif
+}
 
 static void pickLogLevel()
 {
@@ -61,9 +97,9 @@ void logPrint(
     ...)
 {
     const char* prefixes[] = { "T", "V", "D", "I", "W", "E", "" };
-    unsigned threadId = GetCurrentThreadId();
+    unsigned threadId = getThreadId();
 
-    AcquireSRWLockExclusive(&mLogLock);
+    lockLog();
 
     fprintf(stdout, "%s/%08X/%s: ", prefixes[level], threadId, name);
     if (mLogFile != NULL) {
@@ -79,7 +115,7 @@ void logPrint(
     }
     va_end(argptr);
 
-    ReleaseSRWLockExclusive(&mLogLock);
+    unlockLog();
 }
 
 void logPrintRaw(
@@ -90,7 +126,7 @@ void logPrintRaw(
         return;
     }
 
-    AcquireSRWLockExclusive(&mLogLock);
+    lockLog();
 
     va_list argptr;
     va_start(argptr, format);
@@ -101,6 +137,6 @@ void logPrintRaw(
     }
     va_end(argptr);
 
-    ReleaseSRWLockExclusive(&mLogLock);
+    unlockLog();
 }
 
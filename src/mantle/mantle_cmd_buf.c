@@ -229,17 +229,53 @@ static void grCmdBufferUpdateResources(
     if (dirtyFlags & FLAG_DIRTY_PIPELINE) {
         if (grPipeline->pipeline == VK_NULL_HANDLE) {
             // Assume that the depth-stencil attachment formats never change per pipeline
-            grPipeline->pipeline = grPipelineGetVkPipeline(grPipeline,
+            grPipeline->pipeline = grPipelineGetVkPipeline(grPipeline, false,
                                                            grCmdBuffer->depthFormat,
                                                            grCmdBuffer->stencilFormat);
         }
 
         VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipeline);
+        grCmdBuffer->isRectanglePipelineBound = false;
     }
 
     bindPoint->dirtyFlags = 0;
 }
 
+static bool grCmdBufferBindRectanglePipeline(
+    GrCmdBuffer* grCmdBuffer,
+    bool expandRectangles)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    GrPipeline* grPipeline = grCmdBuffer->bindPoints[VK_PIPELINE_BIND_POINT_GRAPHICS].grPipeline;
+
+    if (expandRectangles && grPipeline->rectanglePipeline == VK_NULL_HANDLE) {
+        if (grPipeline->isRectanglePipelineInvalid) {
+            // Already failed once, keep using the geometry shader path
+            expandRectangles = false;
+        } else {
+            grPipeline->rectanglePipeline = grPipelineGetVkPipeline(grPipeline, true,
+                                                                    grCmdBuffer->depthFormat,
+                                                                    grCmdBuffer->stencilFormat);
+
+            if (grPipeline->rectanglePipeline == VK_NULL_HANDLE) {
+                LOGW("failed to create rectangle pipeline for %p, using geometry shader\n",
+                     grPipeline);
+                grPipeline->isRectanglePipelineInvalid = true;
+                expandRectangles = false;
+            }
+        }
+    }
+
+    if (expandRectangles != grCmdBuffer->isRectanglePipelineBound) {
+        VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              expandRectangles ? grPipeline->rectanglePipeline
+                                               : grPipeline->pipeline);
+        grCmdBuffer->isRectanglePipelineBound = expandRectangles;
+    }
+
+    return expandRectangles;
+}
+
 // Command Buffer Building Functions
 
 GR_VOID GR_STDCALL grCmdBindPipeline(
@@ -677,6 +713,13 @@ GR_VOID GR_STDCALL grCmdDraw(
 #endif
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+    if (grCmdBuffer->bindPoints[0].grPipeline->createInfo->rectangleVertexShaderModule !=
+        VK_NULL_HANDLE && grCmdBufferBindRectanglePipeline(grCmdBuffer, true)) {
+        // Expanded rectangles take 6 vertices instead of 3
+        vertexCount = vertexCount / 3 * 6;
+    }
+
     grCmdBufferBeginRenderPass(grCmdBuffer);
 
     VKD.vkCmdDraw(grCmdBuffer->commandBuffer,
@@ -704,6 +747,7 @@ GR_VOID GR_STDCALL grCmdDrawIndexed(
 #endif
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    grCmdBufferBindRectanglePipeline(grCmdBuffer, false);
     grCmdBufferBeginRenderPass(grCmdBuffer);
 
     VKD.vkCmdDrawIndexed(grCmdBuffer->commandBuffer,
@@ -728,6 +772,7 @@ GR_VOID GR_STDCALL grCmdDrawIndirect(
 #endif
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    grCmdBufferBindRectanglePipeline(grCmdBuffer, false);
     grCmdBufferBeginRenderPass(grCmdBuffer);
 
     VKD.vkCmdDrawIndirect(grCmdBuffer->commandBuffer, grGpuMemory->buffer, offset, 1, 0);
@@ -751,6 +796,7 @@ GR_VOID GR_STDCALL grCmdDrawIndexedIndirect(
 #endif
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    grCmdBufferBindRectanglePipeline(grCmdBuffer, false);
     grCmdBufferBeginRenderPass(grCmdBuffer);
 
     VKD.vkCmdDrawIndexedIndirect(grCmdBuffer->commandBuffer, grGpuMemory->buffer, offset, 1, 0);
@@ -4,6 +4,13 @@
 #define NVIDIA_VENDOR_ID 0x10de
 #define INVALID_QUEUE_INDEX (~0u)
 
+static bool isRectangleExpansionEnabled()
+{
+    const char* envValue = getenv("GRVK_EXPAND_RECT_LISTS");
+
+    return envValue != NULL && strcmp(envValue, "1") == 0;
+}
+
 static char* getGrvkEngineName(
     const GR_CHAR* engineName)
 {
@@ -498,6 +505,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
     uint32_t dmaQueueFamilyIndex = INVALID_QUEUE_INDEX;
     uint32_t dmaQueueIndex = 0;
     uint32_t driverVersion;
+    bool expandRectangles = isRectangleExpansionEnabled();
 
     const VkPhysicalDeviceProperties* props = &grPhysicalGpu->physicalDeviceProps;
 
@@ -520,6 +528,24 @@ GR_RESULT GR_STDCALL grCreateDevice(
          VK_VERSION_MINOR(driverVersion),
          VK_VERSION_PATCH(driverVersion));
 
+    if (expandRectangles) {
+        VkPhysicalDeviceVulkan11Features supportedVulkan11Features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+            .pNext = NULL,
+        };
+        VkPhysicalDeviceFeatures2 supportedFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &supportedVulkan11Features,
+        };
+
+        vki.vkGetPhysicalDeviceFeatures2(grPhysicalGpu->physicalDevice, &supportedFeatures);
+
+        if (!supportedVulkan11Features.shaderDrawParameters) {
+            LOGW("shaderDrawParameters is unsupported, disabling rectangle expansion\n");
+            expandRectangles = false;
+        }
+    }
+
     uint32_t vkQueueFamilyPropertyCount = 0;
     vki.vkGetPhysicalDeviceQueueFamilyProperties(grPhysicalGpu->physicalDevice,
                                                  &vkQueueFamilyPropertyCount, NULL);
@@ -665,9 +691,15 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .samplerMirrorClampToEdge = VK_TRUE,
         .separateDepthStencilLayouts = VK_TRUE,
     };
+    // Rectangle expansion reads the BaseVertex built-in
+    VkPhysicalDeviceVulkan11Features vulkan11DeviceFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+        .pNext = &vulkan12DeviceFeatures,
+        .shaderDrawParameters = expandRectangles,
+    };
     VkPhysicalDeviceFeatures2 deviceFeatures = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-        .pNext = &vulkan12DeviceFeatures,
+        .pNext = &vulkan11DeviceFeatures,
         .features = {
             .imageCubeArray = VK_TRUE,
             .independentBlend = VK_TRUE,
@@ -769,6 +801,17 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .computeAtomicCounterBuffer = VK_NULL_HANDLE, // Initialized below
         .computeAtomicCounterSet = VK_NULL_HANDLE, // Initialized below
         .grBorderColorPalette = NULL,
+        .pendingCompileLock = SRWLOCK_INIT,
+        .pendingCompileCond = CONDITION_VARIABLE_INIT,
+        .pendingCompileCount = 0,
+        .expandRectangles = expandRectangles,
+        .controlFlowHints =
+            (quirkHas(QUIRK_SHADER_DONT_UNROLL_LOOPS) ? ILC_HINT_DONT_UNROLL : ILC_HINT_UNROLL) |
+            (quirkHas(QUIRK_SHADER_DONT_FLATTEN_BRANCHES) ? ILC_HINT_DONT_FLATTEN
+                                                          : ILC_HINT_FLATTEN),
+        .rectangleShaderModuleLock = SRWLOCK_INIT,
+        .rectangleShaderModuleCount = 0,
+        .rectangleShaderModules = NULL,
     };
 
     memcpy(grDevice->memoryHeapMap, memoryHeapMap, memoryHeapCount * sizeof(uint32_t));
@@ -830,6 +873,17 @@ GR_RESULT GR_STDCALL grDestroyDevice(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
+    // Compile callbacks still create shader modules on the device
+    AcquireSRWLockExclusive(&grDevice->pendingCompileLock);
+    while (grDevice->pendingCompileCount > 0) {
+        SleepConditionVariableSRW(&grDevice->pendingCompileCond, &grDevice->pendingCompileLock,
+                                  INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&grDevice->pendingCompileLock);
+
+    // Don't lose the shaders still queued for dumping if the game exits right after
+    ilcFlushShaderDumps();
+
     VKD.vkDestroyDescriptorSetLayout(grDevice->device, grDevice->atomicCounterSetLayout, NULL);
     if (grDevice->grUniversalQueue) {
         free(grDevice->grUniversalQueue->globalMemRefs);
@@ -852,6 +906,14 @@ GR_RESULT GR_STDCALL grDestroyDevice(
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grDmaQueue->commandPool, NULL);
     }
 
+    for (unsigned i = 0; i < grDevice->rectangleShaderModuleCount; i++) {
+        RectangleShaderModule* rectangleShaderModule = &grDevice->rectangleShaderModules[i];
+
+        VKD.vkDestroyShaderModule(grDevice->device, rectangleShaderModule->shaderModule, NULL);
+        free(rectangleShaderModule->inputs);
+    }
+    free(grDevice->rectangleShaderModules);
+
     if (!quirkHas(QUIRK_KEEP_VK_DEVICE)) {
         VKD.vkDestroyDevice(grDevice->device, NULL);
     }
@@ -116,6 +116,7 @@ typedef struct _PipelineCreateInfo
     VkColorComponentFlags colorWriteMasks[GR_MAX_COLOR_TARGETS];
     VkFormat depthFormat;
     VkFormat stencilFormat;
+    VkShaderModule rectangleVertexShaderModule; // Expands RECT_LIST rectangles, if not null
 } PipelineCreateInfo;
 
 typedef struct _UpdateTemplateSlot {
@@ -128,6 +129,17 @@ typedef struct _UpdateTemplateSlot {
     unsigned strideSlotIndexes[MAX_STRIDES];
 } UpdateTemplateSlot;
 
+typedef struct _LinkedShaderModule {
+    uint32_t outputMask;
+    VkShaderModule shaderModule;
+} LinkedShaderModule;
+
+typedef struct _RectangleShaderModule {
+    unsigned inputCount;
+    IlcInput* inputs;
+    VkShaderModule shaderModule;
+} RectangleShaderModule;
+
 // Base object
 typedef struct _GrBaseObject {
     GrObjectType grObjType;
@@ -163,6 +175,7 @@ typedef struct _GrCmdBuffer {
     GrFence* submitFence;
     // Graphics and compute bind points
     BindPoint bindPoints[2];
+    bool isRectanglePipelineBound;
     // Graphics dynamic state
     GrViewportStateObject* grViewportState;
     GrRasterStateObject* grRasterState;
@@ -244,6 +257,14 @@ typedef struct _GrDevice {
     VkDescriptorPool computeAtomicCounterPool;
     VkDescriptorSet computeAtomicCounterSet;
     GrBorderColorPalette* grBorderColorPalette;
+    SRWLOCK pendingCompileLock;
+    CONDITION_VARIABLE pendingCompileCond;
+    unsigned pendingCompileCount; // Shaders still compiling on the thread pool
+    bool expandRectangles; // Draw RECT_LIST without a geometry shader when possible
+    IlcControlFlowHints controlFlowHints; // Passed to every shader compile
+    SRWLOCK rectangleShaderModuleLock;
+    unsigned rectangleShaderModuleCount;
+    RectangleShaderModule* rectangleShaderModules; // Shared by pixel shader input signature
 } GrDevice;
 
 typedef struct _GrEvent {
@@ -302,6 +323,8 @@ typedef struct _GrPipeline {
     PipelineCreateInfo* createInfo;
     bool hasTessellation;
     VkPipeline pipeline;
+    VkPipeline rectanglePipeline; // Used by non-indexed draws, see grCmdDraw
+    bool isRectanglePipelineInvalid;
     VkPipelineLayout pipelineLayout;
     unsigned stageCount;
     VkDescriptorSetLayout descriptorSetLayout;
@@ -334,11 +357,19 @@ typedef struct _GrSampler {
 typedef struct _GrShader {
     GrObject grObj;
     unsigned refCount;
+    SRWLOCK compileLock;
+    PTP_WORK compileWork; // NULL once compiled
+    void* ilCode; // Freed once compiled, unless kept for linking
+    unsigned ilCodeSize;
+    VkResult compileResult;
     VkShaderModule shaderModule;
     unsigned bindingCount;
     IlcBinding* bindings;
     unsigned inputCount;
     IlcInput* inputs;
+    uint32_t outputMask;
+    unsigned linkedShaderModuleCount;
+    LinkedShaderModule* linkedShaderModules; // Variants without the outputs the next stage ignores
     char* name;
 } GrShader;
 
@@ -379,8 +410,12 @@ void grCmdBufferEndRenderPass(
 void grCmdBufferResetState(
     GrCmdBuffer* grCmdBuffer);
 
+VkResult grShaderWait(
+    GrShader* grShader);
+
 VkPipeline grPipelineGetVkPipeline(
     const GrPipeline* grPipeline,
+    bool expandRectangles,
     VkFormat depthFormat,
     VkFormat stencilFormat);
 
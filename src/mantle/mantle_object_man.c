@@ -82,8 +82,11 @@ GR_RESULT GR_STDCALL grDestroyObject(
             }
         }
 
+        VKD.vkDestroyShaderModule(grDevice->device,
+                                  grPipeline->createInfo->rectangleVertexShaderModule, NULL);
         free(grPipeline->createInfo);
         VKD.vkDestroyPipeline(grDevice->device, grPipeline->pipeline, NULL);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->rectanglePipeline, NULL);
         VKD.vkDestroyPipelineLayout(grDevice->device, grPipeline->pipelineLayout, NULL);
         VKD.vkDestroyDescriptorSetLayout(grDevice->device, grPipeline->descriptorSetLayout, NULL);
         for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
@@ -114,9 +117,16 @@ GR_RESULT GR_STDCALL grDestroyObject(
             return GR_SUCCESS;
         }
 
+        grShaderWait(grShader);
         VKD.vkDestroyShaderModule(grDevice->device, grShader->shaderModule, NULL);
+        for (unsigned i = 0; i < grShader->linkedShaderModuleCount; i++) {
+            VKD.vkDestroyShaderModule(grDevice->device,
+                                      grShader->linkedShaderModules[i].shaderModule, NULL);
+        }
+        free(grShader->ilCode);
         free(grShader->bindings);
         free(grShader->inputs);
+        free(grShader->linkedShaderModules);
         free(grShader->name);
     }   break;
     case GR_OBJ_TYPE_QUERY_POOL: {
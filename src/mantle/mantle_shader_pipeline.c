@@ -419,6 +419,7 @@ static VkPipelineLayout getVkPipelineLayout(
 
 VkPipeline grPipelineGetVkPipeline(
     const GrPipeline* grPipeline,
+    bool expandRectangles,
     VkFormat depthFormat,
     VkFormat stencilFormat)
 {
@@ -427,6 +428,32 @@ VkPipeline grPipelineGetVkPipeline(
     VkPipeline vkPipeline = VK_NULL_HANDLE;
     VkResult vkRes;
 
+    unsigned stageCount = createInfo->stageCount;
+    const VkPipelineShaderStageCreateInfo* stageCreateInfos = createInfo->stageCreateInfos;
+    VkPipelineShaderStageCreateInfo rectangleStageCreateInfos[MAX_STAGE_COUNT];
+
+    if (expandRectangles) {
+        // Swap the rectangle geometry shader for the expanding vertex shader
+        stageCount = 0;
+        stageCreateInfos = rectangleStageCreateInfos;
+
+        for (unsigned i = 0; i < createInfo->stageCount; i++) {
+            const VkPipelineShaderStageCreateInfo* stageCreateInfo =
+                &createInfo->stageCreateInfos[i];
+
+            if (stageCreateInfo->stage == VK_SHADER_STAGE_GEOMETRY_BIT) {
+                continue;
+            }
+
+            rectangleStageCreateInfos[stageCount] = *stageCreateInfo;
+            if (stageCreateInfo->stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                rectangleStageCreateInfos[stageCount].module =
+                    createInfo->rectangleVertexShaderModule;
+            }
+            stageCount++;
+        }
+    }
+
     const VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .pNext = NULL,
@@ -441,7 +468,7 @@ VkPipeline grPipelineGetVkPipeline(
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .topology = createInfo->topology,
+        .topology = expandRectangles ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : createInfo->topology,
         .primitiveRestartEnable = VK_FALSE,
     };
 
@@ -591,8 +618,8 @@ VkPipeline grPipelineGetVkPipeline(
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = &renderingCreateInfo,
         .flags = createInfo->createFlags,
-        .stageCount = createInfo->stageCount,
-        .pStages = createInfo->stageCreateInfos,
+        .stageCount = stageCount,
+        .pStages = stageCreateInfos,
         .pVertexInputState = &vertexInputStateCreateInfo,
         .pInputAssemblyState = &inputAssemblyStateCreateInfo,
         .pTessellationState = &tessellationStateCreateInfo,
@@ -618,20 +645,24 @@ VkPipeline grPipelineGetVkPipeline(
     return vkPipeline;
 }
 
-// Shader and Pipeline Functions
-
-GR_RESULT GR_STDCALL grCreateShader(
-    GR_DEVICE device,
-    const GR_SHADER_CREATE_INFO* pCreateInfo,
-    GR_SHADER* pShader)
+static void compileShader(
+    GrShader* grShader)
 {
-    LOGT("%p %p %p\n", device, pCreateInfo, pShader);
-    GrDevice* grDevice = (GrDevice*)device;
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grShader);
     VkShaderModule vkShaderModule = VK_NULL_HANDLE;
 
-    // ALLOW_RE_Z flag doesn't have a Vulkan equivalent. RADV determines it automatically.
-
-    IlcShader ilcShader = ilcCompileShader(pCreateInfo->pCode, pCreateInfo->codeSize);
+    IlcShader ilcShader = ilcCompileShader(grShader->ilCode, grShader->ilCodeSize,
+                                           grDevice->controlFlowHints);
+
+    // Keep the IL code of shaders with generic outputs to link them with the next stage later,
+    // and of vertex shaders that may have to expand rectangles. Overridden shaders are used as-is
+    if (ilcShader.isOverridden ||
+        (ilcShader.outputMask == 0 &&
+         !(grDevice->expandRectangles &&
+           ilcIsVertexShader(grShader->ilCode, grShader->ilCodeSize)))) {
+        free(grShader->ilCode);
+        grShader->ilCode = NULL;
+    }
 
     const VkShaderModuleCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -648,23 +679,289 @@ GR_RESULT GR_STDCALL grCreateShader(
         free(ilcShader.bindings);
         free(ilcShader.inputs);
         free(ilcShader.name);
-        return getGrResult(res);
+        grShader->compileResult = res;
+        return;
     }
 
     free(ilcShader.code);
 
+    grShader->compileResult = VK_SUCCESS;
+    grShader->shaderModule = vkShaderModule;
+    grShader->bindingCount = ilcShader.bindingCount;
+    grShader->bindings = ilcShader.bindings;
+    grShader->inputCount = ilcShader.inputCount;
+    grShader->inputs = ilcShader.inputs;
+    grShader->outputMask = ilcShader.outputMask;
+    grShader->name = ilcShader.name;
+}
+
+static void CALLBACK compileShaderCallback(
+    PTP_CALLBACK_INSTANCE instance,
+    PVOID context,
+    PTP_WORK work)
+{
+    GrShader* grShader = context;
+    GrDevice* grDevice = GET_OBJ_DEVICE(grShader);
+
+    compileShader(grShader);
+
+    // Let grDestroyDevice know the device is no longer in use
+    AcquireSRWLockExclusive(&grDevice->pendingCompileLock);
+    grDevice->pendingCompileCount--;
+    WakeAllConditionVariable(&grDevice->pendingCompileCond);
+    ReleaseSRWLockExclusive(&grDevice->pendingCompileLock);
+}
+
+VkResult grShaderWait(
+    GrShader* grShader)
+{
+    AcquireSRWLockExclusive(&grShader->compileLock);
+
+    if (grShader->compileWork != NULL) {
+        WaitForThreadpoolWorkCallbacks(grShader->compileWork, FALSE);
+        CloseThreadpoolWork(grShader->compileWork);
+        grShader->compileWork = NULL;
+    }
+
+    ReleaseSRWLockExclusive(&grShader->compileLock);
+
+    return grShader->compileResult;
+}
+
+static VkShaderModule getLinkedShaderModule(
+    GrShader* grShader,
+    uint32_t outputMask)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grShader);
+    VkShaderModule vkShaderModule = VK_NULL_HANDLE;
+
+    // Only recompile if some outputs can be dropped, and if the shader isn't overridden
+    outputMask &= grShader->outputMask;
+    if (outputMask == grShader->outputMask || grShader->ilCode == NULL) {
+        return grShader->shaderModule;
+    }
+
+    AcquireSRWLockExclusive(&grShader->compileLock);
+
+    for (unsigned i = 0; i < grShader->linkedShaderModuleCount; i++) {
+        if (grShader->linkedShaderModules[i].outputMask == outputMask) {
+            vkShaderModule = grShader->linkedShaderModules[i].shaderModule;
+            break;
+        }
+    }
+
+    if (vkShaderModule == VK_NULL_HANDLE) {
+        IlcShader ilcShader = ilcCompileLinkedShader(grShader->ilCode, grShader->ilCodeSize,
+                                                     outputMask, grDevice->controlFlowHints);
+
+        const VkShaderModuleCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .codeSize = ilcShader.codeSize,
+            .pCode = ilcShader.code,
+        };
+
+        VkResult res = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL,
+                                                &vkShaderModule);
+        if (res == VK_SUCCESS) {
+            grShader->linkedShaderModuleCount++;
+            grShader->linkedShaderModules = realloc(grShader->linkedShaderModules,
+                                                    grShader->linkedShaderModuleCount *
+                                                    sizeof(LinkedShaderModule));
+            grShader->linkedShaderModules[grShader->linkedShaderModuleCount - 1] =
+                (LinkedShaderModule) {
+                    .outputMask = outputMask,
+                    .shaderModule = vkShaderModule,
+                };
+        } else {
+            LOGW("vkCreateShaderModule failed (%d), using the unlinked shader\n", res);
+            vkShaderModule = grShader->shaderModule;
+        }
+
+        free(ilcShader.code);
+        free(ilcShader.bindings);
+        free(ilcShader.inputs);
+        free(ilcShader.name);
+    }
+
+    ReleaseSRWLockExclusive(&grShader->compileLock);
+
+    return vkShaderModule;
+}
+
+static VkShaderModule getRectangleVertexShaderModule(
+    const GrShader* grShader,
+    const GrShader* grPixelShader)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grShader);
+    VkShaderModule vkShaderModule = VK_NULL_HANDLE;
+
+    if (grShader->ilCode == NULL) {
+        // Overridden shader, use the rectangle geometry shader
+        return VK_NULL_HANDLE;
+    }
+
+    IlcShader ilcShader = ilcCompileRectangleVertexShader(
+        grShader->ilCode, grShader->ilCodeSize,
+        grPixelShader != NULL ? grPixelShader->inputCount : 0,
+        grPixelShader != NULL ? grPixelShader->inputs : NULL, grDevice->controlFlowHints);
+
+    if (ilcShader.code == NULL) {
+        // Not expandable, use the rectangle geometry shader
+        return VK_NULL_HANDLE;
+    }
+
+    const VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .codeSize = ilcShader.codeSize,
+        .pCode = ilcShader.code,
+    };
+
+    VkResult res = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &vkShaderModule);
+    if (res != VK_SUCCESS) {
+        LOGW("vkCreateShaderModule failed (%d), using the rectangle geometry shader\n", res);
+        vkShaderModule = VK_NULL_HANDLE;
+    }
+
+    free(ilcShader.code);
+    free(ilcShader.bindings);
+    free(ilcShader.inputs);
+    free(ilcShader.name);
+
+    return vkShaderModule;
+}
+
+static bool isSameInputSignature(
+    unsigned inputCount,
+    const IlcInput* inputs,
+    const RectangleShaderModule* rectangleShaderModule)
+{
+    if (inputCount != rectangleShaderModule->inputCount) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < inputCount; i++) {
+        if (inputs[i].locationIndex != rectangleShaderModule->inputs[i].locationIndex ||
+            inputs[i].interpMode != rectangleShaderModule->inputs[i].interpMode) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static VkResult getRectangleShaderModule(
+    VkShaderModule* pShaderModule,
+    GrDevice* grDevice,
+    const GrShader* grPixelShader)
+{
+    unsigned inputCount = grPixelShader != NULL ? grPixelShader->inputCount : 0;
+    const IlcInput* inputs = grPixelShader != NULL ? grPixelShader->inputs : NULL;
+    VkShaderModule vkShaderModule = VK_NULL_HANDLE;
+    VkResult res = VK_SUCCESS;
+
+    // The geometry shader only depends on the pixel shader inputs, share it between pipelines
+    AcquireSRWLockExclusive(&grDevice->rectangleShaderModuleLock);
+
+    for (unsigned i = 0; i < grDevice->rectangleShaderModuleCount; i++) {
+        if (isSameInputSignature(inputCount, inputs, &grDevice->rectangleShaderModules[i])) {
+            vkShaderModule = grDevice->rectangleShaderModules[i].shaderModule;
+            break;
+        }
+    }
+
+    if (vkShaderModule == VK_NULL_HANDLE) {
+        IlcShader ilcShader = ilcCompileRectangleGeometryShader(inputCount, inputs);
+
+        const VkShaderModuleCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .codeSize = ilcShader.codeSize,
+            .pCode = ilcShader.code,
+        };
+
+        res = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &vkShaderModule);
+        free(ilcShader.code);
+
+        if (res == VK_SUCCESS) {
+            IlcInput* inputsCopy = NULL;
+            if (inputCount > 0) {
+                inputsCopy = malloc(inputCount * sizeof(IlcInput));
+                memcpy(inputsCopy, inputs, inputCount * sizeof(IlcInput));
+            }
+
+            grDevice->rectangleShaderModuleCount++;
+            grDevice->rectangleShaderModules = realloc(grDevice->rectangleShaderModules,
+                                                       grDevice->rectangleShaderModuleCount *
+                                                       sizeof(RectangleShaderModule));
+            grDevice->rectangleShaderModules[grDevice->rectangleShaderModuleCount - 1] =
+                (RectangleShaderModule) {
+                    .inputCount = inputCount,
+                    .inputs = inputsCopy,
+                    .shaderModule = vkShaderModule,
+                };
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->rectangleShaderModuleLock);
+
+    *pShaderModule = vkShaderModule;
+    return res;
+}
+
+// Shader and Pipeline Functions
+
+GR_RESULT GR_STDCALL grCreateShader(
+    GR_DEVICE device,
+    const GR_SHADER_CREATE_INFO* pCreateInfo,
+    GR_SHADER* pShader)
+{
+    LOGT("%p %p %p\n", device, pCreateInfo, pShader);
+    GrDevice* grDevice = (GrDevice*)device;
+
+    // ALLOW_RE_Z flag doesn't have a Vulkan equivalent. RADV determines it automatically.
+
     GrShader* grShader = malloc(sizeof(GrShader));
     *grShader = (GrShader) {
         .grObj = { GR_OBJ_TYPE_SHADER, grDevice },
         .refCount = 1,
-        .shaderModule = vkShaderModule,
-        .bindingCount = ilcShader.bindingCount,
-        .bindings = ilcShader.bindings,
-        .inputCount = ilcShader.inputCount,
-        .inputs = ilcShader.inputs,
-        .name = ilcShader.name,
+        .compileLock = SRWLOCK_INIT,
+        .compileWork = NULL,
+        .ilCode = malloc(pCreateInfo->codeSize),
+        .ilCodeSize = pCreateInfo->codeSize,
+        .compileResult = VK_SUCCESS,
+        .shaderModule = VK_NULL_HANDLE,
+        .bindingCount = 0,
+        .bindings = NULL,
+        .inputCount = 0,
+        .inputs = NULL,
+        .outputMask = 0,
+        .linkedShaderModuleCount = 0,
+        .linkedShaderModules = NULL,
+        .name = NULL,
     };
 
+    // The IL code may be freed by the application once this returns
+    memcpy(grShader->ilCode, pCreateInfo->pCode, pCreateInfo->codeSize);
+
+    // Compile on the system thread pool, users of the shader wait for completion
+    grShader->compileWork = CreateThreadpoolWork(compileShaderCallback, grShader, NULL);
+    if (grShader->compileWork != NULL) {
+        AcquireSRWLockExclusive(&grDevice->pendingCompileLock);
+        grDevice->pendingCompileCount++;
+        ReleaseSRWLockExclusive(&grDevice->pendingCompileLock);
+
+        SubmitThreadpoolWork(grShader->compileWork);
+    } else {
+        LOGW("failed to create thread pool work (%lu), compiling synchronously\n",
+             GetLastError());
+        compileShader(grShader);
+    }
+
     *pShader = (GR_SHADER)grShader;
     return GR_SUCCESS;
 }
@@ -681,6 +978,7 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkShaderModule rectangleShaderModule = VK_NULL_HANDLE;
+    VkShaderModule rectangleVertexShaderModule = VK_NULL_HANDLE;
     unsigned dynamicOffsetCount = 0;
     unsigned updateTemplateSlotCounts[GR_MAX_DESCRIPTOR_SETS] = { 0 };
     UpdateTemplateSlot* updateTemplateSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
@@ -702,6 +1000,36 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         { &pCreateInfo->ps, VK_SHADER_STAGE_FRAGMENT_BIT },
     };
 
+    // Wait for background compilation to finish before referencing any shader
+    for (int i = 0; i < COUNT_OF(stages); i++) {
+        GrShader* grShader = (GrShader*)stages[i].shader->shader;
+
+        if (grShader != NULL) {
+            vkRes = grShaderWait(grShader);
+            if (vkRes != VK_SUCCESS) {
+                return getGrResult(vkRes);
+            }
+        }
+    }
+
+    // The last pre-rasterization stage only has to write the inputs of the pixel shader (which
+    // the rectangle geometry shader forwards)
+    const GrShader* grPixelShader = (GrShader*)stages[4].shader->shader;
+    uint32_t linkedOutputMask = 0;
+    int linkedStageIndex = -1;
+
+    for (unsigned i = 0; grPixelShader != NULL && i < grPixelShader->inputCount; i++) {
+        if (grPixelShader->inputs[i].locationIndex < 32) {
+            linkedOutputMask |= 1u << grPixelShader->inputs[i].locationIndex;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        if (stages[i].shader->shader != GR_NULL_HANDLE &&
+            stages[i].flags != VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT) {
+            linkedStageIndex = i;
+        }
+    }
+
     unsigned stageCount = 0;
     VkPipelineShaderStageCreateInfo shaderStageCreateInfo[COUNT_OF(stages)];
 
@@ -727,7 +1055,8 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
             .pNext = NULL,
             .flags = 0,
             .stage = stage->flags,
-            .module = grShader->shaderModule,
+            .module = i == linkedStageIndex ? getLinkedShaderModule(grShader, linkedOutputMask)
+                                            : grShader->shaderModule,
             .pName = "main",
             .pSpecializationInfo = NULL,
         };
@@ -749,23 +1078,7 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
             assert(false);
         }
 
-        GrShader* grPixelShader = (GrShader*)stages[4].shader->shader;
-        IlcShader rectangleShader = ilcCompileRectangleGeometryShader(
-            grPixelShader != NULL ? grPixelShader->inputCount : 0,
-            grPixelShader != NULL ? grPixelShader->inputs : NULL);
-
-        const VkShaderModuleCreateInfo rectangleShaderModuleCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
-            .codeSize = rectangleShader.codeSize,
-            .pCode = rectangleShader.code,
-        };
-
-        vkRes = VKD.vkCreateShaderModule(grDevice->device, &rectangleShaderModuleCreateInfo, NULL,
-                                         &rectangleShaderModule);
-        free(rectangleShader.code);
-
+        vkRes = getRectangleShaderModule(&rectangleShaderModule, grDevice, grPixelShader);
         if (vkRes != VK_SUCCESS) {
             res = getGrResult(vkRes);
             goto bail;
@@ -782,6 +1095,12 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         };
 
         stageCount++;
+
+        // Non-indexed draws can expand rectangles in the vertex stage instead, see grCmdDraw
+        if (grDevice->expandRectangles && stages[0].shader->shader != GR_NULL_HANDLE) {
+            rectangleVertexShaderModule = getRectangleVertexShaderModule(
+                (GrShader*)stages[0].shader->shader, grPixelShader);
+        }
     }
 
     VkFormat colorFormats[GR_MAX_COLOR_TARGETS];
@@ -810,6 +1129,7 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         .colorWriteMasks = { 0 }, // Initialized below
         .depthFormat = getDepthVkFormat(pCreateInfo->dbState.format),
         .stencilFormat = getStencilVkFormat(pCreateInfo->dbState.format),
+        .rectangleVertexShaderModule = rectangleVertexShaderModule,
     };
 
     memcpy(pipelineCreateInfo->stageCreateInfos, shaderStageCreateInfo,
@@ -838,7 +1158,6 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
                                grDevice, COUNT_OF(stages), stages, i, descriptorSetLayout);
     }
 
-    // TODO keep track of rectangle shader module
     GrPipeline* grPipeline = malloc(sizeof(GrPipeline));
     *grPipeline = (GrPipeline) {
         .grObj = { GR_OBJ_TYPE_PIPELINE, grDevice },
@@ -846,6 +1165,8 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         .createInfo = pipelineCreateInfo,
         .hasTessellation = hasTessellation,
         .pipeline = VK_NULL_HANDLE, // We don't know the attachment formats yet (Frostbite bug)
+        .rectanglePipeline = VK_NULL_HANDLE,
+        .isRectanglePipelineInvalid = false,
         .pipelineLayout = pipelineLayout,
         .stageCount = COUNT_OF(stages),
         .descriptorSetLayout = descriptorSetLayout,
@@ -866,7 +1187,7 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
 bail:
     VKD.vkDestroyDescriptorSetLayout(grDevice->device, descriptorSetLayout, NULL);
     VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
-    VKD.vkDestroyShaderModule(grDevice->device, rectangleShaderModule, NULL);
+    VKD.vkDestroyShaderModule(grDevice->device, rectangleVertexShaderModule, NULL);
     return res;
 }
 
@@ -897,6 +1218,11 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
 
     GrShader* grShader = (GrShader*)stage.shader->shader;
 
+    vkRes = grShaderWait(grShader);
+    if (vkRes != VK_SUCCESS) {
+        return getGrResult(vkRes);
+    }
+
     grShader->refCount++;
 
     const VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {
@@ -28,6 +28,12 @@ typedef enum {
     // RADV doesn't support linear transfer-only images used by Star Swarm, but it has no effect
     // on rendering. Silence it.
     QUIRK_SILENCE_TRANSFER_ONLY_LINEAR_IMAGE_WARNINGS = 1 << 7,
+
+    // Unrolling fixed loops in shaders doesn't pay off, keep all of them rolled
+    QUIRK_SHADER_DONT_UNROLL_LOOPS = 1 << 8,
+
+    // Flattening short branches in shaders doesn't pay off, keep all of them as branches
+    QUIRK_SHADER_DONT_FLATTEN_BRANCHES = 1 << 9,
 } QUIRK_FLAGS;
 
 void quirkInit(
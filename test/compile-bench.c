@@ -0,0 +1,264 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "amdilc_internal.h"
+
+#define ITERATION_COUNT (100)
+#define TEMPS_PREFIX "temps:"
+
+// Heap statistics, updated by the --wrap'd allocation functions
+static unsigned mAllocCount = 0;
+static uint64_t mAllocSize = 0;
+static int64_t mLiveSize = 0;
+static int64_t mPeakLiveSize = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static void trackAlloc(
+    void* ptr,
+    size_t size)
+{
+    mAllocCount++;
+    mAllocSize += size;
+    mLiveSize += malloc_usable_size(ptr);
+    if (mLiveSize > mPeakLiveSize) {
+        mPeakLiveSize = mLiveSize;
+    }
+}
+
+void* __wrap_malloc(
+    size_t size)
+{
+    void* ptr = __real_malloc(size);
+
+    trackAlloc(ptr, size);
+    return ptr;
+}
+
+void* __wrap_calloc(
+    size_t count,
+    size_t size)
+{
+    void* ptr = __real_calloc(count, size);
+
+    trackAlloc(ptr, count * size);
+    return ptr;
+}
+
+void* __wrap_realloc(
+    void* ptr,
+    size_t size)
+{
+    mLiveSize -= malloc_usable_size(ptr);
+    ptr = __real_realloc(ptr, size);
+
+    trackAlloc(ptr, size);
+    return ptr;
+}
+
+void __wrap_free(
+    void* ptr)
+{
+    mLiveSize -= malloc_usable_size(ptr);
+    __real_free(ptr);
+}
+
+static double getTime()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void freeShader(
+    IlcShader* shader)
+{
+    free(shader->code);
+    free(shader->bindings);
+    free(shader->inputs);
+    free(shader->name);
+}
+
+static unsigned countMovs(
+    const Kernel* kernel)
+{
+    unsigned movCount = 0;
+
+    for (unsigned i = 0; i < kernel->instrCount; i++) {
+        if (kernel->instrs[i].opcode == IL_OP_MOV) {
+            movCount++;
+        }
+    }
+
+    return movCount;
+}
+
+static unsigned countSpirvInstructions(
+    const IlcShader* shader)
+{
+    unsigned wordCount = shader->codeSize / sizeof(uint32_t);
+    unsigned instrCount = 0;
+
+    // Skip the header, each instruction starts with its word count in the high half-word
+    for (unsigned idx = 5; idx < wordCount && (shader->code[idx] >> 16) > 0;
+         idx += shader->code[idx] >> 16) {
+        instrCount++;
+    }
+
+    return instrCount;
+}
+
+static unsigned putRegister(
+    uint32_t* tokens,
+    unsigned type,
+    unsigned num)
+{
+    tokens[0] = num | (type << 16);
+    return 1;
+}
+
+static uint32_t* generateTempsKernel(
+    unsigned tempCount,
+    unsigned* size)
+{
+    // Pixel shader accumulating an input into r# registers, each add reading back an earlier
+    // temporary so that nothing folds away
+    uint32_t* tokens = malloc(sizeof(uint32_t) * (14 + 4 * tempCount));
+    unsigned idx = 0;
+
+    tokens[idx++] = IL_LANG_DX11_PS;
+    tokens[idx++] = (IL_SHADER_PIXEL << 16) | (2 << 8);
+    tokens[idx++] = IL_DCL_OUTPUT | (IL_IMPORTUSAGE_GENERIC << 16);
+    idx += putRegister(&tokens[idx], IL_REGTYPE_OUTPUT, 0);
+    tokens[idx++] = IL_DCL_INPUT | (IL_IMPORTUSAGE_GENERIC << 16) | (IL_INTERPMODE_LINEAR << 21);
+    idx += putRegister(&tokens[idx], IL_REGTYPE_INPUT, 0);
+    tokens[idx++] = IL_OP_MOV;
+    idx += putRegister(&tokens[idx], IL_REGTYPE_TEMP, 0);
+    idx += putRegister(&tokens[idx], IL_REGTYPE_INPUT, 0);
+
+    for (unsigned i = 1; i < tempCount; i++) {
+        tokens[idx++] = IL_OP_ADD;
+        idx += putRegister(&tokens[idx], IL_REGTYPE_TEMP, i);
+        idx += putRegister(&tokens[idx], IL_REGTYPE_TEMP, i - 1);
+        idx += putRegister(&tokens[idx], IL_REGTYPE_TEMP, ((i * 2654435761u) >> 8) % i);
+    }
+
+    tokens[idx++] = IL_OP_MOV;
+    idx += putRegister(&tokens[idx], IL_REGTYPE_OUTPUT, 0);
+    idx += putRegister(&tokens[idx], IL_REGTYPE_TEMP, tempCount - 1);
+    tokens[idx++] = IL_OP_RET_DYN;
+    tokens[idx++] = IL_OP_END;
+
+    *size = sizeof(uint32_t) * idx;
+    return tokens;
+}
+
+static void* readFile(
+    const char* path,
+    unsigned* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    uint8_t* data;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    data = malloc(*size);
+    fseek(file, 0, SEEK_SET);
+    fread(data, 1, *size, file);
+    fclose(file);
+
+    return data;
+}
+
+int main(int argc, char *args[])
+{
+    if (argc < 2) {
+        printf("usage: %s il.bin|" TEMPS_PREFIX "count ...\n", args[0]);
+        return 1;
+    }
+
+    // Keep stdout machine-readable
+    gLogLevel = LOG_LEVEL_NONE;
+
+    // One line per file: name, IL instruction and mov counts, SPIR-V size in words and
+    // instruction count, mean and best time per compile in us, allocations and allocated bytes
+    // per compile, peak heap usage in bytes
+    printf("file,il_instrs,il_movs,words,spv_instrs,us_per_compile,us_min,"
+           "allocs_per_compile,bytes_per_compile,peak_bytes\n");
+
+    for (int i = 1; i < argc; i++) {
+        unsigned size;
+        void* data;
+
+        // Synthetic kernels stress register lookups with thousands of temporaries
+        if (strncmp(args[i], TEMPS_PREFIX, strlen(TEMPS_PREFIX)) == 0) {
+            unsigned tempCount = strtoul(&args[i][strlen(TEMPS_PREFIX)], NULL, 10);
+            if (tempCount < 2 || tempCount > 0x10000) {
+                printf("invalid temporary count in %s\n", args[i]);
+                return 1;
+            }
+
+            data = generateTempsKernel(tempCount, &size);
+        } else {
+            data = readFile(args[i], &size);
+            if (data == NULL) {
+                printf("failed to open %s\n", args[i]);
+                return 1;
+            }
+        }
+
+        // Shows how many IL movs are left for the SPIR-V passes to clean up
+        Kernel* kernel = ilcDecodeStream(data, size / sizeof(Token));
+        unsigned ilInstrCount = kernel->instrCount;
+        unsigned ilMovCount = countMovs(kernel);
+        free(kernel);
+
+        // Warm up, and measure the heap on a single compile
+        mAllocCount = 0;
+        mAllocSize = 0;
+        mPeakLiveSize = mLiveSize;
+        int64_t baseLiveSize = mLiveSize;
+
+        IlcShader shader = ilcCompileShader(data, size, ILC_HINT_DEFAULT);
+        unsigned wordCount = shader.codeSize / sizeof(uint32_t);
+        unsigned spvInstrCount = countSpirvInstructions(&shader);
+        unsigned allocCount = mAllocCount;
+        uint64_t allocSize = mAllocSize;
+        int64_t peakSize = mPeakLiveSize - baseLiveSize;
+        freeShader(&shader);
+
+        double totalTime = 0.0;
+        double minTime = 0.0;
+        for (unsigned j = 0; j < ITERATION_COUNT; j++) {
+            double start = getTime();
+            shader = ilcCompileShader(data, size, ILC_HINT_DEFAULT);
+            double time = getTime() - start;
+
+            freeShader(&shader);
+            totalTime += time;
+            if (j == 0 || time < minTime) {
+                minTime = time;
+            }
+        }
+
+        const char* name = strrchr(args[i], '/');
+        printf("%s,%u,%u,%u,%u,%.1f,%.1f,%u,%llu,%lld\n", name != NULL ? name + 1 : args[i],
+               ilInstrCount, ilMovCount, wordCount, spvInstrCount,
+               1e6 * totalTime / ITERATION_COUNT, 1e6 * minTime, allocCount,
+               (unsigned long long)allocSize, (long long)peakSize);
+
+        free(data);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "amdilc_sha1.h"
+
+#define ITERATION_COUNT (1000)
+
+int main(int argc, char *args[])
+{
+    if (argc < 2) {
+        printf("usage: %s il.bin ...\n", args[0]);
+        return 1;
+    }
+
+    // One line per file: name, size in bytes, time per hash in us, throughput in MB/s
+    printf("file,size,us_per_hash,mb_per_s\n");
+
+    for (int i = 1; i < argc; i++) {
+        FILE* file = fopen(args[i], "rb");
+        if (file == NULL) {
+            printf("failed to open %s\n", args[i]);
+            return 1;
+        }
+
+        unsigned size;
+        uint8_t* data;
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        data = malloc(size);
+        fseek(file, 0, SEEK_SET);
+        fread(data, 1, size, file);
+        fclose(file);
+
+        uint8_t digest[SHA1_SIZE] = { 0 };
+        clock_t start = clock();
+        for (unsigned j = 0; j < ITERATION_COUNT; j++) {
+            // Feed the previous digest back to prevent the loop from being optimized away
+            memcpy(data, digest, size < SHA1_SIZE ? size : SHA1_SIZE);
+            ilcSha1(digest, data, size);
+        }
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        const char* name = strrchr(args[i], '/');
+        printf("%s,%u,%.3f,%.1f\n", name != NULL ? name + 1 : args[i], size,
+               1e6 * seconds / ITERATION_COUNT, size * (double)ITERATION_COUNT / seconds / 1e6);
+
+        free(data);
+    }
+
+    return 0;
+}